@@ -106,6 +106,19 @@ typedef struct {
 } LAYER_VEL_MODEL;
 
 
+
+/**
+ * @brief The derived geometry of the station, it is computed once when the station is loaded & copied
+ *        into the picks, so the hot paths don't need to compute it from the degrees again.
+ *
+ */
+typedef struct {
+	double longitude;   /* Longitude of station in degree */
+	double latitude;    /* Latitude of station in degree */
+	double km_per_lon;  /* The local distance (in km) per degree of the longitude at the station */
+	double km_per_lat;  /* The local distance (in km) per degree of the latitude at the station */
+} STA_GEOMETRY;
+
 /**
  * @brief SNL info related struct
  *
@@ -118,6 +131,8 @@ typedef struct {
 	double latitude;      /* Latitude of station in degree */
 	double longitude;     /* Longitude of station in degree */
 	double elevation;     /* Elevation of station in meter */
+
+	STA_GEOMETRY geometry;
 } USE_SNL;
 
 /**
@@ -132,6 +147,8 @@ typedef struct {
 	double  distance;
 	double  residual;
 	double  r_weight;
+/* The geometry of the station */
+	STA_GEOMETRY geometry;
 /* */
 	EARLY_PICK_MSG observe;
 } PICK_STATE;
@@ -149,6 +166,47 @@ typedef struct {
 	int      cosites;
 } PICKS_POOL;
 
+/**
+ * @brief Statistics of the locating process for each hypo
+ *
+ */
+typedef struct {
+	uint32_t locates;        /* Number of the primary locating */
+	uint32_t iterations;     /* Number of the Geiger's linearizations in total */
+	uint16_t last_iters;     /* Number of the Geiger's linearizations in the last locating */
+	uint32_t incrementals;   /* Number of the accepted incremental relocating */
+	uint32_t fallbacks;      /* Number of the incremental relocating fell back to the full locating */
+	uint32_t robusts;        /* Number of the robust locating */
+	uint32_t saved;          /* Number of the full locating saved by the robust locating */
+	uint32_t ray_hits;       /* Number of the 3D rays returned from the cache directly */
+	uint32_t ray_warms;      /* Number of the 3D rays warm started from the cached ray */
+	uint32_t ray_colds;      /* Number of the 3D rays traced from the straight ray */
+	uint32_t ray_warm_iters; /* Number of the bending iterations of the warm started rays */
+	uint32_t ray_cold_iters; /* Number of the bending iterations of the cold started rays */
+	uint32_t ray_segments;   /* Number of the segments of the traced rays in total */
+} HYPO_LOC_STATS;
+
+/**
+ * @brief The normal equations (GtWG & GtWd) of the last Geiger's solution, it will be used by
+ *        the incremental relocating when there is only one new pick.
+ *
+ */
+typedef struct {
+	uint8_t  ready;
+	int      valids;
+	uint64_t pickset;  /* Order-independent hash of the valid picks */
+	double   misfit;
+	double   weight_norm;
+	double   delta_x;
+	double   delta_y;
+	double   longitude;
+	double   latitude;
+	double   depth;
+	double   origin_time;
+	double   gtwg[HYPO_PARAMS_NUMBER * HYPO_PARAMS_NUMBER];
+	double   gtwd[HYPO_PARAMS_NUMBER];
+} HYPO_NORMAL_EQS;
+
 /*
  *
  */
@@ -173,6 +231,13 @@ typedef struct hypo_state {
 	double ig_longitude;
 	double ig_depth;
 	double ig_origin_time;
+/* */
+	HYPO_LOC_STATS  stats;
+	HYPO_NORMAL_EQS normal;
+/* The cached 3D rays of each station & phase, only accessed by the hypo's thread */
+	void           *ray_caches;
+/* The 3D velocity model held by the hypo, the rays above are traced within it */
+	const void     *velmod;
 /* */
 	PICKS_POOL pool;
 	PICKS_POOL pick_queue;
@@ -197,6 +262,12 @@ typedef struct {
 #define EL_HYPO_POOL_INIT(__HYPO_POOL) \
 		((__HYPO_POOL) = (HYPOS_POOL){ NULL, NULL, 0 })
 /* */
+#define EL_HYPO_LOC_STATS_INIT(__STATS) \
+		((__STATS) = (HYPO_LOC_STATS){ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 })
+/* */
+#define EL_HYPO_NORMAL_EQS_RESET(__NEQS) \
+		((__NEQS).ready = 0)
+/* */
 #define EL_PICK_VALID_LOCATE(__PICK) \
 		(!((__PICK)->flag & PICK_FLAG_REJECT || (__PICK)->flag & PICK_FLAG_LOCMASK || (__PICK)->flag & PICK_FLAG_COSITE))
 /* */
@@ -15,6 +15,12 @@
 int      el_list_db_fetch( const char *, const DBINFO *, const int );
 int      el_list_sta_line_parse( const char *, const int );
 void     el_list_end( void );
+int      el_list_refresh_init( const char [][MAX_TABLE_LEGTH], const int, const DBINFO *, const int );
+void     el_list_refresh_request( void );
+void     el_list_unknown_request( const EARLY_PICK_MSG * );
+int      el_list_snapshot_init( const char * );
+int      el_list_snapshot_load( void );
+int      el_list_snapshot_save( void );
 USE_SNL *el_list_find( const EARLY_PICK_MSG * );
 void     el_list_tree_activate( void );
 void     el_list_tree_abandon( void );
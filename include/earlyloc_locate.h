@@ -10,15 +10,22 @@
  */
 #pragma once
 /* */
+#include <raytracing.h>
 #include <earlyloc.h>
 
 /* */
 int el_loc_primary_locate( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
+int el_loc_robust_locate( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
+int el_loc_incremental_locate( HYPO_STATE *, const PICK_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 void el_loc_all_states_update( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 void el_loc_location_guess( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 void el_loc_location_refine( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *, const int );
 double el_loc_origintime_adjust( HYPO_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 double el_loc_residual_estimate( const HYPO_STATE *, const PICK_STATE *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
+double el_loc_travel_time( const double, const double, const char *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 /* */
-int el_loc_3dvelmod_load( const char * );
-void el_loc_3dvelmod_free( void );
+int el_loc_3dtrace_init( const int );
+void el_loc_3dtrace_profile( const double, const double, const int );
+void el_loc_3dtrace_free( void );
+void el_loc_ray_cache_free( HYPO_STATE * );
+void el_loc_3dvelmod_release( HYPO_STATE * );
@@ -9,10 +9,16 @@
  *
  */
 #pragma once
+/* */
+#include <earlyloc.h>
 
 #define EL_SIMPLE_TIMESTAMP_BUF_SIZE    16
 
 /* */
 double el_misc_timenow( void );
+double el_misc_timenow_precise( void );
 char  *el_misc_simple_timestamp_gen( char *, const int, const double );
 double el_misc_geog2distf( const double, const double, const double, const double );
+void   el_misc_geog_km_per_deg( const double, double *, double * );
+STA_GEOMETRY *el_misc_geometry_init( STA_GEOMETRY *, const double, const double );
+double el_misc_geometry_distf( const STA_GEOMETRY *, const STA_GEOMETRY * );
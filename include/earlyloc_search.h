@@ -0,0 +1,41 @@
+/**
+ * @file earlyloc_search.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief
+ * @version 0.1
+ * @date 2023-10-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#include <earlyloc.h>
+/*
+ *
+ */
+#define EL_SEARCH_SCORE_TABLE \
+		X(EL_SEARCH_SCORE_EDT,   "EDT" ) \
+		X(EL_SEARCH_SCORE_L1,    "L1"  ) \
+		X(EL_SEARCH_SCORE_COUNT, "null")
+
+#define X(a, b) a,
+typedef enum {
+	EL_SEARCH_SCORE_TABLE
+} EL_SEARCH_SCORES;
+#undef X
+
+/**
+ * @brief Elapsed time (in second) of each stage & the number of evaluated nodes of one searching
+ *
+ */
+typedef struct {
+	double coarse;
+	double octree;
+	int    nodes;
+} SEARCH_STATS;
+
+/* */
+int  el_search_init( const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *, const int, const int );
+int  el_search_location_guess( HYPO_STATE *, SEARCH_STATS * );
+void el_search_free( void );
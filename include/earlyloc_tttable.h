@@ -0,0 +1,19 @@
+/**
+ * @file earlyloc_tttable.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief
+ * @version 0.1
+ * @date 2023-10-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#include <raytracing.h>
+#include <earlyloc.h>
+
+/* */
+int  el_tttable_init( const char *, const double, const double, const double, const int );
+int  el_tttable_lookup( const RT_VELMOD *, const PICK_STATE *, const double, const double, const double, double *, double [3] );
+void el_tttable_free( void );
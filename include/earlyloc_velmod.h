@@ -0,0 +1,22 @@
+/**
+ * @file earlyloc_velmod.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief
+ * @version 0.1
+ * @date 2023-10-27
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#include <raytracing.h>
+
+/* */
+int  el_velmod_load( const char * );
+int  el_velmod_compact( void );
+int  el_velmod_reload_init( const int );
+const RT_VELMOD *el_velmod_get( void );
+const RT_VELMOD *el_velmod_acquire( void );
+void el_velmod_release( const RT_VELMOD * );
+void el_velmod_free( void );
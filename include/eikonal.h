@@ -0,0 +1,33 @@
+/**
+ * @file eikonal.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Travel time field of the point source by the fast sweeping method on the regular geographic grid.
+ * @version 0.1
+ * @date 2023-10-25
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#define EIK_MAX_THREADS  8
+
+/**
+ * @brief The regular grid which nodes are ordered by longitude first, then latitude & depth last.
+ *
+ */
+typedef struct {
+	int    nlon;
+	int    nlat;
+	int    ndep;
+/* Origin & steps of the grid, in degree & km */
+	double lon0;
+	double lat0;
+	double dep0;
+	double dlon;
+	double dlat;
+	double ddep;
+} EIK_GRID;
+
+/* */
+int eik_solve( const EIK_GRID *, const float *, const double, const double, const double, const int, float * );
@@ -21,6 +21,34 @@ typedef struct {
 	double *element;
 } MATRIX;
 
+/**
+ * @brief The reusable memory for the matrices & the temporaries of the _into functions, the matrices
+ *        taken from it are valid until it is reset or freed.
+ *
+ */
+typedef struct matrix_workspace MATRIX_WORKSPACE;
+
+/**
+ * @brief The batch of the 4x4 symmetric systems (e.g. the normal equations of many candidate hypocenters)
+ *        in the structure-of-arrays layout, the same element of all the systems is contiguous, so they
+ *        are factored together across the SIMD lanes. Only the lower triangle of a is read.
+ *
+ */
+typedef struct {
+	int     count;
+	int    *rank;  /* The numerical rank of each system, it is solved only when the rank is full */
+	double *a;     /* Element (r, c) of system k is a[(r * MATRIX_BATCH_RANK + c) * count + k] */
+	double *b;     /* Element r of system k is b[r * count + k], so as x */
+	double *x;
+} MATRIX_BATCH;
+
+/* The rank of the batched systems */
+#define MATRIX_BATCH_RANK  4
+
+/* Wrap the caller's array (e.g. on the stack) as the matrix, it won't be freed by matrix_free */
+#define MATRIX_INIT( _ROW, _COL, _ELEMENT ) \
+		((MATRIX){ (_ROW), (_COL), (long)(_ROW) * (_COL), (_ELEMENT) })
+
 /* */
 MATRIX *matrix_new( const int, const int );
 MATRIX *matrix_identity( const int );
@@ -30,9 +58,36 @@ MATRIX *matrix_sub( const MATRIX *, const MATRIX * );
 MATRIX *matrix_mul( const MATRIX *, const MATRIX * );
 MATRIX *matrix_div( const MATRIX *, const MATRIX * );
 MATRIX *matrix_div_weighted( const MATRIX *, const MATRIX *, const MATRIX * );
+MATRIX *matrix_div_weighted_damped( const MATRIX *, const MATRIX *, const MATRIX *, const double );
+MATRIX *matrix_div_weighted_vector( const MATRIX *, const MATRIX *, const double *, const double );
 MATRIX *matrix_transpose( const MATRIX * );
 MATRIX *matrix_inverse( const MATRIX * );
 
+MATRIX *matrix_mul_into( MATRIX *, const MATRIX *, const MATRIX * );
+MATRIX *matrix_mul_tn_into( MATRIX *, const MATRIX *, const MATRIX * );
+MATRIX *matrix_gtdg_into( MATRIX *, MATRIX *, const MATRIX *, const double *, const MATRIX * );
+MATRIX *matrix_transpose_into( MATRIX *, const MATRIX * );
+MATRIX *matrix_inverse_into( MATRIX *, const MATRIX *, MATRIX_WORKSPACE * );
+MATRIX *matrix_div_into( MATRIX *, const MATRIX *, const MATRIX *, MATRIX_WORKSPACE * );
+MATRIX *matrix_div_weighted_into( MATRIX *, const MATRIX *, const MATRIX *, const MATRIX *, MATRIX_WORKSPACE * );
+MATRIX *matrix_div_weighted_damped_into(
+	MATRIX *, const MATRIX *, const MATRIX *, const MATRIX *, const double, MATRIX_WORKSPACE *
+);
+MATRIX *matrix_div_weighted_vector_into(
+	MATRIX *, const MATRIX *, const MATRIX *, const double *, const double, MATRIX_WORKSPACE *
+);
+
+MATRIX_WORKSPACE *matrix_workspace_new( const long );
+MATRIX *matrix_workspace_get( MATRIX_WORKSPACE *, const int, const int );
+void    matrix_workspace_reset( MATRIX_WORKSPACE * );
+void    matrix_workspace_free( MATRIX_WORKSPACE * );
+
+MATRIX_BATCH *matrix_batch_new( const int );
+MATRIX_BATCH *matrix_batch_assign( MATRIX_BATCH *, const int, const MATRIX *, const MATRIX * );
+int           matrix_batch_solve( MATRIX_BATCH * );
+int           matrix_batch_extract( const MATRIX_BATCH *, const int, MATRIX * );
+void          matrix_batch_free( MATRIX_BATCH * );
+
 MATRIX *matrix_assign( MATRIX *, const double, int, int );
 MATRIX *matrix_assign_seq( MATRIX *, const double *, const long );
 MATRIX *matrix_assign_row( MATRIX *, const double *, int, const int );
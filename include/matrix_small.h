@@ -0,0 +1,142 @@
+/**
+ * @file matrix_small.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief The fixed-size 3x3 & 4x4 matrices for the small normal equations of the locating. All the
+ *        loops have the compile-time bounds, so they will be unrolled & kept in the registers.
+ * @version 0.1
+ * @date 2023-10-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#include <string.h>
+#include <math.h>
+
+/* The same guard of the tiny diagonal elements as the MATRIX library */
+#define MAT_SMALL_DIAG_EPS  1.0e-5
+
+/**
+ * @brief The row-major 4x4 matrix
+ *
+ */
+typedef struct {
+	double e[16];
+} MAT4;
+
+/**
+ * @brief The row-major 3x3 matrix
+ *
+ */
+typedef struct {
+	double e[9];
+} MAT3;
+
+/*
+ * Define the inline functions of the N x N matrix type, mat<N>_*:
+ *
+ * zero     : a = 0
+ * rank1    : a += w * g * gt & b += w * g * d (b could be NULL), the row of the weighted least square
+ * mul      : res = a * b
+ * mulv     : res = a * x
+ * damp     : scale the diagonal by (1 + damping) & guard the tiny ones, Levenberg-Marquardt style
+ * cholesky : a = l * lt, the lower triangle of l is the factor; -1 when a is not positive definite
+ * solve    : solve a * x = b by the Cholesky factor, x is only written when it succeeded
+ */
+#define MAT_SMALL_DEFINE( _N ) \
+static inline void mat##_N##_zero( MAT##_N *a ) \
+{ \
+	memset(a, 0, sizeof(MAT##_N)); \
+} \
+\
+static inline void mat##_N##_rank1( MAT##_N *restrict a, double *restrict b, const double *restrict g, const double w, const double d ) \
+{ \
+	for ( int i = 0; i < (_N); i++ ) { \
+		const double wg = w * g[i]; \
+		for ( int j = 0; j < (_N); j++ ) \
+			a->e[i * (_N) + j] += wg * g[j]; \
+		if ( b ) \
+			b[i] += wg * d; \
+	} \
+} \
+\
+static inline void mat##_N##_mul( MAT##_N *restrict res, const MAT##_N *restrict a, const MAT##_N *restrict b ) \
+{ \
+	for ( int i = 0; i < (_N); i++ ) { \
+		for ( int j = 0; j < (_N); j++ ) { \
+			double sum = 0.0; \
+			for ( int k = 0; k < (_N); k++ ) \
+				sum += a->e[i * (_N) + k] * b->e[k * (_N) + j]; \
+			res->e[i * (_N) + j] = sum; \
+		} \
+	} \
+} \
+\
+static inline void mat##_N##_mulv( double *restrict res, const MAT##_N *restrict a, const double *restrict x ) \
+{ \
+	for ( int i = 0; i < (_N); i++ ) { \
+		double sum = 0.0; \
+		for ( int k = 0; k < (_N); k++ ) \
+			sum += a->e[i * (_N) + k] * x[k]; \
+		res[i] = sum; \
+	} \
+} \
+\
+static inline void mat##_N##_damp( MAT##_N *a, const double damping ) \
+{ \
+	for ( int i = 0; i < (_N); i++ ) { \
+		double *diag = &a->e[i * (_N) + i]; \
+		if ( damping > 0.0 ) \
+			*diag *= 1.0 + damping; \
+		if ( fabs(*diag) < MAT_SMALL_DIAG_EPS ) \
+			*diag += MAT_SMALL_DIAG_EPS; \
+	} \
+} \
+\
+static inline int mat##_N##_cholesky( MAT##_N *restrict l, const MAT##_N *restrict a ) \
+{ \
+	for ( int j = 0; j < (_N); j++ ) { \
+		double sum = a->e[j * (_N) + j]; \
+		for ( int k = 0; k < j; k++ ) \
+			sum -= l->e[j * (_N) + k] * l->e[j * (_N) + k]; \
+		if ( !(sum > 0.0) ) \
+			return -1; \
+		l->e[j * (_N) + j] = sqrt(sum); \
+		for ( int i = j + 1; i < (_N); i++ ) { \
+			sum = a->e[i * (_N) + j]; \
+			for ( int k = 0; k < j; k++ ) \
+				sum -= l->e[i * (_N) + k] * l->e[j * (_N) + k]; \
+			l->e[i * (_N) + j] = sum / l->e[j * (_N) + j]; \
+			l->e[j * (_N) + i] = 0.0; \
+		} \
+	} \
+	return 0; \
+} \
+\
+static inline int mat##_N##_solve( double *x, const MAT##_N *a, const double *b ) \
+{ \
+	MAT##_N l; \
+	double  y[(_N)]; \
+	if ( mat##_N##_cholesky( &l, a ) ) \
+		return -1; \
+	for ( int i = 0; i < (_N); i++ ) { \
+		double sum = b[i]; \
+		for ( int k = 0; k < i; k++ ) \
+			sum -= l.e[i * (_N) + k] * y[k]; \
+		y[i] = sum / l.e[i * (_N) + i]; \
+	} \
+	for ( int i = (_N) - 1; i >= 0; i-- ) { \
+		double sum = y[i]; \
+		for ( int k = i + 1; k < (_N); k++ ) \
+			sum -= l.e[k * (_N) + i] * y[k]; \
+		y[i] = sum / l.e[i * (_N) + i]; \
+	} \
+	for ( int i = 0; i < (_N); i++ ) \
+		x[i] = y[i]; \
+	return 0; \
+}
+
+/* */
+MAT_SMALL_DEFINE( 4 )
+MAT_SMALL_DEFINE( 3 )
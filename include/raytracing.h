@@ -10,10 +10,41 @@
  */
 #pragma once
 /* */
+#include <stdint.h>
+/* */
 #define RT_MAX_NODE  16384
 /* */
 #define RT_P_WAVE_VELOCITY  0
 #define RT_S_WAVE_VELOCITY  1
+/* The maximum source movement (in km) to warm start the pseudo-bending from the cached ray */
+#define RT_WARM_START_DIST  10.0
+/* The result of the cached tracing */
+#define RT_RAY_CACHE_HIT   0
+#define RT_RAY_CACHE_WARM  1
+#define RT_RAY_CACHE_COLD  2
+
+/**
+ * @brief The termination of the pseudo-bending, the bending of each number of segments stops when the
+ *        travel time changed less than the tolerance, & the segments will be doubled until they are
+ *        shorter than the minimum length.
+ *
+ */
+typedef struct {
+	double xfac;         /* The enhancement factor (see Um & Thurber, 1987) */
+	int    max_loops;    /* The maximum bending iterations of each number of segments */
+	double tolerance;    /* The tolerance of the travel time change, in second */
+	double min_segment;  /* The minimum length of segment, in km */
+	int    cartesian;    /* Non-zero to bend the nodes in the Cartesian coordinates */
+} RT_PROFILE;
+
+/**
+ * @brief The cost of single tracing.
+ *
+ */
+typedef struct {
+	int iterations;  /* The number of the bending iterations in total */
+	int segments;    /* The number of the final ray segments */
+} RT_TRACE_INFO;
 
 /**
  * @brief
@@ -26,11 +57,63 @@ typedef struct {
 	double v;
 } RAY_INFO;
 
+/**
+ * @brief The loaded 3D velocity model, it is read-only after loading & could be shared by several
+ *        tracing threads.
+ *
+ */
+typedef struct rt_velmod RT_VELMOD;
+
+/**
+ * @brief The last ray of one receiver & phase, it will be returned directly when the source is exactly
+ *        the same, or used as the initial path of the pseudo-bending when the source only moved a little.
+ *
+ */
+typedef struct {
+/* The source & receiver of the cached ray, in degree & km */
+	double    evla;
+	double    evlo;
+	double    evdp;
+	double    stla;
+	double    stlo;
+	double    stdp;
+	int       vel_type;
+/* The cached ray in the shifted frame, np is zero when there is nothing cached */
+	int       np;
+	int       capacity;
+	double    shiftlo;
+	double    travel_time;
+	double    tolerance;  /* The tolerance of the profile which traced the cached ray */
+	RAY_INFO *ray;
+} RT_RAY_CACHE;
+
+/* */
+#define RT_RAY_CACHE_INIT(__CACHE) \
+		((__CACHE) = (RT_RAY_CACHE){ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0, 0, 0.0, 0.0, 0.0, NULL })
+
+/* The profile for the final travel times, close to the former relative limit (1e-6) of the ~10 sec. rays */
+extern const RT_PROFILE rt_profile_fine;
+/* The profile for the trial hypocenters of the locating, the measured error is kept around 0.1 sec. (see raytracing.c) */
+extern const RT_PROFILE rt_profile_coarse;
+
 /* */
-int rt_main( RAY_INFO *, int *, double *, double, double, double, double, double, double, const int );
-int rt_velmod_load( const char * );
-void rt_velmod_free( void );
+int rt_main(
+	const RT_VELMOD *, RAY_INFO *, int *, double *, double, double, double, double, double, double, const int,
+	const RT_PROFILE *, RT_TRACE_INFO *
+);
+int rt_main_cache(
+	const RT_VELMOD *, RT_RAY_CACHE *, RAY_INFO *, int *, double *, double, double, double, double, double, double, const int,
+	const RT_PROFILE *, RT_TRACE_INFO *
+);
+void rt_ray_cache_free( RT_RAY_CACHE * );
+RT_VELMOD *rt_velmod_load( const char * );
+int rt_velmod_save( const RT_VELMOD *, const char * );
+void rt_velmod_free( RT_VELMOD * );
+int rt_velmod_compact( RT_VELMOD * );
+int rt_velmod_range( const RT_VELMOD *, double *, double *, double *, double *, double *, double * );
+double rt_velmod_velocity( const RT_VELMOD *, const double, const double, const double, const int );
+uint64_t rt_velmod_fingerprint( const RT_VELMOD * );
 void rt_tko_azi_cal( const RAY_INFO *, const int, double *, double * );
 void rt_drvt_cal( const RAY_INFO *, const int, double *, double *, double * );
 /* */
-RAY_INFO *rt_ray_rad2deg( RAY_INFO *, const int, double, double );
+RAY_INFO *rt_ray_rad2deg( const RT_VELMOD *, RAY_INFO *, const int, double, double );
@@ -0,0 +1,77 @@
+/**
+ * @file tttable.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Memory-mappable travel time grid of single station & single phase.
+ * @version 0.1
+ * @date 2023-10-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#include <stdint.h>
+#include <stddef.h>
+/* */
+#define TT_TABLE_MAGIC    0x54544c45  /* "ELTT" in little-endian */
+#define TT_TABLE_VERSION  3
+/* The value of the node which travel time can't be derived */
+#define TT_TABLE_NULL     -1.0f
+/* The method of generating the travel times */
+#define TT_TABLE_METHOD_BENDING  0
+#define TT_TABLE_METHOD_EIKONAL  1
+
+/**
+ * @brief The file header, it will be followed by the nlon * nlat * ndep float travel times
+ *        which are ordered by longitude first, then latitude & depth last.
+ *
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nlon;
+	uint32_t nlat;
+	uint32_t ndep;
+	uint32_t phase;
+	uint32_t method;
+	uint32_t reserved;
+/* The fingerprint of the velocity model which the travel times are derived within */
+	uint64_t model;
+/* Origin & steps of the grid, in degree & km */
+	double   lon0;
+	double   lat0;
+	double   dep0;
+	double   dlon;
+	double   dlat;
+	double   ddep;
+/* The receiver */
+	double   sta_lon;
+	double   sta_lat;
+	double   sta_elev;
+} TT_TABLE_HEADER;
+
+/**
+ * @brief
+ *
+ */
+typedef struct {
+	const TT_TABLE_HEADER *header;
+	const float           *data;
+	size_t                 size;
+} TT_TABLE;
+
+/**
+ * @brief The travel time function used by the generator: the arguments are the user's pointer, the
+ *        longitude, latitude & depth of the source; it should return a negative value when failed
+ *        at that node, or NAN to abort the whole generating.
+ *
+ */
+typedef double (*TT_TABLE_TRAVEL_FUNC)( void *, const double, const double, const double );
+
+/* */
+int       tt_table_create( const char *, const TT_TABLE_HEADER *, TT_TABLE_TRAVEL_FUNC, void * );
+int       tt_table_save( const char *, const TT_TABLE_HEADER *, const float * );
+TT_TABLE *tt_table_open( const char * );
+int       tt_table_match( const TT_TABLE *, const TT_TABLE_HEADER * );
+int       tt_table_lookup( const TT_TABLE *, const double, const double, const double, double *, double [3] );
+void      tt_table_close( TT_TABLE * );
@@ -0,0 +1,31 @@
+/**
+ * @file worker_pool.h
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief The persistent worker threads which run the indexed tasks of the batch in parallel.
+ * @version 0.1
+ * @date 2023-10-26
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+/* */
+#define WP_MAX_THREADS  32
+
+/**
+ * @brief The task function, the arguments are the batch's pointer & the index of the task.
+ *
+ */
+typedef void (*WP_TASK_FUNC)( void *, const int );
+
+/**
+ * @brief
+ *
+ */
+typedef struct worker_pool WORKER_POOL;
+
+/* */
+WORKER_POOL *wp_create( const int );
+int  wp_run( WORKER_POOL *, WP_TASK_FUNC, void *, const int );
+int  wp_threads( const WORKER_POOL * );
+void wp_destroy( WORKER_POOL * );
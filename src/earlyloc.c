@@ -30,6 +30,9 @@
 #include <earlyloc_misc.h>
 #include <earlyloc_locate.h>
 #include <earlyloc_report.h>
+#include <earlyloc_search.h>
+#include <earlyloc_tttable.h>
+#include <earlyloc_velmod.h>
 
 /* Functions prototype in this source file */
 static void earlyloc_config( char * );
@@ -49,6 +52,7 @@ static PICK_STATE *parse_eewpick2pickstate( PICK_STATE *, const char * );
 static int mk_outdir_by_evt( char *, const char *, const double, const int, const char * );
 
 static int thread_proc_trigger( void * );
+static void report_converged_hypo( HYPO_STATE *, MSG_LOGO *, const char *, const int, int *, double * );
 
 static HYPO_STATE *create_hypo_state( void );
 static void associate_pick_hypos( HYPOS_POOL *, PICK_STATE * );
@@ -105,11 +109,26 @@ static double   HypoAliveTime = 60.0;    /* */
 static double   ClusterTimeDiff;         /* */
 static double   ClusterDist;             /* */
 static uint16_t ClusterPicks = 2;
+static uint8_t  GridSearchScore = EL_SEARCH_SCORE_EDT;
+static uint16_t GridSearchThreads = 0;    /* 0 if don't want to use the grid search for initial guess */
+static uint8_t  VelocityModelCompact = 0;  /* 0 if keeping the 3D velocity model in the cell grids */
+static int      VelocityModelReload = 0;   /* The interval (in sec.) to check the 3D velocity model file, 0 if never reload */
+static uint16_t TraceThreads = 0;          /* 0 or 1 if tracing the picks one by one within the 3D velocity model */
+static double   TraceCoarseTolerance = 0.0; /* The travel time tolerances (in sec.) of tracing, 0 for the default */
+static double   TraceFineTolerance   = 0.0;
+static uint8_t  TraceCartesian = 0;        /* 0 if bending the rays in the spherical coordinates */
+static char     TTTablePath[MAX_PATH_STR] = { 0 };  /* Empty if don't want to use the 3D travel time tables */
+static double   TTTableHStep;
+static double   TTTableVStep;
+static double   TTTableRadius;
+static int      TTTableEikonalThreads = 0;  /* 0 means tracing the tables by the pseudo-bending */
 static LAYER_VEL_MODEL PWaveModel;
 static LAYER_VEL_MODEL SWaveModel;
 static DBINFO   DBInfo;
 static char     SQLStationTable[MAXLIST][MAX_TABLE_LEGTH];
 static uint16_t nList = 0;
+static int      ListRefreshInterval = 0;   /* The interval (in sec.) to refresh the stations list, 0 if only refresh on the unknown SNL */
+static char     ListSnapshotPath[MAX_PATH_STR] = { 0 };  /* Empty if don't want to start from the stations snapshot */
 
 /* Things to look up in the earthworm.h tables with getutil.c functions */
 static int64_t InRingKey;       /* key of transport ring for i/o     */
@@ -129,13 +148,6 @@ static uint8_t TypeHypoOutput;
 #define  ERR_QUEUE         3   /* error queueing message for sending      */
 static char Text[150];         /* string for log/error messages          */
 
-/* Station list update status flag
- *********************************/
-#define  LIST_IS_UPDATED      0
-#define  LIST_NEED_UPDATED    1
-#define  LIST_UNDER_UPDATE    2
-
-static volatile uint8_t UpdateStatus = LIST_IS_UPDATED;
 /* Macros */
 #define HYPO_IS_CONVERGED(__HYPO) \
 		((__HYPO)->avg_error <= CONVERGE_CRITERIA && ((__HYPO)->avg_error * (__HYPO)->avg_weight) > 0.1)
@@ -156,7 +168,7 @@ static volatile uint8_t UpdateStatus = LIST_IS_UPDATED;
 
 #define PICKS_ARE_COSITE(PICK_A, PICK_B) \
 		(compare_scnl( (PICK_A), (PICK_B) ) && \
-		el_misc_geog2distf( (PICK_A)->observe.longitude, (PICK_A)->observe.latitude, (PICK_B)->observe.longitude, (PICK_B)->observe.latitude ) <= PICK_COSITE_DIST)
+		el_misc_geometry_distf( &(PICK_A)->geometry, &(PICK_B)->geometry ) <= PICK_COSITE_DIST)
 
 /*
  *
@@ -171,8 +183,10 @@ int main ( int argc, char **argv )
 	time_t   time_now;           /* current time                  */
 	time_t   time_last_beat;     /* time last heartbeat was sent  */
 	time_t   time_last_scan;     /* time last heartbeat was sent  */
+	double   _timestamp;
 	char    *lockfile;
 	int32_t  lockfile_fd;
+	uint8_t  from_snapshot = 0;
 /* */
 	char            buffer[4096] = { 0 };
 	EARLY_PICK_MSG *input_pick = (EARLY_PICK_MSG *)buffer;
@@ -193,8 +207,63 @@ int main ( int argc, char **argv )
 /* Read the configuration file(s) */
 	earlyloc_config( argv[1] );
 	logit("" , "%s: Read command file <%s>\n", argv[0], argv[1]);
-	/* Read the channels list from remote database */
-	for ( i = 0; i < nList; i++ ) {
+/* Switch the 3D velocity model to the compact layout before it is shared by the threads */
+	if ( VelocityModelCompact && el_velmod_get() ) {
+		if ( el_velmod_compact() ) {
+			fprintf(stderr, "Something error when switching the 3D velocity model to the compact layout. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: 3D velocity model is switched to the compact layout.\n");
+	}
+/* Start the reloader of the 3D velocity model */
+	if ( VelocityModelReload > 0 && el_velmod_get() ) {
+		if ( el_velmod_reload_init( VelocityModelReload ) ) {
+			fprintf(stderr, "Something error when starting the reloader of the 3D velocity model. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: 3D velocity model file will be checked every %d sec. & reloaded after updated.\n", VelocityModelReload);
+	}
+/* Start the pool for tracing the picks in parallel */
+	if ( TraceThreads > 1 && el_velmod_get() ) {
+		if ( (res = el_loc_3dtrace_init( TraceThreads )) < 0 ) {
+			fprintf(stderr, "Something error when starting the 3D tracing threads. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: Picks will be traced within the 3D velocity model by %d thread(s).\n", res);
+	}
+/* Build the travel time tables for the grid search */
+	if ( GridSearchThreads ) {
+		_timestamp = el_misc_timenow_precise();
+		if ( el_search_init( &PWaveModel, &SWaveModel, GridSearchScore, GridSearchThreads ) ) {
+			fprintf(stderr, "Something error when building the travel time tables or starting the search threads. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: Travel time tables are ready, took %.3lf sec.\n", el_misc_timenow_precise() - _timestamp);
+	}
+/* Start the generator of the 3D travel time tables */
+	if ( strlen(TTTablePath) ) {
+		if ( el_tttable_init( TTTablePath, TTTableHStep, TTTableVStep, TTTableRadius, TTTableEikonalThreads ) ) {
+			fprintf(stderr, "Something error when initializing the 3D travel time tables. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: 3D travel time tables will be generated in the background.\n");
+	}
+/* Read the channels list from the snapshot, then the remote database will be fetched in the background */
+	if ( strlen(ListSnapshotPath) && nList && strlen(DBInfo.host) ) {
+		if ( el_list_snapshot_init( ListSnapshotPath ) ) {
+			fprintf(stderr, "Something error when setting the stations snapshot %s. Exiting!\n", ListSnapshotPath);
+			exit(-1);
+		}
+		if ( (i = el_list_snapshot_load()) > 0 ) {
+			logit("o", "earlyloc: %d station(s) loaded from the snapshot %s.\n", i, ListSnapshotPath);
+			from_snapshot = 1;
+		}
+		else {
+			logit("o", "earlyloc: Can't load the stations snapshot %s, fetching from the database.\n", ListSnapshotPath);
+		}
+	}
+/* Read the channels list from remote database */
+	for ( i = 0; i < nList && !from_snapshot; i++ ) {
 		if ( el_list_db_fetch( SQLStationTable[i], &DBInfo, EARLYLOC_LIST_INITIALIZING ) < 0 ) {
 			fprintf(stderr, "Something error when fetching stations list %s. Exiting!\n", SQLStationTable[i]);
 			exit(-1);
@@ -209,6 +278,20 @@ int main ( int argc, char **argv )
 		logit("o", "earlyloc: There are total %d station(s) in the list.\n", i);
 		el_list_tree_activate();
 	}
+/* Keep the fetched list for the next startup */
+	if ( strlen(ListSnapshotPath) && nList && strlen(DBInfo.host) && !from_snapshot ) {
+		if ( el_list_snapshot_save() )
+			logit("e", "earlyloc: Error writing the stations snapshot %s, it will be tried after next refreshing!\n", ListSnapshotPath);
+	}
+/* Start the background refresher of the stations list from remote database */
+	if ( nList && strlen(DBInfo.host) ) {
+	/* The stations from the snapshot will be refreshed at once & until the tables are fetched completely */
+		if ( el_list_refresh_init( SQLStationTable, nList, &DBInfo, ListRefreshInterval ) ) {
+			fprintf(stderr, "Something error when starting the refresher of the stations list. Exiting!\n");
+			exit(-1);
+		}
+		logit("o", "earlyloc: Stations list will be refreshed in the background.\n");
+	}
 /* Look up important info from earthworm.h tables */
 	earlyloc_lookup();
 /* Reinitialize logit to desired logging level */
@@ -312,14 +395,15 @@ int main ( int argc, char **argv )
 					printf("earlyloc: Pick with %s.%s.%s.%s not found in SNL table, maybe it's a new SNL.\n",
 					input_pick->station, input_pick->channel, input_pick->network, input_pick->location);
 				#endif
-				/* Force to update the table */
-					if ( UpdateStatus == LIST_IS_UPDATED )
-						UpdateStatus = LIST_NEED_UPDATED;
+				/* Ask the refresher to update the table once for each unknown SNL, it won't block this thread */
+					el_list_unknown_request( input_pick );
 					continue;
 				}
 			/* Make the early pick information to local pick type */
 				if ( !parse_epick2pickstate( &pick_state, fill_coor2epick( input_pick, usesnl ) ) )
 					continue;
+			/* The geometry was computed when the station was loaded, just copy it */
+				pick_state.geometry = usesnl->geometry;
 			}
 			else if ( reclogo.type == TypeEEWPick ) {
 				buffer[recsize] = '\0';
@@ -409,6 +493,9 @@ static void earlyloc_config( char *configfile )
 	const char *strategy[] = {
 		PICK_FETCH_STRATEGY_TABLE
 	};
+	const char *score[] = {
+		EL_SEARCH_SCORE_TABLE
+	};
 #undef X
 
 /* Set to zero one init flag for each required command */
@@ -604,13 +691,31 @@ static void earlyloc_config( char *configfile )
 				SWaveModel.deep_grad = k_val();
 				init[16] = 1;
 			}
+			else if ( k_its("GridSearch") ) {
+				if ( (str = k_str()) ) {
+					for ( i = 0; i < EL_SEARCH_SCORE_COUNT; i++ ) {
+						if ( !strcmp(str, score[i]) )
+							break;
+					}
+					if ( i < EL_SEARCH_SCORE_COUNT ) {
+						GridSearchScore = i;
+					}
+				}
+				GridSearchThreads = k_int();
+				if ( GridSearchThreads ) {
+					logit(
+						"o", "earlyloc: Initial guess will be searched by the '%s' scoring grid search with %d thread(s).\n",
+						score[GridSearchScore], GridSearchThreads
+					);
+				}
+			}
 			else if ( k_its("3DVelocityModelFile") ) {
 				str = k_str();
 				if ( str )
 					strcpy(filepath, str);
 				logit("o", "earlyloc: 3D velocity model file: %s\n", filepath);
 
-				if ( el_loc_3dvelmod_load( filepath ) ) {
+				if ( el_velmod_load( filepath ) ) {
 					logit("e", "earlyloc: Error reading 3D velocity model file; exiting!\n");
 					exit(-1);
 				}
@@ -618,6 +723,50 @@ static void earlyloc_config( char *configfile )
 					logit("o", "earlyloc: Reading 3D velocity model file finish!\n");
 				}
 			}
+			else if ( k_its("3DVelocityModelCompact") ) {
+				VelocityModelCompact = k_int();
+			}
+			else if ( k_its("3DVelocityModelReload") ) {
+				VelocityModelReload = k_int();
+			}
+			else if ( k_its("3DTraceThreads") ) {
+				TraceThreads = k_int();
+			}
+			else if ( k_its("3DTraceTolerance") ) {
+				TraceCoarseTolerance = k_val();
+				TraceFineTolerance   = k_val();
+				el_loc_3dtrace_profile( TraceCoarseTolerance, TraceFineTolerance, TraceCartesian );
+				logit(
+					"o", "earlyloc: 3D tracing tolerances of the trial & final travel times: %g & %g sec.\n",
+					TraceCoarseTolerance, TraceFineTolerance
+				);
+			}
+			else if ( k_its("3DTraceCartesian") ) {
+				TraceCartesian = k_int() ? 1 : 0;
+				el_loc_3dtrace_profile( TraceCoarseTolerance, TraceFineTolerance, TraceCartesian );
+				logit(
+					"o", "earlyloc: 3D tracing will bend the rays in the %s coordinates.\n", TraceCartesian ? "Cartesian" : "spherical"
+				);
+			}
+			else if ( k_its("3DTravelTimeTable") ) {
+				str = k_str();
+				if ( str )
+					strcpy(TTTablePath, str);
+				TTTableHStep  = k_val();
+				TTTableVStep  = k_val();
+				TTTableRadius = k_val();
+				logit(
+					"o", "earlyloc: 3D travel time tables path: %s, steps: %.3lf deg & %.3lf km, radius: %.3lf deg\n",
+					TTTablePath, TTTableHStep, TTTableVStep, TTTableRadius
+				);
+			}
+			else if ( k_its("3DTravelTimeEikonal") ) {
+				TTTableEikonalThreads = k_int();
+				logit(
+					"o", "earlyloc: 3D travel time tables will be solved by the eikonal solver with %d threads\n",
+					TTTableEikonalThreads
+				);
+			}
 			else if ( k_its("SQLHost") ) {
 				str = k_str();
 				if ( str )
@@ -665,6 +814,13 @@ static void earlyloc_config( char *configfile )
 				nList++;
 				init[22] = 1;
 			}
+			else if ( k_its("SQLStationRefresh") ) {
+				ListRefreshInterval = k_int();
+			}
+			else if ( k_its("SQLStationSnapshot") ) {
+				if ( (str = k_str()) )
+					strcpy(ListSnapshotPath, str);
+			}
 			else if ( k_its("UseSNL") ) {
 				str = k_get();
 				for ( str += strlen(str) + 1; isspace(*str); str++ );
@@ -857,7 +1013,11 @@ static void earlyloc_end( void )
 {
 	tport_detach(&InRegion);
 	tport_detach(&OutRegion);
-	el_loc_3dvelmod_free();
+	el_tttable_free();
+	el_loc_3dtrace_free();
+	el_velmod_free();
+	el_search_free();
+	el_list_end();
 
 	return;
 }
@@ -871,13 +1031,18 @@ static int thread_proc_trigger( void *arg )
 	struct timespec waittime = { .tv_sec = 0, .tv_nsec = 100000000 }; /* 100 ms */
 	PICK_STATE     *pick = NULL;
 	PICK_STATE     *pick_in_pool = NULL;
+	PICK_STATE     *new_pick = NULL;
 	MSG_LOGO        logo = { 0 };
 	char            _report_path[MAX_PATH_STR] = { 0 };
 	int             max_valids = 0;
+	int             new_valids = 0;
 	int             nsearch;
+	int             nmasks;
+	int             robust;
 	int             pool_status = POOL_HAS_NEW_PICK;
 	double          min_werror = CONVERGE_CRITERIA;
 	double          time_last_hypo = el_misc_timenow();
+	SEARCH_STATS    search_stats;
 
 /* Build the message */
 	logo.instid = InstId;
@@ -895,62 +1060,70 @@ static int thread_proc_trigger( void *arg )
 		if ( pool_status == POOL_HAS_NEW_PICK ) {
 		/* Initial guess */
 			if ( result->ig_origin_time < 0.0 ) {
-				el_loc_location_guess( result, &PWaveModel, &SWaveModel );
-				el_loc_location_refine( result, &PWaveModel, &SWaveModel, 0 );
+			/* The grid search result is good enough, it doesn't need the refining */
+				if ( GridSearchThreads && !el_search_location_guess( result, &search_stats ) ) {
+					logit(
+						"o", "earlyloc: Hypo(#%d) initial guess searched %d nodes, coarse grid %.2lf ms & oct-tree %.2lf ms.\n",
+						result->eid, search_stats.nodes, search_stats.coarse * 1000.0, search_stats.octree * 1000.0
+					);
+				}
+				else {
+					el_loc_location_guess( result, &PWaveModel, &SWaveModel );
+					el_loc_location_refine( result, &PWaveModel, &SWaveModel, 0 );
+				}
 				save_to_init_guess( result );
 			}
-		/* Main hypo iteration process... */
-			use_init_guess( result );
-			nsearch = 0;
-			do {
-			/* The main locate process */
-				if ( el_loc_primary_locate( result, &PWaveModel, &SWaveModel ) ) {
-					logit("et", "earlyloc: Hypo(#%d) locating ERROR, skip this time!\n", result->eid);
-					break;
-				}
-			/* Check if it converge or not */
-				if ( HYPO_IS_CONVERGED( result ) ) {
-				/* Adjust the origin time to reduce the overall residual */
-					el_loc_location_refine( result, &PWaveModel, &SWaveModel, 1 );
-					el_loc_origintime_adjust( result, &PWaveModel, &SWaveModel );
-					el_loc_all_states_update( result, &PWaveModel, &SWaveModel );
-				/* Finally, output the report... */
-					if ( !ReportTermNum || result->rep_count < ReportTermNum ) {
-						el_report_ring_output( result, &OutRegion, &logo, OutputPostfix, OutputRejectPick );
-						if ( strlen(_report_path) )
-							el_report_file_output( result, _report_path, OutputPostfix, OutputRejectPick );
+		/* Warm start from the last solution when there is only one new pick after the last report */
+			if (
+				new_valids == 1 && result->rep_count &&
+				!el_loc_incremental_locate( result, new_pick, &PWaveModel, &SWaveModel ) &&
+				HYPO_IS_CONVERGED( result )
+			) {
+				report_converged_hypo( result, &logo, _report_path, 0, &max_valids, &min_werror );
+			}
+			else {
+			/* Main hypo iteration process... */
+				use_init_guess( result );
+				nsearch = 0;
+				robust  = 0;
+				do {
+				/* The main locate process */
+					if ( el_loc_primary_locate( result, &PWaveModel, &SWaveModel ) ) {
+						logit("et", "earlyloc: Hypo(#%d) locating ERROR, skip this time!\n", result->eid);
+						break;
 					}
-				/* Keep the best solution for next initial guess */
-					if (
-						result->pool.valids > max_valids ||
-						(result->pool.valids == max_valids && (result->avg_error / result->avg_weight) < min_werror)
-					) {
-						save_to_best_state( result );
-						max_valids = result->pool.valids;
-						min_werror = result->avg_error / result->avg_weight;
-					/* */
+				/* Check if it converge or not */
+					if ( HYPO_IS_CONVERGED( result ) ) {
+						report_converged_hypo( result, &logo, _report_path, 1, &max_valids, &min_werror );
+						break;
+					}
+				/* Try to mask all the outliers within one robust locating before masking them one by one */
+					if ( !robust++ ) {
+						if ( (nmasks = el_loc_robust_locate( result, &PWaveModel, &SWaveModel )) >= 0 && HYPO_IS_CONVERGED( result ) ) {
+							result->stats.saved += nmasks > 1 ? nmasks - 1 : 0;
+							report_converged_hypo( result, &logo, _report_path, 1, &max_valids, &min_werror );
+							break;
+						}
+					/* Restore those picks masked by the robust locating */
+						unmark_locmask_picks( &result->pool, 0.0 );
+					}
+				/* */
+					use_init_guess( result );
+					if ( !result->rep_count && nsearch++ < 5 ) {
+						unmark_locmask_picks( &result->pool, 0.0 );
+						el_loc_location_refine( result, &PWaveModel, &SWaveModel, 0 );
 						save_to_init_guess( result );
+						continue;
 					}
-				/* Increase the report # */
-					result->rep_count++;
-					break;
-				}
+					el_loc_all_states_update( result, &PWaveModel, &SWaveModel );
+				/* Mask the pick with highest residual until it can't do it any more */
+					if ( !mark_locmask_pick_max_residual( &result->pool ) )
+						break;
+				} while ( result->pool.valids >= MIN_LOCATE_PICKS );
 			/* */
-				use_init_guess( result );
-				if ( !result->rep_count && nsearch++ < 5 ) {
-					unmark_locmask_picks( &result->pool, 0.0 );
-					el_loc_location_refine( result, &PWaveModel, &SWaveModel, 0 );
-					save_to_init_guess( result );
-					continue;
-				}
-				el_loc_all_states_update( result, &PWaveModel, &SWaveModel );
-			/* Mask the pick with highest residual until it can't do it any more */
-				if ( !mark_locmask_pick_max_residual( &result->pool ) )
-					break;
-			} while ( result->pool.valids >= MIN_LOCATE_PICKS );
-		/* */
-			if ( result->pool.valids < MIN_LOCATE_PICKS )
-				printf("earlyloc: ##### NO REPORT ##### Hypo(#%d) can't reach the converging criteria!\n", result->eid);
+				if ( result->pool.valids < MIN_LOCATE_PICKS )
+					printf("earlyloc: ##### NO REPORT ##### Hypo(#%d) can't reach the converging criteria!\n", result->eid);
+			}
 		/* Debug null output */
 		#ifdef _DEBUG
 			if ( strlen(_report_path) )
@@ -971,6 +1144,11 @@ static int thread_proc_trigger( void *arg )
 			/* Finish the hypo process when over the report count limit */
 				break;
 			}
+		/* The picks set has been changed by masking or rejecting, the last normal equations are useless */
+			if ( result->pool.valids != result->normal.valids )
+				EL_HYPO_NORMAL_EQS_RESET( result->normal );
+			new_valids = 0;
+			new_pick   = NULL;
 		/* */
 			pool_status = POOL_ALREADY_USED;
 			time_last_hypo = el_misc_timenow();
@@ -997,6 +1175,8 @@ static int thread_proc_trigger( void *arg )
 			/* */
 				if ( EL_PICK_VALID_LOCATE( pick_in_pool ) ) {
 					pool_status = POOL_HAS_NEW_PICK;
+					new_pick    = pick_in_pool;
+					new_valids++;
 				/* */
 					if ( PickFetchStrategy == PICK_FETCH_STRATEGY_STEP ) {
 						pick_in_pool = NULL;
@@ -1016,12 +1196,80 @@ static int thread_proc_trigger( void *arg )
 /* End process */
 	if ( !result->rep_count && strlen(_report_path) )
 		remove(_report_path);
+	el_loc_3dvelmod_release( result );
 	result->flag = HYPO_IS_FINISHED;
 	logit("ot", "earlyloc: Finished hypo(#%d) at the end of hypo life.\n", result->eid);
+	logit(
+		"o", "earlyloc: Hypo(#%d) has been located %u time(s) with %u Geiger's iteration(s) (%.1f per locating).\n",
+		result->eid, result->stats.locates, result->stats.iterations,
+		result->stats.locates ? (double)result->stats.iterations / result->stats.locates : 0.0
+	);
+	logit(
+		"o", "earlyloc: Hypo(#%d) has been relocated incrementally %u time(s), %u time(s) fell back to the full locating.\n",
+		result->eid, result->stats.incrementals, result->stats.fallbacks
+	);
+	logit(
+		"o", "earlyloc: Hypo(#%d) has been located robustly %u time(s), %u full locating(s) saved.\n",
+		result->eid, result->stats.robusts, result->stats.saved
+	);
+	if ( el_velmod_get() ) {
+		logit(
+			"o", "earlyloc: Hypo(#%d) got %u 3D ray(s) from the cache, %u warm started (%.1f bending iteration(s) each) & %u cold started (%.1f each).\n",
+			result->eid, result->stats.ray_hits,
+			result->stats.ray_warms, result->stats.ray_warms ? (double)result->stats.ray_warm_iters / result->stats.ray_warms : 0.0,
+			result->stats.ray_colds, result->stats.ray_colds ? (double)result->stats.ray_cold_iters / result->stats.ray_colds : 0.0
+		);
+		logit(
+			"o", "earlyloc: Hypo(#%d) traced 3D ray(s) with %.1f segment(s) each.\n",
+			result->eid, (result->stats.ray_warms + result->stats.ray_colds) ?
+				(double)result->stats.ray_segments / (result->stats.ray_warms + result->stats.ray_colds) : 0.0
+		);
+	}
 
 	return 0;
 }
 
+/**
+ * @brief Adjust the converged hypo & output the report, then keep it if it is the best solution.
+ *
+ * @param hyp
+ * @param logo
+ * @param report_path
+ * @param refine
+ * @param max_valids
+ * @param min_werror
+ */
+static void report_converged_hypo(
+	HYPO_STATE *hyp, MSG_LOGO *logo, const char *report_path, const int refine, int *max_valids, double *min_werror
+) {
+/* Adjust the origin time to reduce the overall residual */
+	if ( refine )
+		el_loc_location_refine( hyp, &PWaveModel, &SWaveModel, 1 );
+	el_loc_origintime_adjust( hyp, &PWaveModel, &SWaveModel );
+	el_loc_all_states_update( hyp, &PWaveModel, &SWaveModel );
+/* Finally, output the report... */
+	if ( !ReportTermNum || hyp->rep_count < ReportTermNum ) {
+		el_report_ring_output( hyp, &OutRegion, logo, OutputPostfix, OutputRejectPick );
+		if ( strlen(report_path) )
+			el_report_file_output( hyp, report_path, OutputPostfix, OutputRejectPick );
+	}
+/* Keep the best solution for next initial guess */
+	if (
+		hyp->pool.valids > *max_valids ||
+		(hyp->pool.valids == *max_valids && (hyp->avg_error / hyp->avg_weight) < *min_werror)
+	) {
+		save_to_best_state( hyp );
+		*max_valids = hyp->pool.valids;
+		*min_werror = hyp->avg_error / hyp->avg_weight;
+	/* */
+		save_to_init_guess( hyp );
+	}
+/* Increase the report # */
+	hyp->rep_count++;
+
+	return;
+}
+
 /**
  * @brief
  *
@@ -1073,6 +1321,7 @@ static PICK_STATE *parse_eewpick2pickstate( PICK_STATE *dest, const char *src )
 		&dest->observe.longitude, &dest->observe.latitude, &dest->observe.picktime, &dest->observe.weight
 	);
 	dest->observe.elevation = 1.0;
+	el_misc_geometry_init( &dest->geometry, dest->observe.longitude, dest->observe.latitude );
 /* */
 	if ( dest->observe.channel[2] == 'Z' ) {
 		dest->observe.phase_name[0] = 'P';
@@ -1115,6 +1364,10 @@ static HYPO_STATE *create_hypo_state( void )
 	result->avg_error    = REJECT_CRITERIA;
 	result->avg_weight   = REJECT_CRITERIA;
 	result->q            = HYPO_RESULT_QUALITY_D;
+	EL_HYPO_LOC_STATS_INIT( result->stats );
+	EL_HYPO_NORMAL_EQS_RESET( result->normal );
+	result->ray_caches   = NULL;
+	result->velmod       = NULL;
 /* */
 	result->ig_latitude    = 0.0;
 	result->ig_longitude   = 0.0;
@@ -1790,9 +2043,13 @@ static int gen_hypo_eid( const HYPO_STATE *hyp )
 static int cluster_pick( const PICK_STATE *pick_a, const PICK_STATE *pick_b )
 {
 	const double dtime = fabs(pick_a->observe.picktime - pick_b->observe.picktime);
-	const double dist  = el_misc_geog2distf( pick_a->observe.longitude, pick_a->observe.latitude, pick_b->observe.longitude, pick_b->observe.latitude );
+	double       dist;
 
-	if ( dtime < ClusterTimeDiff && dist > PICK_COSITE_DIST && dist < ClusterDist ) {
+/* Most of the pairs are dropped by the time difference, so check it before the distance */
+	if ( dtime >= ClusterTimeDiff )
+		return 0;
+	dist = el_misc_geometry_distf( &pick_a->geometry, &pick_b->geometry );
+	if ( dist > PICK_COSITE_DIST && dist < ClusterDist ) {
 		if ( !strcmp(pick_a->observe.phase_name, "P") && !strcmp(pick_b->observe.phase_name, "P") ) {
 			if ( dtime < (dist / PWaveModel.shallow_init) )
 				return 1;
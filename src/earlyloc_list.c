@@ -14,9 +14,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <search.h>
 #include <time.h>
 #include <ctype.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 /* Earthworm environment header include */
 #include <earthworm.h>
 #include <trace_buf.h>
@@ -26,22 +31,125 @@
 #include <dl_chain_list.h>
 #include <earlyloc.h>
 #include <earlyloc_list.h>
+#include <earlyloc_misc.h>
+/* The initial number of the slots in the hash table, it should be power of 2 */
+#define SNL_HASH_INIT_SLOTS  1024
+/* The number of the recent hits cached by each thread, it should be power of 2 */
+#define SNL_CACHE_SIZE       16
+/* The number of the unknown SNLs remembered by each thread, it should be power of 2 */
+#define SNL_UNKNOWN_SIZE     64
+/* The refresher checks the requests every number of seconds, so it won't query the database more often */
+#define LIST_REFRESH_MIN_INTERVAL  30
+/* The retired tables & stations will be freed after the number of seconds */
+#define LIST_RETIRE_GRACE          10
+/* */
+#define SNL_SNAPSHOT_MAGIC    0x534c4c45  /* "ELLS" in little-endian */
+#define SNL_SNAPSHOT_VERSION  1
+/* The packed SNL key, all the bytes after the terminator are zeroed so it could be compared by words */
+#define SNL_KEY_LEN    (TRACE2_STA_LEN + TRACE2_NET_LEN + TRACE2_LOC_LEN)
+#define SNL_KEY_WORDS  ((SNL_KEY_LEN + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+/* */
+typedef union {
+	char     bytes[SNL_KEY_WORDS * sizeof(uint64_t)];
+	uint64_t words[SNL_KEY_WORDS];
+} SNL_KEY;
+
+/*
+ * The slot of the open-addressing hash table, it is empty when the snl is NULL
+ */
+typedef struct {
+	uint64_t hash;
+	SNL_KEY  key;
+	USE_SNL *snl;
+} SNL_SLOT;
+
+/* */
+typedef struct {
+	uint32_t  serial;  /* Unique serial of each table, for invalidating the cached hits */
+	uint32_t  count;
+	uint32_t  mask;
+	SNL_SLOT *slots;
+} SNL_HASH;
+
+/* */
+typedef struct {
+	uint32_t serial;
+	SNL_KEY  key;
+	USE_SNL *snl;
+} SNL_CACHE;
+
+/*
+ * The unknown SNL which has been requested within the refresh generation
+ */
+typedef struct {
+	uint32_t generation;
+	SNL_KEY  key;
+} SNL_UNKNOWN;
+
+/*
+ * The header of the stations snapshot, it will be followed by the count of records
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t record_size;
+	int64_t  timestamp;  /* When the stations were fetched */
+} SNL_SNAPSHOT_HEADER;
+
+/* */
+typedef struct {
+	char   sta[TRACE2_STA_LEN];
+	char   net[TRACE2_NET_LEN];
+	char   loc[TRACE2_LOC_LEN];
+	double latitude;
+	double longitude;
+	double elevation;
+} SNL_SNAPSHOT_RECORD;
+
+/*
+ * The table & the stations replaced by the refreshing, the readers might still hold them until the grace period
+ */
+typedef struct snl_retired {
+	time_t              time;
+	SNL_HASH           *hash;
+	DL_NODE            *stations;
+	struct snl_retired *next;
+} SNL_RETIRED;
+
 /* */
 typedef struct {
-	int     count;      /* Number of clients in the list */
-	time_t  timestamp;  /* Time of the last time updated */
-	void   *entry;      /* Pointer to first client       */
-	void   *root;       /* Root of binary searching tree */
-	void   *root_t;     /* Temporary root of binary searching tree */
+	int               count;      /* Number of clients in the list */
+	time_t            timestamp;  /* Time of the last time updated */
+	void             *entry;      /* Pointer to first client       */
+	SNL_HASH *_Atomic hash;       /* Hash table of the clients, it is published atomically */
+	SNL_HASH         *hash_t;     /* Temporary hash table of the clients */
+	DL_NODE          *replaced;   /* The stations replaced or removed by the temporary table */
+	DL_NODE          *local;      /* The stations from the local list, they are kept by every refreshing */
+	SNL_RETIRED      *retired;
 } SNLList;
 
 /* */
-static int      fetch_list_sql( SNLList *, const char *, const DBINFO *, const int );
-static int      compare_snl( const void *, const void * );
-static SNLList *init_snl_list( void );
-static void     destroy_snl_list( SNLList * );
-static void     dummy_func( void * );
-static USE_SNL *update_stainfo( USE_SNL *, const USE_SNL * );
+static int       fetch_list_sql( SNLList *, const char *, const DBINFO *, const int );
+static SNLList  *init_snl_list( void );
+static void      destroy_snl_list( SNLList * );
+static uint64_t  pack_snl_key( SNL_KEY *, const char *, const char *, const char * );
+static int       is_same_snl_key( const SNL_KEY *, const SNL_KEY * );
+static void      pack_snl_field( char *, const char *, const int );
+static SNL_HASH *create_snl_hash( const uint32_t );
+static void      destroy_snl_hash( SNL_HASH * );
+static SNL_SLOT *probe_snl_hash( const SNL_HASH *, const SNL_KEY *, const uint64_t );
+static USE_SNL  *find_snl_hash( const SNL_HASH *, const SNL_KEY *, const uint64_t );
+static USE_SNL  *insert_snl_hash( SNL_HASH *, const SNL_KEY *, const uint64_t, USE_SNL * );
+static int       grow_snl_hash( SNL_HASH * );
+static int       compare_snl_pointer( const void *, const void * );
+static int       thread_refresher( void * );
+static int       refresh_snl_list( SNLList * );
+static void      retire_snl_list( SNLList *, SNL_HASH * );
+static void      free_retired_list( SNLList *, const time_t );
+static void      remove_usesnl_list( SNLList *, const USE_SNL * );
+static int       is_same_stainfo( const USE_SNL *, const USE_SNL * );
 static USE_SNL *append_usesnl_list( SNLList *, USE_SNL *, const int );
 static USE_SNL *create_new_usesnl(
 	const char *, const char *, const char *, const double, const double, const double
@@ -57,6 +165,24 @@ static void extract_stainfo_mysql(
 #endif
 /* */
 static SNLList *SList = NULL;
+static uint32_t HashSerial = 0;
+static char     SnapshotPath[MAX_PATH_STR] = { 0 };  /* Empty if don't want to keep the snapshot */
+/* Recent hits of each thread */
+static thread_local SNL_CACHE   SNLCache[SNL_CACHE_SIZE];
+static thread_local SNL_UNKNOWN SNLUnknown[SNL_UNKNOWN_SIZE];
+/* The background refresher */
+static uint8_t      RefresherReady  = 0;
+static int          RefreshInterval = 0;
+static int          RefreshTables   = 0;
+static char       (*RefreshTable)[MAX_TABLE_LEGTH] = NULL;
+static DBINFO       RefreshDBInfo;
+static atomic_int   RefreshRequest  = 0;
+static uint8_t      SnapshotStale   = 0;  /* The list is from the snapshot & not yet fetched completely */
+static atomic_uint  RefreshGeneration = 1;  /* Increased after every refreshing, it never be 0 */
+static volatile int Terminate       = 0;
+static mtx_t        RefreshMutex;
+static cnd_t        RefreshCond;
+static thrd_t       RefresherTid;
 
 /*
  * el_list_db_fetch() -
@@ -82,13 +208,14 @@ int el_list_db_fetch( const char *table_sta, const DBINFO *dbinfo, const int upd
  */
 int el_list_sta_line_parse( const char *line, const int update )
 {
-	int     result = 0;
-	char    sta[TRACE2_STA_LEN] = { 0 };
-	char    net[TRACE2_NET_LEN] = { 0 };
-	char    loc[TRACE2_LOC_LEN] = { 0 };
-	double  lat = 0.0;
-	double  lon = 0.0;
-	double  elv = 0.0;
+	int      result = 0;
+	char     sta[TRACE2_STA_LEN] = { 0 };
+	char     net[TRACE2_NET_LEN] = { 0 };
+	char     loc[TRACE2_LOC_LEN] = { 0 };
+	double   lat = 0.0;
+	double   lon = 0.0;
+	double   elv = 0.0;
+	USE_SNL *usesnl;
 
 /* */
 	if ( !SList ) {
@@ -101,7 +228,10 @@ int el_list_sta_line_parse( const char *line, const int update )
 /* */
 	if ( sscanf(line, "%s %s %s %lf %lf %lf", sta, net, loc, &lat, &lon, &elv) >= 6 ) {
 	/* */
-		if ( append_usesnl_list( SList, create_new_usesnl( sta, net, loc, lat, lon, elv ), update ) == NULL )
+		if ( (usesnl = append_usesnl_list( SList, create_new_usesnl( sta, net, loc, lat, lon, elv ), update )) == NULL )
+			result = -2;
+	/* Remember it, the refreshing only rebuilds the table from the local list & the SQL tables */
+		else if ( !dl_node_push( &SList->local, usesnl ) )
 			result = -2;
 	}
 	else {
@@ -117,28 +247,275 @@ int el_list_sta_line_parse( const char *line, const int update )
  */
 void el_list_end( void )
 {
+/* */
+	if ( RefresherReady ) {
+		mtx_lock(&RefreshMutex);
+		Terminate = 1;
+		cnd_signal(&RefreshCond);
+		mtx_unlock(&RefreshMutex);
+		thrd_join(RefresherTid, NULL);
+		cnd_destroy(&RefreshCond);
+		mtx_destroy(&RefreshMutex);
+		free(RefreshTable);
+		RefreshTable   = NULL;
+		RefresherReady = 0;
+	}
+/* */
 	destroy_snl_list( SList );
 	SList = NULL;
 
 	return;
 }
 
+/**
+ * @brief Start the background refresher of the stations from the SQL tables, it refreshes the list every
+ *        interval (in second, 0 for never) & when requested by el_list_refresh_request. The stations from the
+ *        local list are kept since it won't be changed without restarting, the others no longer in the
+ *        SQL tables are removed.
+ *
+ * @param tables
+ * @param ntables
+ * @param dbinfo
+ * @param interval
+ * @return int
+ */
+int el_list_refresh_init( const char tables[][MAX_TABLE_LEGTH], const int ntables, const DBINFO *dbinfo, const int interval )
+{
+	if ( !SList || ntables <= 0 || !strlen(dbinfo->host) )
+		return -1;
+	if ( RefresherReady )
+		return 0;
+/* */
+	if ( !(RefreshTable = calloc(ntables, MAX_TABLE_LEGTH)) )
+		return -1;
+	memcpy(RefreshTable, tables, (size_t)ntables * MAX_TABLE_LEGTH);
+	RefreshTables   = ntables;
+	RefreshDBInfo   = *dbinfo;
+	RefreshInterval = interval;
+	Terminate       = 0;
+	if ( mtx_init(&RefreshMutex, mtx_plain) != thrd_success )
+		goto except;
+	if ( cnd_init(&RefreshCond) != thrd_success ) {
+		mtx_destroy(&RefreshMutex);
+		goto except;
+	}
+	if ( thrd_create(&RefresherTid, thread_refresher, NULL) != thrd_success ) {
+		cnd_destroy(&RefreshCond);
+		mtx_destroy(&RefreshMutex);
+		goto except;
+	}
+	RefresherReady = 1;
+
+	return 0;
+/* Exception handle */
+except:
+	free(RefreshTable);
+	RefreshTable = NULL;
+	return -1;
+}
+
+/**
+ * @brief Set the path of the stations snapshot, the snapshot will be written after each successful fetching
+ *        from the SQL tables.
+ *
+ * @param path
+ * @return int
+ */
+int el_list_snapshot_init( const char *path )
+{
+	if ( !path || strlen(path) >= MAX_PATH_STR )
+		return -1;
+	strcpy(SnapshotPath, path);
+
+	return 0;
+}
+
+/**
+ * @brief Load the stations from the snapshot into the temporary table, the stations already in the table
+ *        (e.g. from the local list) are kept. The refresher will fetch the SQL tables at once & every period
+ *        until it succeeds, then the stations no longer in the tables are removed. It returns the number of
+ *        the loaded stations.
+ *
+ * @return int
+ */
+int el_list_snapshot_load( void )
+{
+	int                        fd;
+	void                      *map;
+	struct stat                fs;
+	const SNL_SNAPSHOT_HEADER *header;
+	const SNL_SNAPSHOT_RECORD *record;
+	SNL_KEY                    key;
+	int                        result = 0;
+
+/* */
+	if ( !SList && !(SList = init_snl_list()) ) {
+		logit("e", "earlyloc: Fatal! Trace list memory initialized error!\n");
+		return -3;
+	}
+	if ( !strlen(SnapshotPath) || (fd = open(SnapshotPath, O_RDONLY)) < 0 )
+		return -1;
+	if ( fstat(fd, &fs) || fs.st_size < (off_t)sizeof(SNL_SNAPSHOT_HEADER) ) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED )
+		return -1;
+/* Check the header & the size */
+	header = (const SNL_SNAPSHOT_HEADER *)map;
+	if (
+		header->magic != SNL_SNAPSHOT_MAGIC || header->version != SNL_SNAPSHOT_VERSION ||
+		header->record_size != sizeof(SNL_SNAPSHOT_RECORD) ||
+		(size_t)fs.st_size != sizeof(SNL_SNAPSHOT_HEADER) + (size_t)header->count * sizeof(SNL_SNAPSHOT_RECORD)
+	) {
+		munmap(map, fs.st_size);
+		return -1;
+	}
+/* */
+	record = (const SNL_SNAPSHOT_RECORD *)(header + 1);
+	for ( uint32_t i = 0; i < header->count; i++, record++ ) {
+		if (
+			record->sta[TRACE2_STA_LEN - 1] || record->net[TRACE2_NET_LEN - 1] || record->loc[TRACE2_LOC_LEN - 1] ||
+			(SList->hash_t && probe_snl_hash( SList->hash_t, &key, pack_snl_key( &key, record->sta, record->net, record->loc ) )->snl)
+		) {
+			continue;
+		}
+		if ( append_usesnl_list(
+				SList,
+				create_new_usesnl( record->sta, record->net, record->loc, record->latitude, record->longitude, record->elevation ),
+				EARLYLOC_LIST_INITIALIZING
+			) == NULL
+		) {
+			munmap(map, fs.st_size);
+			return -2;
+		}
+		result++;
+	}
+	munmap(map, fs.st_size);
+	SnapshotStale = result > 0;
+
+	return result;
+}
+
+/**
+ * @brief Write all the stations of the current table as the snapshot. It will be written to a temporary file
+ *        first & renamed after finishing, therefore the next startup will never load a half-written snapshot.
+ *
+ * @return int
+ */
+int el_list_snapshot_save( void )
+{
+	char                tmp_path[MAX_PATH_STR + 8];
+	FILE               *fp;
+	SNL_SNAPSHOT_HEADER header;
+	SNL_SNAPSHOT_RECORD record;
+	const USE_SNL      *usesnl;
+	const SNL_HASH     *hash = SList ? atomic_load_explicit(&SList->hash, memory_order_acquire) : NULL;
+	int                 ret  = 0;
+
+/* */
+	if ( !hash || !strlen(SnapshotPath) )
+		return -1;
+/* */
+	memset(&header, 0, sizeof(SNL_SNAPSHOT_HEADER));
+	header.magic       = SNL_SNAPSHOT_MAGIC;
+	header.version     = SNL_SNAPSHOT_VERSION;
+	header.count       = hash->count;
+	header.record_size = sizeof(SNL_SNAPSHOT_RECORD);
+	header.timestamp   = SList->timestamp;
+/* */
+	sprintf(tmp_path, "%s.tmp", SnapshotPath);
+	if ( (fp = fopen(tmp_path, "wb")) == NULL )
+		return -1;
+	if ( fwrite(&header, sizeof(SNL_SNAPSHOT_HEADER), 1, fp) != 1 )
+		ret = -1;
+	for ( uint32_t i = 0; i <= hash->mask && !ret; i++ ) {
+		if ( (usesnl = hash->slots[i].snl) ) {
+		/* Zero the padding, so the same list always makes the same file */
+			memset(&record, 0, sizeof(SNL_SNAPSHOT_RECORD));
+			memcpy(record.sta, usesnl->sta, TRACE2_STA_LEN);
+			memcpy(record.net, usesnl->net, TRACE2_NET_LEN);
+			memcpy(record.loc, usesnl->loc, TRACE2_LOC_LEN);
+			record.latitude  = usesnl->latitude;
+			record.longitude = usesnl->longitude;
+			record.elevation = usesnl->elevation;
+			if ( fwrite(&record, sizeof(SNL_SNAPSHOT_RECORD), 1, fp) != 1 )
+				ret = -1;
+		}
+	}
+	if ( fclose(fp) )
+		ret = -1;
+/* */
+	if ( ret || rename(tmp_path, SnapshotPath) ) {
+		remove(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Ask the refresher to fetch the list again (e.g. a pick from the unknown SNL), it never blocks &
+ *        the requests within the same checking period are merged into one.
+ *
+ */
+void el_list_refresh_request( void )
+{
+	atomic_store_explicit(&RefreshRequest, 1, memory_order_relaxed);
+	return;
+}
+
+/**
+ * @brief Ask the refresher for the SNL of the pick which is not in the list. Each unknown SNL only makes one
+ *        request until the next refreshing, the following picks from it are just dropped.
+ *
+ * @param pick
+ */
+void el_list_unknown_request( const EARLY_PICK_MSG *pick )
+{
+	const uint32_t generation = atomic_load_explicit(&RefreshGeneration, memory_order_relaxed);
+	SNL_UNKNOWN   *unknown;
+	SNL_KEY        key;
+	uint64_t       hvalue;
+
+/* */
+	hvalue  = pack_snl_key( &key, pick->station, pick->network, pick->location );
+	unknown = &SNLUnknown[hvalue & (SNL_UNKNOWN_SIZE - 1)];
+	if ( unknown->generation != generation || !is_same_snl_key( &unknown->key, &key ) ) {
+		unknown->generation = generation;
+		unknown->key        = key;
+		el_list_refresh_request();
+	}
+
+	return;
+}
+
 /*
  * earlyloc_list_find() -
  */
 USE_SNL *el_list_find( const EARLY_PICK_MSG *pick )
 {
-	USE_SNL *result = NULL;
-	USE_SNL  key;
+	USE_SNL   *result = NULL;
+	SNL_HASH  *hash   = atomic_load_explicit(&SList->hash, memory_order_acquire);
+	SNL_CACHE *cache;
+	SNL_KEY    key;
+	uint64_t   hvalue;
 
 /* */
-	memcpy(key.sta, pick->station, TRACE2_STA_LEN);
-	memcpy(key.net, pick->network, TRACE2_NET_LEN);
-	memcpy(key.loc, pick->location, TRACE2_LOC_LEN);
+	if ( !hash )
+		return NULL;
+/* Check the recent hits of this thread first */
+	hvalue = pack_snl_key( &key, pick->station, pick->network, pick->location );
+	cache  = &SNLCache[hvalue & (SNL_CACHE_SIZE - 1)];
+	if ( cache->serial == hash->serial && is_same_snl_key( &cache->key, &key ) )
+		return cache->snl;
 /* Find which station */
-	if ( (result = tfind(&key, &SList->root, compare_snl)) != NULL ) {
-	/* Found in the main Palert table */
-		result = *(USE_SNL **)result;
+	if ( (result = find_snl_hash( hash, &key, hvalue )) ) {
+		cache->serial = hash->serial;
+		cache->key    = key;
+		cache->snl    = result;
 	}
 
 	return result;
@@ -149,16 +526,12 @@ USE_SNL *el_list_find( const EARLY_PICK_MSG *pick )
  */
 void el_list_tree_activate( void )
 {
-	void *_root = SList->root;
+	SNL_HASH *_hash = atomic_exchange_explicit(&SList->hash, SList->hash_t, memory_order_acq_rel);
 
-	SList->root      = SList->root_t;
-	SList->root_t    = NULL;
+/* The former table will be freed by the refresher (or at the end) after the grace period */
+	SList->hash_t    = NULL;
 	SList->timestamp = time(NULL);
-
-	if ( _root ) {
-		sleep_ew(1000);
-		tdestroy(_root, dummy_func);
-	}
+	retire_snl_list( SList, _hash );
 
 	return;
 }
@@ -168,10 +541,21 @@ void el_list_tree_activate( void )
  */
 void el_list_tree_abandon( void )
 {
-	if ( SList->root_t )
-		tdestroy(SList->root_t, dummy_func);
+	const SNL_HASH *hash = atomic_load_explicit(&SList->hash, memory_order_acquire);
+	const SNL_SLOT *slot;
 
-	SList->root_t = NULL;
+/* Free the new stations only within the temporary table, the others are still used by the current table */
+	for ( uint32_t i = 0; hash && SList->hash_t && i <= SList->hash_t->mask; i++ ) {
+		slot = SList->hash_t->slots + i;
+		if ( slot->snl && probe_snl_hash( hash, &slot->key, slot->hash )->snl != slot->snl ) {
+			remove_usesnl_list( SList, slot->snl );
+			free(slot->snl);
+		}
+	}
+	destroy_snl_hash( SList->hash_t );
+	SList->hash_t = NULL;
+/* The replaced ones are still used by the current table */
+	dl_list_destroy( &SList->replaced, NULL );
 
 	return;
 }
@@ -223,7 +607,7 @@ static int fetch_list_sql( SNLList *list, const char *table_sta, const DBINFO *d
 	MYSQL_ROW  sql_row;
 
 /* Connect to database */
-	printf("earlyloc: Querying the stations information from MySQL server %s...\n", dbinfo->host);
+	logit("o", "earlyloc: Querying the stations information from MySQL server %s...\n", dbinfo->host);
 	sql_res = dblist_sta_query_sql(
 		dbinfo, table_sta, EARLYLOC_INFO_FROM_SQL,
 		COL_STA_STATION, COL_STA_NETWORK, COL_STA_LOCATION,
@@ -231,7 +615,7 @@ static int fetch_list_sql( SNLList *list, const char *table_sta, const DBINFO *d
 	);
 	if ( sql_res == NULL )
 		return -1;
-	printf("earlyloc: Queried the stations information success!\n");
+	logit("o", "earlyloc: Queried the stations information success!\n");
 
 /* Start the SQL server connection for channel */
 	dblist_start_persistent_sql( dbinfo );
@@ -294,8 +678,8 @@ static void extract_stainfo_mysql(
  */
 static int fetch_list_sql( SNLList *list, const char *table_sta, const DBINFO *dbinfo, const int update )
 {
-	printf(
-		"earlyloc: Skip the process of fetching station list from remote database "
+	logit(
+		"o", "earlyloc: Skip the process of fetching station list from remote database "
 		"'cause you did not define the _USE_SQL tag when compiling.\n"
 	);
 	return 0;
@@ -313,8 +697,11 @@ static SNLList *init_snl_list( void )
 		result->count     = 0;
 		result->timestamp = time(NULL);
 		result->entry     = NULL;
-		result->root      = NULL;
-		result->root_t    = NULL;
+		result->hash      = NULL;
+		result->hash_t    = NULL;
+		result->replaced  = NULL;
+		result->local     = NULL;
+		result->retired   = NULL;
 	}
 
 	return result;
@@ -327,7 +714,11 @@ static void destroy_snl_list( SNLList *list )
 {
 	if ( list != (SNLList *)NULL ) {
 	/* */
-		tdestroy(list->root, dummy_func);
+		free_retired_list( list, time(NULL) + LIST_RETIRE_GRACE );
+		dl_list_destroy( &list->replaced, NULL );
+		dl_list_destroy( &list->local, NULL );
+		destroy_snl_hash( list->hash );
+		destroy_snl_hash( list->hash_t );
 		dl_list_destroy( (DL_NODE **)&list->entry, free );
 		free(list);
 	}
@@ -340,43 +731,264 @@ static void destroy_snl_list( SNLList *list )
  */
 static USE_SNL *append_usesnl_list( SNLList *list, USE_SNL *usesnl, const int update )
 {
-	USE_SNL *result = NULL;
-	void    **_root  = update == EARLYLOC_LIST_UPDATING ? &list->root : &list->root_t;
+	USE_SNL  *result = NULL;
+	SNL_HASH *hash;
+	SNL_SLOT *slot;
+	SNL_KEY   key;
+	uint64_t  hvalue;
 
 /* */
 	if ( list && usesnl ) {
-		if ( (result = tfind(usesnl, _root, compare_snl)) == NULL ) {
-		/* Insert the station information into binary tree */
-			if ( dl_node_append( (DL_NODE **)&list->entry, usesnl ) == NULL ) {
+		if ( !list->hash_t && !(list->hash_t = create_snl_hash( SNL_HASH_INIT_SLOTS )) ) {
+			logit("e", "earlyloc: Error creating the hash table of channels!\n");
+			goto except;
+		}
+	/* */
+		hvalue = pack_snl_key( &key, usesnl->sta, usesnl->net, usesnl->loc );
+		if ( (slot = probe_snl_hash( list->hash_t, &key, hvalue ))->snl ) {
+		/* The first one wins, so the local list is always ahead of the SQL tables */
+			if ( update != EARLYLOC_LIST_UPDATING ) {
+				logit(
+					"o", "earlyloc: SNL(%s.%s.%s) is already in the list, skip it!\n",
+					usesnl->sta, usesnl->net, usesnl->loc
+				);
+			}
+			result = slot->snl;
+			free(usesnl);
+		}
+		else {
+		/* Reuse the unchanged published one, the changed one will be retired after the table is activated */
+			if (
+				update == EARLYLOC_LIST_UPDATING &&
+				(hash = atomic_load_explicit(&list->hash, memory_order_acquire)) &&
+				(slot = probe_snl_hash( hash, &key, hvalue ))->snl && is_same_stainfo( slot->snl, usesnl )
+			) {
+				free(usesnl);
+				usesnl = slot->snl;
+			}
+		/* Insert the station information into hash table */
+			else if ( dl_node_push( (DL_NODE **)&list->entry, usesnl ) == NULL ) {
 				logit("e", "earlyloc: Error insert channel into linked list!\n");
 				goto except;
 			}
-			if ( (result = tsearch(usesnl, &list->root_t, compare_snl)) == NULL ) {
-				logit("e", "earlyloc: Error insert channel into binary tree!\n");
-				goto except;
+			if ( (result = insert_snl_hash( list->hash_t, &key, hvalue, usesnl )) == NULL ) {
+				logit("e", "earlyloc: Error insert channel into hash table!\n");
+				return NULL;
 			}
 		}
-		else if ( update == EARLYLOC_LIST_UPDATING ) {
-			update_stainfo( *(USE_SNL **)result, usesnl );
-			if ( (result = tsearch(usesnl, &list->root_t, compare_snl)) == NULL ) {
-				logit("e", "earlyloc: Error insert channel into binary tree!\n");
-				goto except;
+	}
+
+	return result;
+/* Exception handle */
+except:
+	free(usesnl);
+	return NULL;
+}
+
+/*
+ *  remove_usesnl_list() - Removing the station from the linked list without freeing it.
+ */
+static void remove_usesnl_list( SNLList *list, const USE_SNL *usesnl )
+{
+	DL_NODE *node;
+
+/* */
+	DL_LIST_FOR_EACH( (DL_NODE *)list->entry, node ) {
+		if ( node->data == usesnl ) {
+			if ( node == list->entry )
+				list->entry = node->next;
+			dl_node_delete( node, NULL );
+			break;
+		}
+	}
+
+	return;
+}
+
+/*
+ *  retire_snl_list() - Moving the former table & the replaced stations to the retired list.
+ */
+static void retire_snl_list( SNLList *list, SNL_HASH *hash )
+{
+	SNL_RETIRED *retired;
+	DL_NODE     *node;
+	DL_NODE     *safe;
+	void       **replaced;
+	size_t       nreplaced = 0;
+
+/* */
+	if ( !hash && !list->replaced )
+		return;
+/* Sort the replaced ones, so they could be removed within one pass of the linked list */
+	DL_LIST_FOR_EACH( list->replaced, node ) {
+		nreplaced++;
+	}
+	if ( nreplaced && (replaced = (void **)malloc(nreplaced * sizeof(void *))) ) {
+		nreplaced = 0;
+		DL_LIST_FOR_EACH( list->replaced, node ) {
+			replaced[nreplaced++] = node->data;
+		}
+		qsort(replaced, nreplaced, sizeof(void *), compare_snl_pointer);
+		DL_LIST_FOR_EACH_SAFE( (DL_NODE *)list->entry, node, safe ) {
+			if ( bsearch(&node->data, replaced, nreplaced, sizeof(void *), compare_snl_pointer) ) {
+				if ( node == list->entry )
+					list->entry = safe;
+				dl_node_delete( node, NULL );
 			}
 		}
+		free(replaced);
+	}
+	else {
+		DL_LIST_FOR_EACH( list->replaced, node ) {
+			remove_usesnl_list( list, node->data );
+		}
+	}
+	if ( (retired = (SNL_RETIRED *)calloc(1, sizeof(SNL_RETIRED))) ) {
+		retired->time     = time(NULL);
+		retired->hash     = hash;
+		retired->stations = list->replaced;
+		retired->next     = list->retired;
+		list->retired     = retired;
+	}
+	else {
+		logit("e", "earlyloc: Error retiring the former stations list, it won't be freed!\n");
+		dl_list_destroy( &list->replaced, NULL );
+	}
+	list->replaced = NULL;
+
+	return;
+}
+
+/*
+ *  free_retired_list() - Freeing the retired tables & stations which have passed the grace period.
+ */
+static void free_retired_list( SNLList *list, const time_t now )
+{
+	SNL_RETIRED **prev;
+	SNL_RETIRED  *retired;
+
+/* */
+	for ( prev = &list->retired; (retired = *prev); ) {
+		if ( now - retired->time >= LIST_RETIRE_GRACE ) {
+			*prev = retired->next;
+			destroy_snl_hash( retired->hash );
+			dl_list_destroy( &retired->stations, free );
+			free(retired);
+		}
 		else {
-			logit(
-				"o", "earlyloc: SNL(%s.%s.%s) is already in the list, skip it!\n",
-				usesnl->sta, usesnl->net, usesnl->loc
-			);
-			free(usesnl);
+			prev = &retired->next;
 		}
 	}
 
-	return result ? *(USE_SNL **)result : NULL;
+	return;
+}
+
+/*
+ *  refresh_snl_list() - Building the new table from the local list & all the SQL tables, then activating it
+ *                       when there is any change. The stations no longer in the SQL tables are retired.
+ */
+static int refresh_snl_list( SNLList *list )
+{
+	int       result   = 0;
+	int       nremoved = 0;
+	SNL_HASH *hash     = atomic_load_explicit(&list->hash, memory_order_acquire);
+	SNL_SLOT *slot;
+	SNL_KEY   key;
+	USE_SNL  *usesnl;
+	DL_NODE  *node;
+
+/* */
+	if ( !(list->hash_t = create_snl_hash( hash ? hash->mask + 1 : SNL_HASH_INIT_SLOTS )) ) {
+		logit("e", "earlyloc: Error creating the hash table for refreshing the stations list!\n");
+		return -1;
+	}
+	DL_LIST_FOR_EACH( list->local, node ) {
+		usesnl = (USE_SNL *)node->data;
+		if ( !insert_snl_hash( list->hash_t, &key, pack_snl_key( &key, usesnl->sta, usesnl->net, usesnl->loc ), usesnl ) )
+			goto except;
+	}
+/* The empty table is taken as failed too, it won't remove all the stations by the temporary error */
+	for ( int i = 0; i < RefreshTables; i++ ) {
+		if ( fetch_list_sql( list, RefreshTable[i], &RefreshDBInfo, EARLYLOC_LIST_UPDATING ) <= 0 ) {
+			logit("e", "earlyloc: Error refreshing the stations list %s, keep the former stations!\n", RefreshTable[i]);
+			result = -1;
+		}
+	}
+/* Retire the former stations which are changed or gone, but keep the gone ones when some tables were failed */
+	for ( uint32_t i = 0; hash && i <= hash->mask; i++ ) {
+		if ( !(usesnl = hash->slots[i].snl) )
+			continue;
+		if ( (slot = probe_snl_hash( list->hash_t, &hash->slots[i].key, hash->slots[i].hash ))->snl == usesnl )
+			continue;
+		if ( !slot->snl && result ) {
+			if ( !insert_snl_hash( list->hash_t, &hash->slots[i].key, hash->slots[i].hash, usesnl ) )
+				goto except;
+			continue;
+		}
+		if ( !dl_node_push( &list->replaced, usesnl ) )
+			goto except;
+		if ( !slot->snl )
+			nremoved++;
+	}
+/* */
+	if ( hash && list->hash_t->count == hash->count && !list->replaced ) {
+		el_list_tree_abandon();
+		list->timestamp = time(NULL);
+	}
+	else {
+		el_list_tree_activate();
+		logit(
+			"ot", "earlyloc: Stations list has been refreshed, %d station(s) removed & there are total %d station(s) in the list now.\n",
+			nremoved, el_list_total_station_get()
+		);
+	/* Only the complete list is worth keeping for the next startup */
+		if ( !result && strlen(SnapshotPath) && el_list_snapshot_save() )
+			logit("e", "earlyloc: Error writing the stations snapshot %s!\n", SnapshotPath);
+	}
+/* The unknown SNLs could be requested again */
+	atomic_fetch_add_explicit(&RefreshGeneration, 1, memory_order_relaxed);
+	if ( !result )
+		SnapshotStale = 0;
+
+	return result;
 /* Exception handle */
 except:
-	free(usesnl);
-	return NULL;
+	logit("e", "earlyloc: Error building the refreshed stations list, keep the former stations!\n");
+	el_list_tree_abandon();
+	list->timestamp = time(NULL);
+	return -1;
+}
+
+/*
+ * thread_refresher() - The background refresher, it checks the requests & the interval every period.
+ */
+static int thread_refresher( void *arg )
+{
+	struct timespec until;
+	time_t          now;
+
+/* */
+	mtx_lock(&RefreshMutex);
+	while ( !Terminate ) {
+		mtx_unlock(&RefreshMutex);
+	/* Check before waiting, so the request made before starting (e.g. loaded from the snapshot) is served at once */
+		now = time(NULL);
+		free_retired_list( SList, now );
+		if (
+			atomic_exchange(&RefreshRequest, 0) || SnapshotStale ||
+			(RefreshInterval > 0 && now - SList->timestamp >= RefreshInterval)
+		) {
+			refresh_snl_list( SList );
+		}
+		mtx_lock(&RefreshMutex);
+	/* */
+		timespec_get(&until, TIME_UTC);
+		until.tv_sec += LIST_REFRESH_MIN_INTERVAL;
+		while ( !Terminate && cnd_timedwait(&RefreshCond, &RefreshMutex, &until) != thrd_timedout );
+	}
+	mtx_unlock(&RefreshMutex);
+
+	return 0;
 }
 
 /*
@@ -408,21 +1020,63 @@ static USE_SNL *enrich_stainfo_raw(
 	usesnl->latitude  = lat;
 	usesnl->longitude = lon;
 	usesnl->elevation = elv;
+	el_misc_geometry_init( &usesnl->geometry, lon, lat );
 
 	return usesnl;
 }
 
 /*
- * update_stainfo() -
+ * is_same_stainfo() -
  */
-static USE_SNL *update_stainfo( USE_SNL *dest, const USE_SNL *src )
+static int is_same_stainfo( const USE_SNL *a, const USE_SNL *b )
 {
+	return a->latitude == b->latitude && a->longitude == b->longitude && a->elevation == b->elevation;
+}
+
+/**
+ * @brief Pack the SNL into the key with the zeroed tail & return its hash, which is mixed word by word
+ *        with the golden ratio multiplier.
+ *
+ * @param key
+ * @param sta
+ * @param net
+ * @param loc
+ * @return uint64_t
+ */
+static uint64_t pack_snl_key( SNL_KEY *key, const char *sta, const char *net, const char *loc )
+{
+	uint64_t result = 0;
+
 /* */
-	dest->latitude  = src->latitude;
-	dest->longitude = src->longitude;
-	dest->elevation = src->elevation;
+	key->words[SNL_KEY_WORDS - 1] = 0;
+	pack_snl_field( key->bytes, sta, TRACE2_STA_LEN );
+	pack_snl_field( key->bytes + TRACE2_STA_LEN, net, TRACE2_NET_LEN );
+	pack_snl_field( key->bytes + TRACE2_STA_LEN + TRACE2_NET_LEN, loc, TRACE2_LOC_LEN );
+	for ( size_t i = 0; i < SNL_KEY_WORDS; i++ )
+		result = (result ^ key->words[i]) * 0x9e3779b97f4a7c15ULL;
 
-	return dest;
+	return result ^ (result >> 29);
+}
+
+/**
+ * @brief Copy the fixed-width field & zero all the bytes after the terminator, it is branch-free since
+ *        the lengths of the codes are varied.
+ *
+ * @param dest
+ * @param src
+ * @param len
+ */
+static inline void pack_snl_field( char *dest, const char *src, const int len )
+{
+	int end = 0;
+
+/* */
+	for ( int i = 0; i < len; i++ ) {
+		end    |= src[i] == '\0';
+		dest[i] = end ? '\0' : src[i];
+	}
+
+	return;
 }
 
 /**
@@ -432,25 +1086,154 @@ static USE_SNL *update_stainfo( USE_SNL *dest, const USE_SNL *src )
  * @param b
  * @return int
  */
-static int compare_snl( const void *a, const void *b )
+static int is_same_snl_key( const SNL_KEY *a, const SNL_KEY *b )
 {
-	int result;
-	USE_SNL *tmpa = (USE_SNL *)a;
-	USE_SNL *tmpb = (USE_SNL *)b;
+	uint64_t result = 0;
 
 /* */
-	if ( (result = strcmp( tmpa->sta, tmpb->sta )) )
-		return result;
-	if ( (result = strcmp( tmpa->net, tmpb->net )) )
-		return result;
+	for ( size_t i = 0; i < SNL_KEY_WORDS; i++ )
+		result |= a->words[i] ^ b->words[i];
 
-	return strcmp( tmpa->loc, tmpb->loc );
+	return result == 0;
 }
 
-/*
- * dummy_func() -
+/**
+ * @brief
+ *
+ * @return SNL_HASH*
  */
-static void dummy_func( void *node )
+static SNL_HASH *create_snl_hash( const uint32_t slots )
 {
+	SNL_HASH *result = (SNL_HASH *)calloc(1, sizeof(SNL_HASH));
+
+/* */
+	if ( result ) {
+		if ( !(result->slots = (SNL_SLOT *)calloc(slots, sizeof(SNL_SLOT))) ) {
+			free(result);
+			return NULL;
+		}
+		result->serial = ++HashSerial;
+		result->mask   = slots - 1;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Only the table is freed, the stations are still kept in the linked list.
+ *
+ * @param hash
+ */
+static void destroy_snl_hash( SNL_HASH *hash )
+{
+	if ( hash ) {
+		free(hash->slots);
+		free(hash);
+	}
+
 	return;
 }
+
+/**
+ * @brief Linear probing until the slot with the same key or the empty one.
+ *
+ * @param hash
+ * @param key
+ * @param hvalue
+ * @return SNL_SLOT*
+ */
+static SNL_SLOT *probe_snl_hash( const SNL_HASH *hash, const SNL_KEY *key, const uint64_t hvalue )
+{
+	SNL_SLOT *slot;
+
+/* */
+	for ( uint32_t i = (uint32_t)hvalue & hash->mask; (slot = hash->slots + i)->snl; i = (i + 1) & hash->mask )
+		if ( slot->hash == hvalue && is_same_snl_key( &slot->key, key ) )
+			break;
+
+	return slot;
+}
+
+/**
+ * @brief
+ *
+ * @param hash
+ * @param key
+ * @param hvalue
+ * @return USE_SNL*
+ */
+static USE_SNL *find_snl_hash( const SNL_HASH *hash, const SNL_KEY *key, const uint64_t hvalue )
+{
+	return probe_snl_hash( hash, key, hvalue )->snl;
+}
+
+/**
+ * @brief Insert the station & return it, or return the existed one with the same key.
+ *
+ * @param hash
+ * @param key
+ * @param hvalue
+ * @param snl
+ * @return USE_SNL*
+ */
+static USE_SNL *insert_snl_hash( SNL_HASH *hash, const SNL_KEY *key, const uint64_t hvalue, USE_SNL *snl )
+{
+	SNL_SLOT *slot;
+
+/* Keep the load factor under one half */
+	if ( (hash->count + 1) * 2 > hash->mask + 1 && grow_snl_hash( hash ) )
+		return NULL;
+/* */
+	if ( (slot = probe_snl_hash( hash, key, hvalue ))->snl )
+		return slot->snl;
+/* */
+	slot->hash = hvalue;
+	slot->key  = *key;
+	slot->snl  = snl;
+	hash->count++;
+
+	return snl;
+}
+
+/**
+ * @brief Double the slots & rehash all the stations.
+ *
+ * @param hash
+ * @return int
+ */
+static int grow_snl_hash( SNL_HASH *hash )
+{
+	SNL_SLOT      *slots;
+	const uint32_t mask = hash->mask * 2 + 1;
+	uint32_t       j;
+
+/* */
+	if ( !(slots = (SNL_SLOT *)calloc((size_t)mask + 1, sizeof(SNL_SLOT))) )
+		return -1;
+	for ( uint32_t i = 0; i <= hash->mask; i++ ) {
+		if ( hash->slots[i].snl ) {
+			for ( j = (uint32_t)hash->slots[i].hash & mask; slots[j].snl; j = (j + 1) & mask );
+			slots[j] = hash->slots[i];
+		}
+	}
+	free(hash->slots);
+	hash->slots = slots;
+	hash->mask  = mask;
+
+	return 0;
+}
+
+/**
+ * @brief
+ *
+ * @param a
+ * @param b
+ * @return int
+ */
+static int compare_snl_pointer( const void *a, const void *b )
+{
+	const uintptr_t ptr_a = (uintptr_t)*(void * const *)a;
+	const uintptr_t ptr_b = (uintptr_t)*(void * const *)b;
+
+	return (ptr_a > ptr_b) - (ptr_a < ptr_b);
+}
@@ -8,20 +8,58 @@
  * @copyright Copyright (c) 2023
  *
  */
+#define _GNU_SOURCE
 /* */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <search.h>
 /* */
 #include <constants.h>
 #include <raytracing.h>
 #include <dl_chain_list.h>
-#include <matrix.h>
+#include <matrix_small.h>
+#include <worker_pool.h>
 #include <earlyloc.h>
 #include <earlyloc_misc.h>
+#include <earlyloc_tttable.h>
+#include <earlyloc_velmod.h>
+
+/* The real number type of the 1D linear-gradient kernel, single precision is optional */
+#if defined( _USE_SINGLE_PRECISION )
+#include <tgmath.h>
+typedef float  LOC_REAL;
+#else
+typedef double LOC_REAL;
+#endif
+#define LOC_REAL_C(__VALUE)  ((LOC_REAL)(__VALUE))
+/* The normal equations are solved by the fixed-size kernels of matrix_small.h */
+#if HYPO_PARAMS_NUMBER != 4
+#error "The fixed-size normal equations only support four hypocenter parameters!"
+#endif
 
 /* */
 #define GEIGER_ERROR_RETURN  -1.0f
+/* Levenberg-Marquardt damping & convergence control of the Geiger's method */
+#define GEIGER_MAX_ITERATION     20
+#define GEIGER_LM_INIT_DAMPING   1.0e-2
+#define GEIGER_LM_MIN_DAMPING    1.0e-6
+#define GEIGER_LM_MAX_DAMPING    1.0e+4
+#define GEIGER_LM_INC_FACTOR     10.0
+#define GEIGER_LM_DEC_FACTOR     0.1
+#define GEIGER_CONVERGE_NORM     1.0f
+#define GEIGER_CONVERGE_MISFIT   1.0e-3
+#define GEIGER_MAX_TIME_DRIFT    60.0f
+/* Acceptance of the incremental relocating, otherwise it will fall back to the full locating */
+#define INCREMENTAL_MAX_NORM      10.0f
+#define INCREMENTAL_MISFIT_JUMP   2.0f
+/* Tukey's biweight tuning constant & the minimum residual scale (in second) of the robust locating */
+#define ROBUST_TUKEY_CONSTANT     4.685f
+#define ROBUST_MIN_SCALE          0.3f
+#define ROBUST_MAD_FACTOR         1.4826f
+#define ROBUST_MAX_REWEIGHT       2
+#define ROBUST_SCALE_TOLERANCE    0.2f
 /* */
 #define NEAR_HYPO_DISTANCE    80.0f
 #define FAR_HYPO_DISTANCE     600.0f
@@ -30,40 +68,127 @@
  */
 typedef struct {
 /* Hypo & station point */
-	double hyp_depth;
-	double epc_dist;
-	double epc_dist_x;
-	double epc_dist_y;
+	LOC_REAL hyp_depth;
+	LOC_REAL epc_dist;
+	LOC_REAL epc_dist_x;
+	LOC_REAL epc_dist_y;
 /* Velocity parameters */
-	double vel_init;
-	double vel_grad;
+	LOC_REAL vel_init;
+	LOC_REAL vel_grad;
 /* Center of the circle */
-	double center_x;
-	double center_z;
+	LOC_REAL center_x;
+	LOC_REAL center_z;
 /* Angles */
-	double angle_a;
-	double angle_b;
+	LOC_REAL angle_a;
+	LOC_REAL angle_b;
 /* Travel time */
-	double traveltime;
+	LOC_REAL traveltime;
 } LINEAR_RAY_INFO;
 
+/*
+ * The linearized system of the Geiger's method at one trial hypocenter
+ */
+typedef struct {
+	int     valids;
+	double  delta_x;
+	double  delta_y;
+	double  misfit;
+	double  weight_norm;
+	double  robust_scale;
+/* The normal equations of the weighted least square, GtWG & GtWd */
+	MAT4    gtwg;
+	double  gtwd[HYPO_PARAMS_NUMBER];
+} GEIGER_SYSTEM;
+
+/*
+ * The cached ray of one station & phase within the hypo
+ */
+typedef struct {
+	char         key[TRACE2_STA_LEN + TRACE2_NET_LEN + TRACE2_LOC_LEN + 4];
+	RT_RAY_CACHE cache;
+} RAY_CACHE_NODE;
+
+/*
+ * The 3D travel time of single pick, the tasks only write to their own slots & the shared states of
+ * the hypo (cache tree & statistics) are handled serially before & after the parallel part
+ */
+typedef struct {
+	const PICK_STATE *pick;
+	RT_RAY_CACHE     *cache;
+	double            trv_time;
+	double            derivatives[HYPO_PARAMS_NUMBER];
+	int               result;   /* The result of rt_main_cache, or -1 when failed */
+	RT_TRACE_INFO     info;
+} TRACE_TASK;
+
+/*
+ * The batch of the tasks at the same trial hypocenter
+ */
+typedef struct {
+	double            lon0;
+	double            lat0;
+	double            depth0;
+	double            delta_x;
+	double            delta_y;
+	int               derivatives;    /* Non-zero if the derivatives are needed */
+	const RT_PROFILE *profile;        /* The coarse one for the trial hypocenters, the fine one for the final */
+	const RT_VELMOD  *model;          /* The model held by the hypo */
+	int               ntasks;
+	TRACE_TASK       *tasks;
+} TRACE_BATCH;
+
+/* The result of the table lookup & the tracing without the cache, besides the results of rt_main_cache */
+#define TRACE_RESULT_TABLE    -2
+#define TRACE_RESULT_NOCACHE  -3
+
 /* */
-static double step_geiger_method(
-	double *, double *, double *, double *, PICKS_POOL *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *, const double [HYPO_PARAMS_NUMBER]
+static int    run_geiger_method(
+	HYPO_STATE *, double *, double *, double *, double *, const double, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *
+);
+static void   init_geiger_system( GEIGER_SYSTEM *, const int );
+static double linearize_geiger_method(
+	GEIGER_SYSTEM *, const double, const double, const double, double *, PICKS_POOL *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *
+);
+static double linearize_geiger_method_3D( GEIGER_SYSTEM *, const double, const double, const double, double *, HYPO_STATE * );
+static double step_geiger_method( const GEIGER_SYSTEM *, double *, double *, double *, double *, const double );
+static double apply_geiger_adjustments(
+	const double [HYPO_PARAMS_NUMBER], const double, const double, double *, double *, double *, double *
+);
+static void   store_normal_equations(
+	HYPO_NORMAL_EQS *, const GEIGER_SYSTEM *, const uint64_t, const double, const double, const double, const double
+);
+static uint64_t get_pickset_hash( const PICKS_POOL *, const PICK_STATE * );
+static uint64_t get_pick_hash( const PICK_STATE * );
+static int    get_pick_derivatives(
+	const double, const double, const double, HYPO_STATE *, const PICK_STATE *, double [HYPO_PARAMS_NUMBER], double *, double *,
+	const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *
 );
-static double step_geiger_method_3D( double *, double *, double *, double *, PICKS_POOL *, const double [HYPO_PARAMS_NUMBER] );
 static double step_geiger_method_tdiff( double *, double *, double *, double *, PICKS_POOL *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *, const int );
 static void update_picks_state(
 	const double, const double, const double, const double, PICKS_POOL *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL *
 );
-static void update_picks_state_3D( const double, const double, const double, const double, PICKS_POOL * );
+static void update_picks_state_3D( const double, const double, const double, const double, HYPO_STATE * );
 static void update_hypo_state( const double, const double, const double, const double, HYPO_STATE * );
 static LINEAR_RAY_INFO *get_linear_ray(
 	LINEAR_RAY_INFO *, const double, const double, const double, const double, const double, const double, const double, const double, const double
 );
 static double *get_travel_time_derivatives( const LINEAR_RAY_INFO *, double [HYPO_PARAMS_NUMBER] );
 static double *get_travel_time_derivatives_3D( const RAY_INFO *, const int, double [HYPO_PARAMS_NUMBER] );
+static int     get_travel_time_3D(
+	const double, const double, const double, const double, const double, HYPO_STATE *, const PICK_STATE *, double *,
+	double [HYPO_PARAMS_NUMBER]
+);
+static int     trace_picks_3D( HYPO_STATE *, TRACE_BATCH * );
+static void    trace_pick_task( void *, const int );
+static const RT_VELMOD *get_hypo_velmod( HYPO_STATE * );
+static RT_RAY_CACHE *get_ray_cache( HYPO_STATE *, const PICK_STATE * );
+static int     compare_ray_cache( const void *, const void * );
+static void    free_ray_cache( void * );
 static double  get_r_weight( const double, const double, const double, const int, const int );
+static double  get_r_loss( const double, const double, const double, const int, const int );
+static double  get_robust_weight( const double, const double, const int );
+static double  get_robust_residual( const double, const double, const int );
+static double  get_robust_scale( const PICKS_POOL * );
 static double  get_gap_degree( const double, const double, const PICKS_POOL * );
 static double  get_pool_residual_avg( const double, const double, const double, const double, PICKS_POOL *, const LAYER_VEL_MODEL *, const LAYER_VEL_MODEL * );
 static int     get_hypo_quality( const int, const double, const double, const double );
@@ -92,55 +217,200 @@ static int     compare_gap( const void *, const void * );
 		((__RAY_PATH) = (LINEAR_RAY_INFO){ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 })
 
 /* */
-static uint8_t VelocityModel3DReady = 0;
+static WORKER_POOL *TracePool = NULL;
+/* The termination profiles of the pseudo-bending, the tolerances & kernel could be changed by el_loc_3dtrace_profile */
+static RT_PROFILE TraceProfiles[2];
+static const RT_PROFILE *TraceProfileCoarse = &rt_profile_coarse;
+static const RT_PROFILE *TraceProfileFine   = &rt_profile_fine;
 
 /*
  *
  */
 int el_loc_primary_locate( HYPO_STATE *hyp, const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model )
 {
+	int    iters;
 	double lon0, lat0, depth0, time0;
-	double tmp;
 
 /* */
 	lon0   = hyp->longitude;
 	lat0   = hyp->latitude;
 	depth0 = hyp->depth;
 	time0  = hyp->origin_time;
+/* Something error when doing geiger method */
+	if ( (iters = run_geiger_method( hyp, &lon0, &lat0, &depth0, &time0, 0.0, p_model, s_model )) < 0 )
+		return -1;
+/* Calculate relative parameters one more by new hyp location */
+	time0 += get_pool_residual_avg( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
+	if ( get_hypo_velmod( hyp ) )
+		update_picks_state_3D( lon0, lat0, depth0, time0, hyp );
+	else
+		update_picks_state( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
+/* Update all the parameters to the hypo state */
+	update_hypo_state( lon0, lat0, depth0, time0, hyp );
+#ifdef _DEBUG
+	printf(
+		"earlyloc: Primary locate to: %lf %lf %lf %lf, average error: %lf, iterations: %d\n",
+		lon0, lat0, depth0, time0, hyp->avg_error, iters
+	);
+#endif
 
-/* First, Geiger's method step for 20 times */
-	for ( int i = 0; i < 20; i++ ) {
-		if ( VelocityModel3DReady )
-			tmp = step_geiger_method_3D( &lon0, &lat0, &depth0, &time0, &hyp->pool, NULL );
+	return 0;
+}
+
+/**
+ * @brief Locate the hypo by the iteratively reweighted Geiger's method with Tukey's biweight, the scale
+ *        is estimated by the MAD of residuals & it will be re-estimated at the new hypocenter. After that,
+ *        all the outliers (except primary picks) will be masked within one pass. It returns the number of
+ *        masked picks, or -1 when something error.
+ *
+ * @param hyp
+ * @param p_model
+ * @param s_model
+ * @return int
+ */
+int el_loc_robust_locate( HYPO_STATE *hyp, const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model )
+{
+	int         result = 0;
+	DL_NODE    *node;
+	PICK_STATE *pick;
+	double      lon0, lat0, depth0, time0;
+	double      scale, _scale;
+
+/* */
+	lon0   = hyp->longitude;
+	lat0   = hyp->latitude;
+	depth0 = hyp->depth;
+	time0  = hyp->origin_time;
+/* The scale of the residuals at the current hypocenter */
+	scale = get_robust_scale( &hyp->pool );
+	for ( int i = 0; i < ROBUST_MAX_REWEIGHT; i++ ) {
+		if ( run_geiger_method( hyp, &lon0, &lat0, &depth0, &time0, scale, p_model, s_model ) < 0 )
+			return -1;
+	/* Update the residuals by the new hypocenter, then re-estimate the scale */
+		if ( get_hypo_velmod( hyp ) )
+			update_picks_state_3D( lon0, lat0, depth0, time0, hyp );
 		else
-			tmp = step_geiger_method( &lon0, &lat0, &depth0, &time0, &hyp->pool, p_model, s_model, NULL );
+			update_picks_state( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
 	/* */
-		if ( tmp < 1.0 )
+		_scale = get_robust_scale( &hyp->pool );
+		if ( fabs(_scale - scale) <= scale * ROBUST_SCALE_TOLERANCE )
 			break;
-	/* Go back to the initial if the result is too far */
-		if ( fabs(time0 - hyp->origin_time) > 60.0 ) {
-			lon0   = hyp->longitude;
-			lat0   = hyp->latitude;
-			depth0 = hyp->depth;
-			time0  = hyp->origin_time;
+		scale = _scale;
+	}
+/* Mask all the outliers which have no weight in the robust solution */
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, pick ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && get_robust_weight( pick->residual, scale, pick->flag ) <= 0.0 ) {
+			EL_MARK_PICK_LOCMASK( pick );
+			hyp->pool.valids--;
+			result++;
 		}
 	}
-/* Something error when doing geiger method */
-	if ( tmp < 0.0 )
+	hyp->stats.robusts++;
+/* Calculate relative parameters one more by new hyp location */
+	time0 += get_pool_residual_avg( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
+	if ( get_hypo_velmod( hyp ) )
+		update_picks_state_3D( lon0, lat0, depth0, time0, hyp );
+	else
+		update_picks_state( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
+/* Update all the parameters to the hypo state */
+	update_hypo_state( lon0, lat0, depth0, time0, hyp );
+#ifdef _DEBUG
+	printf(
+		"earlyloc: Robust locate to: %lf %lf %lf %lf, average error: %lf, masked picks: %d\n",
+		lon0, lat0, depth0, time0, hyp->avg_error, result
+	);
+#endif
+
+	return result;
+}
+
+/**
+ * @brief Relocate the hypo by folding the only one new pick into the normal equations of the last
+ *        solution (rank-one update), then verify it by one linearization at the new hypocenter.
+ *        It returns -1 when it can't be done incrementally, the full locating should be used instead.
+ *
+ * @param hyp
+ * @param pick
+ * @param p_model
+ * @param s_model
+ * @return int
+ */
+int el_loc_incremental_locate(
+	HYPO_STATE *hyp, const PICK_STATE *pick, const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model
+) {
+	int              valids = 0;
+	DL_NODE         *node;
+	PICK_STATE      *_pick;
+	HYPO_NORMAL_EQS *neqs = &hyp->normal;
+	double           lon0, lat0, depth0, time0;
+	double           trv_time, distance, residual, r_weight;
+	double           misfit;
+	double           g_params[HYPO_PARAMS_NUMBER] = { 0.0 };
+	double           normal_b[HYPO_PARAMS_NUMBER];
+	MAT4             normal_n;
+	GEIGER_SYSTEM    sys;
+
+/* The valid picks should be exactly the picks of the last solution plus the new one */
+	if ( !neqs->ready || !pick || !EL_PICK_VALID_LOCATE( pick ) )
 		return -1;
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, _pick ) {
+		if ( EL_PICK_VALID_LOCATE( _pick ) )
+			valids++;
+	}
+	if ( valids != neqs->valids + 1 || get_pickset_hash( &hyp->pool, pick ) != neqs->pickset )
+		return -1;
+/* Warm start from the linearization point of the last solution */
+	lon0   = neqs->longitude;
+	lat0   = neqs->latitude;
+	depth0 = neqs->depth;
+	time0  = neqs->origin_time;
+	if ( get_pick_derivatives( lon0, lat0, depth0, hyp, pick, g_params, &trv_time, &distance, p_model, s_model ) )
+		return -1;
+	residual = pick->observe.picktime - (time0 + trv_time);
+	r_weight = get_r_weight( distance, depth0, residual, pick->observe.weight, pick->flag ) / neqs->weight_norm;
+/* Rank-one update of the normal equations by the new row */
+	memcpy(normal_n.e, neqs->gtwg, sizeof(normal_n.e));
+	memcpy(normal_b, neqs->gtwd, sizeof(normal_b));
+	mat4_rank1( &normal_n, normal_b, g_params, r_weight, residual );
+	mat4_damp( &normal_n, GEIGER_LM_MIN_DAMPING );
+	if ( mat4_solve( g_params, &normal_n, normal_b ) )
+		goto fallback;
+/* The new pick moves the hypo too far, it should be relocated from the beginning */
+	if ( apply_geiger_adjustments( g_params, neqs->delta_x, neqs->delta_y, &lon0, &lat0, &depth0, &time0 ) > INCREMENTAL_MAX_NORM )
+		goto fallback;
+/* Verify the misfit at the new hypocenter, & it will be the next linearization point */
+	init_geiger_system( &sys, valids );
+	if ( get_hypo_velmod( hyp ) )
+		misfit = linearize_geiger_method_3D( &sys, lon0, lat0, depth0, &time0, hyp );
+	else
+		misfit = linearize_geiger_method( &sys, lon0, lat0, depth0, &time0, &hyp->pool, p_model, s_model );
+/* */
+	if ( misfit < 0.0 || misfit > neqs->misfit * INCREMENTAL_MISFIT_JUMP )
+		goto fallback;
+	store_normal_equations( neqs, &sys, get_pickset_hash( &hyp->pool, NULL ), lon0, lat0, depth0, time0 );
+	hyp->stats.incrementals++;
 /* Calculate relative parameters one more by new hyp location */
 	time0 += get_pool_residual_avg( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
-	if ( VelocityModel3DReady )
-		update_picks_state_3D( lon0, lat0, depth0, time0, &hyp->pool );
+	if ( get_hypo_velmod( hyp ) )
+		update_picks_state_3D( lon0, lat0, depth0, time0, hyp );
 	else
 		update_picks_state( lon0, lat0, depth0, time0, &hyp->pool, p_model, s_model );
 /* Update all the parameters to the hypo state */
 	update_hypo_state( lon0, lat0, depth0, time0, hyp );
 #ifdef _DEBUG
-	printf("earlyloc: Primary locate to: %lf %lf %lf %lf, average error: %lf\n", lon0, lat0, depth0, time0, hyp->avg_error );
+	printf(
+		"earlyloc: Incremental locate to: %lf %lf %lf %lf, average error: %lf\n",
+		lon0, lat0, depth0, time0, hyp->avg_error
+	);
 #endif
 
 	return 0;
+/* */
+fallback:
+	EL_HYPO_NORMAL_EQS_RESET( hyp->normal );
+	hyp->stats.fallbacks++;
+
+	return -1;
 }
 
 /*
@@ -149,8 +419,8 @@ int el_loc_primary_locate( HYPO_STATE *hyp, const LAYER_VEL_MODEL *p_model, cons
 void el_loc_all_states_update( HYPO_STATE *hyp, const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model )
 {
 /* Calculate relative parameters one more by new hyp depth */
-	if ( VelocityModel3DReady )
-		update_picks_state_3D( hyp->longitude, hyp->latitude, hyp->depth, hyp->origin_time, &hyp->pool );
+	if ( get_hypo_velmod( hyp ) )
+		update_picks_state_3D( hyp->longitude, hyp->latitude, hyp->depth, hyp->origin_time, hyp );
 	else
 		update_picks_state( hyp->longitude, hyp->latitude, hyp->depth, hyp->origin_time, &hyp->pool, p_model, s_model );
 /* Update all the parameters to the hypo state */
@@ -303,6 +573,9 @@ double el_loc_origintime_adjust( HYPO_STATE *hyp, const LAYER_VEL_MODEL *p_model
 			result  += residual * r_weight;
 		}
 	}
+/* Nothing to adjust when all the picks are weighted out */
+	if ( !(sum_wei > 0.0) )
+		return 0.0;
 /* Recalculate the travel time residual & weight */
 	result /= sum_wei;
 	hyp->origin_time += result;
@@ -341,42 +614,156 @@ double el_loc_residual_estimate( const HYPO_STATE *hyp, const PICK_STATE *pick,
 }
 
 /**
- * @brief
+ * @brief Get the travel time of the phase within the 1D layer velocity model by the epicentral distance
+ *        & the hypocenter depth.
+ *
+ * @param epc_dist
+ * @param hyp_depth
+ * @param phase_name
+ * @param p_model
+ * @param s_model
+ * @return double
+ */
+double el_loc_travel_time(
+	const double epc_dist, const double hyp_depth, const char *phase_name,
+	const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model
+) {
+	LINEAR_RAY_INFO ray_path;
+	double veli = 0.0;
+	double velg = 0.0;
+
+/* */
+	INIT_LINEAR_RAY_INFO( ray_path );
+	SELECT_VEL_PHASE_DEPTH( veli, velg, hyp_depth, phase_name, p_model, s_model );
+/* Using the unit scale, then the distance along the x-axis is exactly the epicentral distance */
+	get_linear_ray( &ray_path, 0.0, 0.0, epc_dist, 0.0, 1.0, 1.0, hyp_depth, veli, velg );
+
+	return ray_path.traveltime;
+}
+
+/**
+ * @brief Start the pool for tracing the picks in parallel within the 3D velocity model, the number of
+ *        threads includes the locating thread itself.
  *
- * @param model_path
+ * @param nthreads
  * @return int
  */
-int el_loc_3dvelmod_load( const char *model_path )
+int el_loc_3dtrace_init( const int nthreads )
 {
-	if ( rt_velmod_load( model_path ) )
+	if ( TracePool || nthreads < 2 )
+		return 0;
+	if ( (TracePool = wp_create( nthreads )) == NULL )
 		return -1;
 
-	VelocityModel3DReady = 1;
+	return wp_threads( TracePool );
+}
 
-	return 0;
+/**
+ * @brief Change the travel time tolerances (in second) of the pseudo-bending, the coarse one is used by
+ *        the trial hypocenters of the Geiger's method & the fine one is used by the final travel times.
+ *        The non-positive one keeps the default. The non-zero cartesian switches both of them to the
+ *        Cartesian bending kernel.
+ *
+ * @param coarse
+ * @param fine
+ * @param cartesian
+ */
+void el_loc_3dtrace_profile( const double coarse, const double fine, const int cartesian )
+{
+	TraceProfiles[0] = rt_profile_coarse;
+	TraceProfiles[1] = rt_profile_fine;
+	if ( coarse > 0.0 )
+		TraceProfiles[0].tolerance = coarse;
+	if ( fine > 0.0 )
+		TraceProfiles[1].tolerance = fine;
+	TraceProfiles[0].cartesian = TraceProfiles[1].cartesian = cartesian;
+/* */
+	TraceProfileCoarse = &TraceProfiles[0];
+	TraceProfileFine   = &TraceProfiles[1];
+
+	return;
 }
 
 /**
  * @brief
  *
  */
-void el_loc_3dvelmod_free( void )
+void el_loc_3dtrace_free( void )
 {
-	if ( VelocityModel3DReady )
-		rt_velmod_free();
+	wp_destroy( TracePool );
+	TracePool = NULL;
 
 	return;
 }
 
-/*
+/**
+ * @brief Release the cached rays of the hypo, it should be called by the hypo's own thread.
  *
+ * @param hyp
  */
-static double step_geiger_method(
-	double *lon0, double *lat0, double *depth0, double *time0, PICKS_POOL *pool,
-	const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model, const double damping_matrix[HYPO_PARAMS_NUMBER]
+void el_loc_ray_cache_free( HYPO_STATE *hyp )
+{
+	tdestroy(hyp->ray_caches, free_ray_cache);
+	hyp->ray_caches = NULL;
+
+	return;
+}
+
+/**
+ * @brief Release the cached rays & the 3D velocity model held by the hypo, it should be called by the
+ *        hypo's own thread at the end of the hypo life.
+ *
+ * @param hyp
+ */
+void el_loc_3dvelmod_release( HYPO_STATE *hyp )
+{
+	el_loc_ray_cache_free( hyp );
+	el_velmod_release( hyp->velmod );
+	hyp->velmod = NULL;
+
+	return;
+}
+
+/**
+ * @brief
+ *
+ * @param sys
+ * @param valids
+ */
+static void init_geiger_system( GEIGER_SYSTEM *sys, const int valids )
+{
+	sys->valids   = valids;
+	sys->delta_x  = 0.0;
+	sys->delta_y  = 0.0;
+	sys->misfit   = 0.0;
+	sys->weight_norm = 1.0;
+	sys->robust_scale = 0.0;
+	mat4_zero( &sys->gtwg );
+	memset(sys->gtwd, 0, sizeof(sys->gtwd));
+
+	return;
+}
+
+/**
+ * @brief Build the linearized system at the input hypocenter. The origin time will be shifted by
+ *        the weighted average residual first, then returns the weighted misfit at there. It returns
+ *        HUGE_VAL without any update when all the picks are weighted out.
+ *
+ * @param sys
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param time0
+ * @param pool
+ * @param p_model
+ * @param s_model
+ * @return double
+ */
+static double linearize_geiger_method(
+	GEIGER_SYSTEM *sys, const double lon0, const double lat0, const double depth0, double *time0, PICKS_POOL *pool,
+	const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model
 ) {
 	int         i;
-	int         valids = 0;
 	DL_NODE    *node;
 	PICK_STATE *pick;
 /* */
@@ -385,93 +772,368 @@ static double step_geiger_method(
 	double veli = 0.0;
 	double velg = 0.0;
 	double residual;
-	double trv_time[pool->totals];
-	double distance[pool->totals];
-	double r_weight[pool->totals];
-	double g_params[HYPO_PARAMS_NUMBER] = { 0.0 };
-/* */
-	MATRIX *matrix_g = NULL, *matrix_d = NULL, *matrix_w = NULL, *matrix_m = NULL;
+/* Origin-relative, so these are able to hold in the kernel's real type */
+	LOC_REAL trv_time[pool->totals];
+	LOC_REAL distance[pool->totals];
+	LOC_REAL r_weight[pool->totals];
+	double   residuals[pool->totals];
+	double   drvts[pool->totals][HYPO_PARAMS_NUMBER];
 /* */
 	LINEAR_RAY_INFO ray_path;
 /* */
-	const double delta_x = el_misc_geog2distf( *lon0 - 0.5, *lat0, *lon0 + 0.5, *lat0 );
-	const double delta_y = el_misc_geog2distf( *lon0, *lat0 - 0.5, *lon0, *lat0 + 0.5 );
+	const double delta_x = el_misc_geog2distf( lon0 - 0.5, lat0, lon0 + 0.5, lat0 );
+	const double delta_y = el_misc_geog2distf( lon0, lat0 - 0.5, lon0, lat0 + 0.5 );
 
-/* Get the valids pick in the pool */
-	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
-		if ( EL_PICK_VALID_LOCATE( pick ) )
-			valids++;
-	}
 /* */
 	INIT_LINEAR_RAY_INFO( ray_path );
-	matrix_g = matrix_new( valids, HYPO_PARAMS_NUMBER );
-	matrix_d = matrix_new( valids, 1 );
-	matrix_w = matrix_new( valids, valids );
-/* */
 	i = 0;
 	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
-		if ( EL_PICK_VALID_LOCATE( pick ) ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && i < sys->valids ) {
 		/* */
-			SELECT_VEL_PHASE_DEPTH( veli, velg, *depth0, pick->observe.phase_name, p_model, s_model );
+			SELECT_VEL_PHASE_DEPTH( veli, velg, depth0, pick->observe.phase_name, p_model, s_model );
 		/* */
 			get_linear_ray(
-				&ray_path, *lon0, *lat0, pick->observe.longitude, pick->observe.latitude, delta_x, delta_y, *depth0, veli, velg
+				&ray_path, lon0, lat0, pick->observe.longitude, pick->observe.latitude, delta_x, delta_y, depth0, veli, velg
 			);
 		/* Assign derived values to picking */
 			distance[i] = ray_path.epc_dist;
 			trv_time[i] = ray_path.traveltime;
-			residual    = pick->observe.picktime - (*time0 + trv_time[i]);
-			r_weight[i] = get_r_weight( distance[i], *depth0, residual, pick->observe.weight, pick->flag );
+			residual    = (pick->observe.picktime - *time0) - trv_time[i];
+			r_weight[i] = get_r_weight( distance[i], depth0, residual, pick->observe.weight, pick->flag ) *
+				get_robust_weight( residual, sys->robust_scale, pick->flag );
+			sum_wei    += r_weight[i];
+			result     += residual * r_weight[i];
 		/* Get the derivatives of T */
-			get_travel_time_derivatives( &ray_path, g_params );
-		/* */
-			if ( !damping_matrix ) {
-				sum_wei += r_weight[i];
-				result  += residual * r_weight[i];
-			}
-			else {
-			/* Apply the damping values */
-				for ( int j = 0; j < HYPO_PARAMS_NUMBER; j++ )
-					g_params[j] *= damping_matrix[j];
-			}
-		/* Assign derived values to matrix */
-			matrix_assign_row( matrix_g, g_params, i + 1, HYPO_PARAMS_NUMBER );
+			get_travel_time_derivatives( &ray_path, drvts[i] );
 			i++;
 		}
 	}
+/* All the picks are weighted out (e.g. by the robust weights), there is no update at this point */
+	if ( !(sum_wei > 0.0) )
+		return sys->misfit = HUGE_VAL;
 /* Recalculate the travel time residual & weight */
-	if ( !damping_matrix ) {
-		result /= sum_wei;
-		*time0 += result;
+	result /= sum_wei;
+	*time0 += result;
+/* */
+	sys->delta_x = delta_x;
+	sys->delta_y = delta_y;
+	sys->misfit  = 0.0;
+	result = 0.0;
+	i = 0;
+	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
+	/* */
+		if ( EL_PICK_VALID_LOCATE( pick ) && i < sys->valids ) {
+		/* */
+			residual = (pick->observe.picktime - *time0) - trv_time[i];
+			r_weight[i] = get_r_weight( distance[i], depth0, residual, pick->observe.weight, pick->flag ) *
+				get_robust_weight( residual, sys->robust_scale, pick->flag );
+		/* */
+			residuals[i] = residual;
+			sys->misfit += get_r_loss(
+				distance[i], depth0, get_robust_residual( residual, sys->robust_scale, pick->flag ), pick->observe.weight, pick->flag
+			);
+			result += r_weight[i];
+			i++;
+		}
+	}
+/* Construct the normal equations with the normalized weights */
+	if ( !(result > 0.0) )
+		return sys->misfit = HUGE_VAL;
+	result /= (double)sys->valids;
+	mat4_zero( &sys->gtwg );
+	memset(sys->gtwd, 0, sizeof(sys->gtwd));
+	for ( i = 0; i < sys->valids; i++ )
+		mat4_rank1( &sys->gtwg, sys->gtwd, drvts[i], r_weight[i] / result, residuals[i] );
+	sys->weight_norm = result;
+/* */
+	sys->misfit /= (double)sys->valids;
+
+	return sys->misfit;
+}
+
+/**
+ * @brief Build the linearized system at the input hypocenter within 3D velocity model. The origin time
+ *        will be shifted by the weighted average residual first, then returns the weighted misfit at there.
+ *        It returns HUGE_VAL without any update when all the picks are weighted out.
+ *
+ * @param sys
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param time0
+ * @param hyp
+ * @return double
+ */
+static double linearize_geiger_method_3D(
+	GEIGER_SYSTEM *sys, const double lon0, const double lat0, const double depth0, double *time0, HYPO_STATE *hyp
+) {
+	int         i;
+	DL_NODE    *node;
+	PICK_STATE *pick;
+	PICKS_POOL *pool = &hyp->pool;
+	TRACE_BATCH batch;
+/* */
+	double     result  = 0.0;
+	double     sum_wei = 0.0;
+	double     residual;
+	double     _x, _y;
+	double     trv_time[pool->totals];
+	double     distance[pool->totals];
+	double     r_weight[pool->totals];
+	double     residuals[pool->totals];
+	TRACE_TASK tasks[pool->totals];
+/* */
+	const double delta_x = el_misc_geog2distf( lon0 - 0.5, lat0, lon0 + 0.5, lat0 );
+	const double delta_y = el_misc_geog2distf( lon0, lat0 - 0.5, lon0, lat0 + 0.5 );
+
+/* Get the travel time & the derivatives of T of all the valid picks at once */
+	i = 0;
+	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && i < sys->valids )
+			tasks[i++].pick = pick;
 	}
+	batch.lon0        = lon0;
+	batch.lat0        = lat0;
+	batch.depth0      = depth0;
+	batch.delta_x     = delta_x;
+	batch.delta_y     = delta_y;
+	batch.derivatives = 1;
+	batch.profile     = TraceProfileCoarse;
+	batch.ntasks      = i;
+	batch.tasks       = tasks;
+	if ( trace_picks_3D( hyp, &batch ) )
+		return GEIGER_ERROR_RETURN;
 /* */
+	for ( i = 0; i < batch.ntasks; i++ ) {
+		const PICK_STATE *_pick = tasks[i].pick;
+	/* */
+		trv_time[i] = tasks[i].trv_time;
+		_x = (_pick->observe.longitude - lon0) * delta_x;
+		_y = (_pick->observe.latitude - lat0) * delta_y;
+	/* Assign derived values to picking */
+		residual    = _pick->observe.picktime - (*time0 + trv_time[i]);
+		distance[i] = sqrt(_x * _x + _y * _y + EARLYLOC_EPSILON);
+		r_weight[i] = get_r_weight( distance[i], depth0, residual, _pick->observe.weight, _pick->flag ) *
+			get_robust_weight( residual, sys->robust_scale, _pick->flag );
+		sum_wei    += r_weight[i];
+		result     += residual * r_weight[i];
+	}
+/* All the picks are weighted out (e.g. by the robust weights), there is no update at this point */
+	if ( !(sum_wei > 0.0) )
+		return sys->misfit = HUGE_VAL;
+/* Recalculate the travel time residual & weight */
+	result /= sum_wei;
+	*time0 += result;
+/* */
+	sys->delta_x = delta_x;
+	sys->delta_y = delta_y;
+	sys->misfit  = 0.0;
 	result = 0.0;
 	i = 0;
 	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
 	/* */
-		if ( EL_PICK_VALID_LOCATE( pick ) ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && i < sys->valids ) {
 		/* */
 			residual = pick->observe.picktime - (*time0 + trv_time[i]);
-			r_weight[i] = get_r_weight( distance[i], *depth0, residual, pick->observe.weight, pick->flag );
+			r_weight[i] = get_r_weight( distance[i], depth0, residual, pick->observe.weight, pick->flag ) *
+				get_robust_weight( residual, sys->robust_scale, pick->flag );
 		/* */
-			matrix_assign( matrix_d, residual, i + 1, 1 );
+			residuals[i] = residual;
+			sys->misfit += get_r_loss(
+				distance[i], depth0, get_robust_residual( residual, sys->robust_scale, pick->flag ), pick->observe.weight, pick->flag
+			);
 			result += r_weight[i];
 			i++;
 		}
 	}
-/* Construct the weighting matrix */
-	result /= (double)valids;
-	for ( i = 0; i < valids; i++ )
-		matrix_assign( matrix_w, r_weight[i] / result, i + 1, i + 1);
-/* Go through the least square procedure & get the adjustments */
-	matrix_m = matrix_div_weighted( matrix_d, matrix_g, matrix_w );
-	matrix_extract_seq( matrix_m, g_params, HYPO_PARAMS_NUMBER );
-	*lon0   += g_params[0] / delta_x;
-	*lat0   += g_params[1] / delta_y;
-	*depth0 += g_params[2];
-	*time0  += g_params[3];
+/* Construct the normal equations with the normalized weights */
+	if ( !(result > 0.0) )
+		return sys->misfit = HUGE_VAL;
+	result /= (double)sys->valids;
+	mat4_zero( &sys->gtwg );
+	memset(sys->gtwd, 0, sizeof(sys->gtwd));
+	for ( i = 0; i < sys->valids; i++ )
+		mat4_rank1( &sys->gtwg, sys->gtwd, tasks[i].derivatives, r_weight[i] / result, residuals[i] );
+	sys->weight_norm = result;
 /* */
-	result = fabs(g_params[0]) + fabs(g_params[1]);
+	sys->misfit /= (double)sys->valids;
+
+	return sys->misfit;
+}
+
+/**
+ * @brief The damped Geiger's method with the trust-region step control, it starts from the input
+ *        hypocenter & returns the number of linearizations, or -1 when something error.
+ *
+ * @param hyp
+ * @param _lon0
+ * @param _lat0
+ * @param _depth0
+ * @param _time0
+ * @param robust_scale
+ * @param p_model
+ * @param s_model
+ * @return int
+ */
+static int run_geiger_method(
+	HYPO_STATE *hyp, double *_lon0, double *_lat0, double *_depth0, double *_time0, const double robust_scale,
+	const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model
+) {
+	int           i;
+	int           iters  = 0;
+	int           valids = 0;
+	DL_NODE      *node;
+	PICK_STATE   *pick;
+	double        lon0, lat0, depth0, time0;
+	double        lon1, lat1, depth1, time1;
+	double        misfit0, misfit1;
+	double        norm;
+	double        damping = GEIGER_LM_INIT_DAMPING;
+	GEIGER_SYSTEM sys[2];
+	GEIGER_SYSTEM *sys0 = &sys[0];
+	GEIGER_SYSTEM *sys1 = &sys[1];
+
+/* */
+	lon0   = *_lon0;
+	lat0   = *_lat0;
+	depth0 = *_depth0;
+	time0  = *_time0;
+/* Get the valids pick in the pool */
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, pick ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) )
+			valids++;
+	}
+/* */
+	init_geiger_system( sys0, valids );
+	init_geiger_system( sys1, valids );
+	sys0->robust_scale = sys1->robust_scale = robust_scale;
+
+/* Linearize at the initial hypocenter */
+	if ( get_hypo_velmod( hyp ) )
+		misfit0 = linearize_geiger_method_3D( sys0, lon0, lat0, depth0, &time0, hyp );
+	else
+		misfit0 = linearize_geiger_method( sys0, lon0, lat0, depth0, &time0, &hyp->pool, p_model, s_model );
+	iters++;
+/* No usable weight at the initial hypocenter, it can't be located */
+	if ( isinf(misfit0) )
+		misfit0 = GEIGER_ERROR_RETURN;
+/* Then, the damped Geiger's method with the trust-region step control */
+	for ( i = 0; misfit0 >= 0.0 && i < GEIGER_MAX_ITERATION; i++ ) {
+		lon1   = lon0;
+		lat1   = lat0;
+		depth1 = depth0;
+		time1  = time0;
+		norm   = step_geiger_method( sys0, &lon1, &lat1, &depth1, &time1, damping );
+	/* Reject the step which drifts too far away, then it will go back with heavier damping */
+		if ( fabs(time1 - hyp->origin_time) > GEIGER_MAX_TIME_DRIFT ) {
+			misfit1 = HUGE_VAL;
+		}
+		else {
+			if ( get_hypo_velmod( hyp ) )
+				misfit1 = linearize_geiger_method_3D( sys1, lon1, lat1, depth1, &time1, hyp );
+			else
+				misfit1 = linearize_geiger_method( sys1, lon1, lat1, depth1, &time1, &hyp->pool, p_model, s_model );
+			iters++;
+		/* Something error when doing ray tracing */
+			if ( misfit1 < 0.0 ) {
+				misfit0 = GEIGER_ERROR_RETURN;
+				break;
+			}
+		}
+	/* Accept the step only when the weighted misfit decreased */
+		if ( misfit1 <= misfit0 ) {
+			lon0   = lon1;
+			lat0   = lat1;
+			depth0 = depth1;
+			time0  = time1;
+		/* Swap the linearized systems, the trial one is the current one now */
+			sys0 = sys0 == &sys[0] ? &sys[1] : &sys[0];
+			sys1 = sys1 == &sys[0] ? &sys[1] : &sys[0];
+		/* Converged on the model norm or the relative change of misfit */
+			if ( norm < GEIGER_CONVERGE_NORM || (misfit0 - misfit1) <= misfit0 * GEIGER_CONVERGE_MISFIT ) {
+				misfit0 = misfit1;
+				break;
+			}
+			misfit0 = misfit1;
+			if ( (damping *= GEIGER_LM_DEC_FACTOR) < GEIGER_LM_MIN_DAMPING )
+				damping = GEIGER_LM_MIN_DAMPING;
+		}
+		else if ( (damping *= GEIGER_LM_INC_FACTOR) > GEIGER_LM_MAX_DAMPING ) {
+		/* The step can't be reduced any more, it should be the local minimum already */
+			break;
+		}
+	}
+/* Keep the normal equations of the final solution for the incremental relocating */
+	if ( misfit0 >= 0.0 && robust_scale <= 0.0 )
+		store_normal_equations( &hyp->normal, sys0, get_pickset_hash( &hyp->pool, NULL ), lon0, lat0, depth0, time0 );
+	else
+		EL_HYPO_NORMAL_EQS_RESET( hyp->normal );
+/* */
+	hyp->stats.locates++;
+	hyp->stats.iterations += iters;
+	hyp->stats.last_iters  = iters;
+/* Something error when doing geiger method */
+	if ( misfit0 < 0.0 )
+		return -1;
+/* */
+	*_lon0   = lon0;
+	*_lat0   = lat0;
+	*_depth0 = depth0;
+	*_time0  = time0;
+
+	return iters;
+}
+
+/**
+ * @brief Solve the damped least square problem of the linearized system & apply the adjustments
+ *        to the hypocenter, then returns the norm of the spatial adjustments (in km).
+ *
+ * @param sys
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param time0
+ * @param damping
+ * @return double
+ */
+static double step_geiger_method(
+	const GEIGER_SYSTEM *sys, double *lon0, double *lat0, double *depth0, double *time0, const double damping
+) {
+	double g_params[HYPO_PARAMS_NUMBER] = { 0.0 };
+	MAT4   gtwg = sys->gtwg;
+
+/* Go through the least square procedure & get the adjustments, it won't move when the system is singular */
+	mat4_damp( &gtwg, damping );
+	mat4_solve( g_params, &gtwg, sys->gtwd );
+
+	return apply_geiger_adjustments( g_params, sys->delta_x, sys->delta_y, lon0, lat0, depth0, time0 );
+}
+
+/**
+ * @brief Apply the adjustments to the hypocenter, then returns the norm of the spatial adjustments (in km).
+ *
+ * @param adjustments
+ * @param delta_x
+ * @param delta_y
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param time0
+ * @return double
+ */
+static double apply_geiger_adjustments(
+	const double adjustments[HYPO_PARAMS_NUMBER], const double delta_x, const double delta_y,
+	double *lon0, double *lat0, double *depth0, double *time0
+) {
+	const double result = sqrt(
+		adjustments[0] * adjustments[0] + adjustments[1] * adjustments[1] + adjustments[2] * adjustments[2]
+	);
+
+/* */
+	*lon0   += adjustments[0] / delta_x;
+	*lat0   += adjustments[1] / delta_y;
+	*depth0 += adjustments[2];
+	*time0  += adjustments[3];
 /* Avoid the air quake & keep it always deeper than 5 km & less than 100 km */
 	if ( *depth0 < 0.0 )
 		*depth0 = fabs(*depth0);
@@ -479,130 +1141,147 @@ static double step_geiger_method(
 		*depth0 = MIN_HYPO_DEPTH + EARLYLOC_EPSILON;
 	else if ( *depth0 > MAX_HYPO_DEPTH )
 		*depth0 = MAX_HYPO_DEPTH - EARLYLOC_EPSILON;
-/* */
-	matrix_free( matrix_g );
-	matrix_free( matrix_d );
-	matrix_free( matrix_w );
-	matrix_free( matrix_m );
 
 	return result;
 }
 
-/*
+/**
+ * @brief Compute the normal equations (GtWG & GtWd) of the linearized system & keep them with the
+ *        linearization point.
+ *
+ * @param neqs
+ * @param sys
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param time0
+ */
+static void store_normal_equations(
+	HYPO_NORMAL_EQS *neqs, const GEIGER_SYSTEM *sys, const uint64_t pickset,
+	const double lon0, const double lat0, const double depth0, const double time0
+) {
+/* */
+	memcpy(neqs->gtwg, sys->gtwg.e, sizeof(sys->gtwg.e));
+	memcpy(neqs->gtwd, sys->gtwd, sizeof(sys->gtwd));
+/* */
+	neqs->ready       = 1;
+	neqs->valids      = sys->valids;
+	neqs->pickset     = pickset;
+	neqs->misfit      = sys->misfit;
+	neqs->weight_norm = sys->weight_norm;
+	neqs->delta_x     = sys->delta_x;
+	neqs->delta_y     = sys->delta_y;
+	neqs->longitude   = lon0;
+	neqs->latitude    = lat0;
+	neqs->depth       = depth0;
+	neqs->origin_time = time0;
+
+	return;
+}
+
+/**
+ * @brief Hash the identities of all the valid picks within the pool except the excluded one, the hashes of
+ *        the picks are summed so it doesn't depend on the order of the pool.
  *
+ * @param pool
+ * @param exclude
+ * @return uint64_t
  */
-static double step_geiger_method_3D( double *lon0, double *lat0, double *depth0, double *time0, PICKS_POOL *pool, const double damping_matrix[HYPO_PARAMS_NUMBER] )
+static uint64_t get_pickset_hash( const PICKS_POOL *pool, const PICK_STATE *exclude )
 {
-	int         i;
-	int         valids = 0;
 	DL_NODE    *node;
 	PICK_STATE *pick;
+	uint64_t    result = 0;
+
 /* */
-	double result  = 0.0;
-	double sum_wei = 0.0;
-	double residual;
+	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
+		if ( pick != exclude && EL_PICK_VALID_LOCATE( pick ) )
+			result += get_pick_hash( pick );
+	}
+
+	return result;
+}
+
+/**
+ * @brief FNV-1a hash of the SCNL, phase & pick time, then mixed by the finalizer of SplitMix64.
+ *
+ * @param pick
+ * @return uint64_t
+ */
+static uint64_t get_pick_hash( const PICK_STATE *pick )
+{
+	const char *fields[] = {
+		pick->observe.station, pick->observe.channel, pick->observe.network, pick->observe.location, pick->observe.phase_name
+	};
+	uint64_t result = 0xcbf29ce484222325ULL;
+	uint64_t bits;
+
+/* */
+	for ( size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++ ) {
+		for ( const char *c = fields[i]; *c; c++ )
+			result = (result ^ (uint8_t)*c) * 0x100000001b3ULL;
+		result = (result ^ 0xff) * 0x100000001b3ULL;
+	}
+	memcpy(&bits, &pick->observe.picktime, sizeof(bits));
+	result ^= bits;
+/* */
+	result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	result = (result ^ (result >> 27)) * 0x94d049bb133111ebULL;
+
+	return result ^ (result >> 31);
+}
+
+/**
+ * @brief Get the travel time, the epicentral distance & the derivatives of T for single pick.
+ *
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param hyp
+ * @param pick
+ * @param derivatives
+ * @param trv_time
+ * @param distance
+ * @param p_model
+ * @param s_model
+ * @return int
+ */
+static int get_pick_derivatives(
+	const double lon0, const double lat0, const double depth0, HYPO_STATE *hyp, const PICK_STATE *pick,
+	double derivatives[HYPO_PARAMS_NUMBER], double *trv_time, double *distance,
+	const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model
+) {
 	double _x, _y;
-	double trv_time[pool->totals];
-	double distance[pool->totals];
-	double r_weight[pool->totals];
-	double g_params[HYPO_PARAMS_NUMBER] = { 0.0 };
-/* */
-	MATRIX *matrix_g = NULL, *matrix_d = NULL, *matrix_w = NULL, *matrix_m = NULL;
+	double veli = 0.0;
+	double velg = 0.0;
 /* */
-	RAY_INFO ray_path[RT_MAX_NODE + 1];
-	int      np;
+	LINEAR_RAY_INFO ray_path;
 /* */
-	const double delta_x = el_misc_geog2distf( *lon0 - 0.5, *lat0, *lon0 + 0.5, *lat0 );
-	const double delta_y = el_misc_geog2distf( *lon0, *lat0 - 0.5, *lon0, *lat0 + 0.5 );
+	const double delta_x = el_misc_geog2distf( lon0 - 0.5, lat0, lon0 + 0.5, lat0 );
+	const double delta_y = el_misc_geog2distf( lon0, lat0 - 0.5, lon0, lat0 + 0.5 );
 
-/* Get the valids pick in the pool */
-	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
-		if ( EL_PICK_VALID_LOCATE( pick ) )
-			valids++;
-	}
 /* */
-	matrix_g = matrix_new( valids, HYPO_PARAMS_NUMBER );
-	matrix_d = matrix_new( valids, 1 );
-	matrix_w = matrix_new( valids, valids );
-/* */
-	i = 0;
-	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
-		if ( EL_PICK_VALID_LOCATE( pick ) ) {
-		/* Do the ray tracing & get the travel time */
-			if (
-				rt_main(
-					ray_path, &np, &trv_time[i], *lat0, *lon0, *depth0, pick->observe.latitude, pick->observe.longitude, pick->observe.elevation,
-					!strcmp(pick->observe.phase_name, "S") ? RT_S_WAVE_VELOCITY : RT_P_WAVE_VELOCITY
-				)
-			) {
-				return GEIGER_ERROR_RETURN;
-			}
-		/* */
-			_x = (pick->observe.longitude - *lon0) * delta_x;
-			_y = (pick->observe.latitude - *lat0) * delta_y;
-		/* Assign derived values to picking */
-			residual    = pick->observe.picktime - (*time0 + trv_time[i]);
-			distance[i] = sqrt(_x * _x + _y * _y + EARLYLOC_EPSILON);
-			r_weight[i] = get_r_weight( distance[i], *depth0, residual, pick->observe.weight, pick->flag );
-			sum_wei    += r_weight[i];
-			result     += residual * r_weight[i];
-		/* Get the derivatives of T */
-			get_travel_time_derivatives_3D( ray_path, np, g_params );
-		/* Apply the damping values */
-			if ( damping_matrix )
-				for ( int j = 0; j < HYPO_PARAMS_NUMBER; j++ )
-					g_params[j] *= damping_matrix[j];
-		/* Assign derived values to matrix */
-			matrix_assign_row( matrix_g, g_params, i + 1, HYPO_PARAMS_NUMBER );
-			i++;
-		}
+	if ( get_hypo_velmod( hyp ) ) {
+		if ( get_travel_time_3D( lon0, lat0, depth0, delta_x, delta_y, hyp, pick, trv_time, derivatives ) )
+			return -1;
+	/* */
+		_x = (pick->observe.longitude - lon0) * delta_x;
+		_y = (pick->observe.latitude - lat0) * delta_y;
+		*distance = sqrt(_x * _x + _y * _y + EARLYLOC_EPSILON);
 	}
-/* Recalculate the travel time residual & weight */
-	result /= sum_wei;
-	*time0 += result;
-/* */
-	result = 0.0;
-	i = 0;
-	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
+	else {
+		INIT_LINEAR_RAY_INFO( ray_path );
+		SELECT_VEL_PHASE_DEPTH( veli, velg, depth0, pick->observe.phase_name, p_model, s_model );
+		get_linear_ray(
+			&ray_path, lon0, lat0, pick->observe.longitude, pick->observe.latitude, delta_x, delta_y, depth0, veli, velg
+		);
 	/* */
-		if ( EL_PICK_VALID_LOCATE( pick ) ) {
-		/* */
-			residual = pick->observe.picktime - (*time0 + trv_time[i]);
-			r_weight[i] = get_r_weight( distance[i], *depth0, residual, pick->observe.weight, pick->flag );
-		/* */
-			matrix_assign( matrix_d, residual, i + 1, 1 );
-			result += r_weight[i];
-			i++;
-		}
+		*trv_time = ray_path.traveltime;
+		*distance = ray_path.epc_dist;
+		get_travel_time_derivatives( &ray_path, derivatives );
 	}
-/* Construct the weighting matrix */
-	result /= (double)valids;
-	for ( i = 0; i < valids; i++ )
-		matrix_assign( matrix_w, r_weight[i] / result, i + 1, i + 1);
-/* Go through the least square procedure & get the adjustments */
-	matrix_m = matrix_div_weighted( matrix_d, matrix_g, matrix_w );
-	matrix_extract_seq( matrix_m, g_params, HYPO_PARAMS_NUMBER );
-	*lon0   += g_params[0] / delta_x;
-	*lat0   += g_params[1] / delta_y;
-	*depth0 += g_params[2];
-	*time0  += g_params[3];
-/* */
-	for ( i = 0, result = 0.0; i < HYPO_PARAMS_NUMBER; i++ )
-		result += fabs(g_params[i]);
-/* Avoid the air quake & keep it always deeper than 5 km & less than 100 km */
-	if ( *depth0 < 0.0 )
-		*depth0 = fabs(*depth0);
-	if ( *depth0 < MIN_HYPO_DEPTH )
-		*depth0 = MIN_HYPO_DEPTH + EARLYLOC_EPSILON;
-	else if ( *depth0 > MAX_HYPO_DEPTH )
-		*depth0 = MAX_HYPO_DEPTH - EARLYLOC_EPSILON;
-/* */
-	matrix_free( matrix_g );
-	matrix_free( matrix_d );
-	matrix_free( matrix_w );
-	matrix_free( matrix_m );
 
-	return result;
+	return 0;
 }
 
 /*
@@ -614,7 +1293,6 @@ static double step_geiger_method_tdiff(
 ) {
 	int         i;
 	int         valids = 0;
-	int         npairs = 0;
 	DL_NODE    *node;
 	PICK_STATE *pick;
 /* */
@@ -624,13 +1302,14 @@ static double step_geiger_method_tdiff(
 	double residual[pool->totals];
 	double r_weight[pool->totals];
 	double drvts[pool->totals][HYPO_PARAMS_NUMBER];
-	double g_params[HYPO_PARAMS_NUMBER];
-/* */
-	MATRIX *matrix_g = NULL, *matrix_d = NULL, *matrix_w = NULL, *matrix_m = NULL;
+	double g_params[HYPO_PARAMS_NUMBER] = { 0.0 };
+	double p_params[HYPO_PARAMS_NUMBER - 1];
+/* Only the spatial parameters, the origin time is cancelled by the differences */
+	MAT3   normal_n;
+	double normal_b[HYPO_PARAMS_NUMBER - 1] = { 0.0 };
 /* */
 	LINEAR_RAY_INFO ray_path;
 /* */
-	const int    params_num = HYPO_PARAMS_NUMBER - 1;
 	const double delta_x = el_misc_geog2distf( *lon0 - 0.5, *lat0, *lon0 + 0.5, *lat0 );
 	const double delta_y = el_misc_geog2distf( *lon0, *lat0 - 0.5, *lon0, *lat0 + 0.5 );
 
@@ -639,17 +1318,9 @@ static double step_geiger_method_tdiff(
 		if ( EL_PICK_VALID_LOCATE( pick ) )
 			valids++;
 	}
-/* */
-	for ( int j = 0; j < valids; j++ )
-		for ( int k = j + 1; k < valids; k++ )
-			npairs++;
 /* */
 	INIT_LINEAR_RAY_INFO( ray_path );
-	matrix_g = matrix_new( npairs, params_num );
-	matrix_d = matrix_new( npairs, 1 );
-	if ( use_weight )
-		matrix_w = matrix_new( npairs, npairs );
-/* */
+	mat3_zero( &normal_n );
 	i = 0;
 	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
 		if ( EL_PICK_VALID_LOCATE( pick ) ) {
@@ -675,26 +1346,21 @@ static double step_geiger_method_tdiff(
 		result /= valids;
 		result *= result;
 	}
-	i = 0;
 	for ( int j = 0; j < valids; j++ ) {
 		for ( int k = j + 1; k < valids; k++ ) {
-			g_params[0] = drvts[j][0] - drvts[k][0];
-			g_params[1] = drvts[j][1] - drvts[k][1];
-			g_params[2] = drvts[j][2] - drvts[k][2];
-		/* Assign derived values to matrix */
-			matrix_assign_row( matrix_g, g_params, i + 1, params_num );
-			matrix_assign( matrix_d, residual[j] - residual[k], i + 1, 1 );
-			if ( use_weight )
-				matrix_assign( matrix_w, (r_weight[j] * r_weight[k]) / result, i + 1, i + 1 );
-			i++;
+			p_params[0] = drvts[j][0] - drvts[k][0];
+			p_params[1] = drvts[j][1] - drvts[k][1];
+			p_params[2] = drvts[j][2] - drvts[k][2];
+		/* Accumulate the pair into the normal equations */
+			mat3_rank1(
+				&normal_n, normal_b, p_params,
+				use_weight ? (r_weight[j] * r_weight[k]) / result : 1.0, residual[j] - residual[k]
+			);
 		}
 	}
-/* Go through the least square procedure & get the adjustments */
-	if ( use_weight )
-		matrix_m = matrix_div_weighted( matrix_d, matrix_g, matrix_w );
-	else
-		matrix_m = matrix_div( matrix_d, matrix_g );
-	matrix_extract_seq( matrix_m, g_params, params_num );
+/* Go through the least square procedure & get the adjustments, it won't move when the system is singular */
+	mat3_damp( &normal_n, 0.0 );
+	mat3_solve( g_params, &normal_n, normal_b );
 	*lon0   += g_params[0] / delta_x;
 	*lat0   += g_params[1] / delta_y;
 	*depth0 += g_params[2];
@@ -710,12 +1376,6 @@ static double step_geiger_method_tdiff(
 		*depth0 = MIN_HYPO_DEPTH + EARLYLOC_EPSILON;
 	else if ( *depth0 > MAX_HYPO_DEPTH )
 		*depth0 = MAX_HYPO_DEPTH - EARLYLOC_EPSILON;
-/* */
-	matrix_free( matrix_g );
-	matrix_free( matrix_d );
-	matrix_free( matrix_m );
-	if ( use_weight )
-		matrix_free( matrix_w );
 
 	return result;
 }
@@ -770,27 +1430,45 @@ static void update_picks_state(
  * @param lat0
  * @param depth0
  * @param time0
- * @param pool
+ * @param hyp
  */
-static void update_picks_state_3D( const double lon0, const double lat0, const double depth0, const double time0, PICKS_POOL *pool )
+static void update_picks_state_3D( const double lon0, const double lat0, const double depth0, const double time0, HYPO_STATE *hyp )
 {
-	RAY_INFO    ray_path[RT_MAX_NODE + 1];
-	int         np;
+	int         i;
 	double      _x;
 	double      _y;
 	DL_NODE    *node;
 	PICK_STATE *pick;
+	TRACE_BATCH batch;
+	TRACE_TASK  tasks[hyp->pool.totals];
 /* */
 	const double delta_x = el_misc_geog2distf( lon0 - 0.5, lat0, lon0 + 0.5, lat0 );
 	const double delta_y = el_misc_geog2distf( lon0, lat0 - 0.5, lon0, lat0 + 0.5 );
 
 /* */
-	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
-	/* */
-		rt_main(
-			ray_path, &np, &pick->trv_time, lat0, lon0, depth0, pick->observe.latitude, pick->observe.longitude, pick->observe.elevation,
-			!strcmp(pick->observe.phase_name, "S") ? RT_S_WAVE_VELOCITY : RT_P_WAVE_VELOCITY
-		);
+	i = 0;
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, pick ) {
+		if ( i < hyp->pool.totals )
+			tasks[i++].pick = pick;
+	}
+	batch.lon0        = lon0;
+	batch.lat0        = lat0;
+	batch.depth0      = depth0;
+	batch.delta_x     = delta_x;
+	batch.delta_y     = delta_y;
+	batch.derivatives = 0;
+	batch.profile     = TraceProfileFine;
+	batch.ntasks      = i;
+	batch.tasks       = tasks;
+	trace_picks_3D( hyp, &batch );
+/* */
+	i = 0;
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, pick ) {
+		if ( i >= batch.ntasks )
+			break;
+	/* Keep the last travel time when failed */
+		if ( tasks[i++].result != -1 )
+			pick->trv_time = tasks[i - 1].trv_time;
 	/* */
 		_x = (pick->observe.longitude - lon0) * delta_x;
 		_y = (pick->observe.latitude - lat0) * delta_y;
@@ -872,21 +1550,25 @@ static LINEAR_RAY_INFO *get_linear_ray(
 ) {
 	dest->epc_dist_x = (sta_lon - epc_lon) * delta_x;
 	dest->epc_dist_y = (sta_lat - epc_lat) * delta_y;
-	dest->epc_dist   = sqrt(dest->epc_dist_x * dest->epc_dist_x + dest->epc_dist_y * dest->epc_dist_y + EARLYLOC_EPSILON);
+	dest->epc_dist   = sqrt(dest->epc_dist_x * dest->epc_dist_x + dest->epc_dist_y * dest->epc_dist_y + LOC_REAL_C(EARLYLOC_EPSILON));
 	dest->hyp_depth  = hyp_depth;
 	dest->vel_init   = veli;
 	dest->vel_grad   = velg;
 
-	dest->center_z = -veli / velg;
-	dest->center_x = (dest->epc_dist * dest->epc_dist + 2.0 * dest->center_z * hyp_depth - hyp_depth * hyp_depth) / (2. * dest->epc_dist);
-	dest->angle_a  = atan((hyp_depth - dest->center_z) / dest->center_x);
+	dest->center_z = -dest->vel_init / dest->vel_grad;
+	dest->center_x =
+		(dest->epc_dist * dest->epc_dist + LOC_REAL_C(2.0) * dest->center_z * dest->hyp_depth - dest->hyp_depth * dest->hyp_depth) /
+		(LOC_REAL_C(2.0) * dest->epc_dist);
+	dest->angle_a  = atan((dest->hyp_depth - dest->center_z) / dest->center_x);
 	dest->angle_b  = atan(-dest->center_z / (dest->epc_dist - dest->center_x));
 /* */
-	if ( dest->angle_a < 0.0 )
-		dest->angle_a += EARLYLOC_PI;
-	dest->angle_a = EARLYLOC_PI - dest->angle_a;
+	if ( dest->angle_a < LOC_REAL_C(0.0) )
+		dest->angle_a += LOC_REAL_C(EARLYLOC_PI);
+	dest->angle_a = LOC_REAL_C(EARLYLOC_PI) - dest->angle_a;
 /* */
-	dest->traveltime = (-1.0 / dest->vel_grad) * log(fabs(tan(dest->angle_b * 0.5) / tan(dest->angle_a * 0.5)));
+	dest->traveltime =
+		(LOC_REAL_C(-1.0) / dest->vel_grad) *
+		log(fabs(tan(dest->angle_b * LOC_REAL_C(0.5)) / tan(dest->angle_a * LOC_REAL_C(0.5))));
 
 	return dest;
 }
@@ -900,13 +1582,13 @@ static LINEAR_RAY_INFO *get_linear_ray(
  */
 static double *get_travel_time_derivatives( const LINEAR_RAY_INFO *ray_path, double derivatives[HYPO_PARAMS_NUMBER] )
 {
-	double tmp1 = ray_path->vel_init + ray_path->vel_grad * ray_path->hyp_depth;
-	double tmp2 = -sin(ray_path->angle_a) / (tmp1 * ray_path->epc_dist);
+	const LOC_REAL tmp1 = ray_path->vel_init + ray_path->vel_grad * ray_path->hyp_depth;
+	const LOC_REAL tmp2 = -sin(ray_path->angle_a) / (tmp1 * ray_path->epc_dist);
 
 /* Spatial derivative of T */
 	derivatives[0] = tmp2 * ray_path->epc_dist_x;
 	derivatives[1] = tmp2 * ray_path->epc_dist_y;
-	derivatives[2] = -cos(ray_path->angle_a) / tmp1;
+	derivatives[2] = cos(ray_path->angle_a) / tmp1;
 	derivatives[3] = 1.0;
 
 	return derivatives;
@@ -931,6 +1613,162 @@ static double *get_travel_time_derivatives_3D(
 	return derivatives;
 }
 
+/**
+ * @brief Get the travel time & its derivatives of single pick within 3D velocity model. It is the
+ *        batch of single task, see trace_picks_3D. Since it is only used for the step of the incremental
+ *        relocating, it is traced by the coarse profile.
+ *
+ * @param lon0
+ * @param lat0
+ * @param depth0
+ * @param delta_x
+ * @param delta_y
+ * @param hyp
+ * @param pick
+ * @param trv_time
+ * @param derivatives could be NULL when only the travel time is needed
+ * @return int
+ */
+static int get_travel_time_3D(
+	const double lon0, const double lat0, const double depth0, const double delta_x, const double delta_y,
+	HYPO_STATE *hyp, const PICK_STATE *pick, double *trv_time, double derivatives[HYPO_PARAMS_NUMBER]
+) {
+	TRACE_TASK  task;
+	TRACE_BATCH batch;
+
+/* */
+	task.pick         = pick;
+	batch.lon0        = lon0;
+	batch.lat0        = lat0;
+	batch.depth0      = depth0;
+	batch.delta_x     = delta_x;
+	batch.delta_y     = delta_y;
+	batch.derivatives = derivatives != NULL;
+	batch.profile     = TraceProfileCoarse;
+	batch.ntasks      = 1;
+	batch.tasks       = &task;
+	if ( trace_picks_3D( hyp, &batch ) )
+		return -1;
+/* */
+	*trv_time = task.trv_time;
+	if ( derivatives )
+		memcpy(derivatives, task.derivatives, sizeof(double) * HYPO_PARAMS_NUMBER);
+
+	return 0;
+}
+
+/**
+ * @brief Get the travel times (& the derivatives) of the batch of picks at the same hypocenter. The
+ *        picks are traced in parallel by the pool when it is enabled; the ray caches are fetched &
+ *        the statistics are summed serially in the order of the picks, so the result doesn't depend
+ *        on the number of threads. It returns -1 when any of the picks failed.
+ *
+ * @param hyp
+ * @param batch
+ * @return int
+ */
+static int trace_picks_3D( HYPO_STATE *hyp, TRACE_BATCH *batch )
+{
+	int         result = 0;
+	TRACE_TASK *task;
+
+/* */
+	if ( (batch->model = get_hypo_velmod( hyp )) == NULL )
+		return -1;
+/* The picks of the same station & phase can't share one cache at the same time, only the first one uses it */
+	for ( int i = 0; i < batch->ntasks; i++ ) {
+		task = batch->tasks + i;
+		if ( (task->cache = get_ray_cache( hyp, task->pick )) ) {
+			for ( int j = 0; j < i; j++ ) {
+				if ( batch->tasks[j].cache == task->cache ) {
+					task->cache = NULL;
+					break;
+				}
+			}
+		}
+	}
+/* */
+	wp_run( TracePool, trace_pick_task, batch, batch->ntasks );
+/* */
+	for ( int i = 0; i < batch->ntasks; i++ ) {
+		task = batch->tasks + i;
+		switch ( task->result ) {
+		case RT_RAY_CACHE_HIT:
+			hyp->stats.ray_hits++;
+			break;
+		case RT_RAY_CACHE_WARM:
+			hyp->stats.ray_warms++;
+			hyp->stats.ray_warm_iters += task->info.iterations;
+			hyp->stats.ray_segments   += task->info.segments;
+			break;
+		case RT_RAY_CACHE_COLD:
+		case TRACE_RESULT_NOCACHE:
+			hyp->stats.ray_colds++;
+			hyp->stats.ray_cold_iters += task->info.iterations;
+			hyp->stats.ray_segments   += task->info.segments;
+			break;
+		case TRACE_RESULT_TABLE:
+			break;
+		default:
+			result = -1;
+			break;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Get the travel time of single pick, it will be interpolated from the station's travel time table
+ *        when it is ready, otherwise traced by the pseudo-bending which is warm started from the hypo's last
+ *        ray of the same station & phase. It only writes to its own task.
+ *
+ * @param arg
+ * @param index
+ */
+static void trace_pick_task( void *arg, const int index )
+{
+	TRACE_BATCH      *batch = (TRACE_BATCH *)arg;
+	TRACE_TASK       *task  = batch->tasks + index;
+	const PICK_STATE *pick  = task->pick;
+	RAY_INFO          ray_path[RT_MAX_NODE + 1];
+	int               np;
+	double            gradient[3];
+	const int         vel_type = !strcmp(pick->observe.phase_name, "S") ? RT_S_WAVE_VELOCITY : RT_P_WAVE_VELOCITY;
+
+/* */
+	task->info = (RT_TRACE_INFO){ 0, 0 };
+	if ( !el_tttable_lookup( batch->model, pick, batch->lon0, batch->lat0, batch->depth0, &task->trv_time, gradient ) ) {
+		if ( batch->derivatives ) {
+			task->derivatives[0] = gradient[0] / batch->delta_x;
+			task->derivatives[1] = gradient[1] / batch->delta_y;
+			task->derivatives[2] = gradient[2];
+			task->derivatives[3] = 1.0;
+		}
+		task->result = TRACE_RESULT_TABLE;
+		return;
+	}
+/* Without the cache, just trace it from the straight ray */
+	if ( !task->cache ) {
+		task->result = rt_main(
+			batch->model, ray_path, &np, &task->trv_time,
+			batch->lat0, batch->lon0, batch->depth0, pick->observe.latitude, pick->observe.longitude, pick->observe.elevation, vel_type,
+			batch->profile, &task->info
+		) ? -1 : TRACE_RESULT_NOCACHE;
+	}
+	else {
+		task->result = rt_main_cache(
+			batch->model, task->cache, ray_path, &np, &task->trv_time,
+			batch->lat0, batch->lon0, batch->depth0, pick->observe.latitude, pick->observe.longitude, pick->observe.elevation, vel_type,
+			batch->profile, &task->info
+		);
+	}
+	if ( task->result != -1 && batch->derivatives )
+		get_travel_time_derivatives_3D( ray_path, np, task->derivatives );
+
+	return;
+}
+
 /**
  * @brief Get the r weight object
  *
@@ -942,6 +1780,42 @@ static double *get_travel_time_derivatives_3D(
  * @return double
  */
 static double get_r_weight( const double epc_dist, const double hyp_depth, const double residual, const int pick_weight, const int pick_flag )
+{
+	LOC_REAL tmp;
+	LOC_REAL result = 1.0;
+/* */
+	const LOC_REAL tres     = 1.0 + (pick_flag & PICK_FLAG_PRIMARY ? 1.0: 0.0) + (pick_weight < 2 ? 1.0 : 0.0);
+	const LOC_REAL _depth   = hyp_depth;
+	const LOC_REAL _dist    = epc_dist;
+	const LOC_REAL hyp_dist = sqrt(_depth * _depth + _dist * _dist + LOC_REAL_C(EARLYLOC_EPSILON));
+
+/* */
+	if ( hyp_dist > NEAR_HYPO_DISTANCE ) {
+		result *=
+			LOC_REAL_C(FAR_HYPO_DISTANCE - NEAR_HYPO_DISTANCE) /
+			(LOC_REAL_C(9.0) * hyp_dist + LOC_REAL_C(FAR_HYPO_DISTANCE - 10.0 * NEAR_HYPO_DISTANCE));
+	}
+/* */
+	tmp     = tres / (tres + fabs((LOC_REAL)residual));
+	result *= tmp * tmp;
+	//result *= tmp * (tres / (tres + log10(epc_dist))) * (tres / (tres + pick_weight));
+
+	return result;
+}
+
+/**
+ * @brief Get the loss of residual which is consistent with the r weight, that means the derivative
+ *        of this loss is exactly (r weight * residual). Therefore, the weighted least square step will
+ *        always be the descent direction of this loss.
+ *
+ * @param epc_dist
+ * @param hyp_depth
+ * @param residual
+ * @param pick_weight
+ * @param pick_flag
+ * @return double
+ */
+static double get_r_loss( const double epc_dist, const double hyp_depth, const double residual, const int pick_weight, const int pick_flag )
 {
 	double tmp;
 	double result = 1.0;
@@ -955,13 +1829,88 @@ static double get_r_weight( const double epc_dist, const double hyp_depth, const
 			(FAR_HYPO_DISTANCE - NEAR_HYPO_DISTANCE) / (9. * hyp_dist + FAR_HYPO_DISTANCE - 10. * NEAR_HYPO_DISTANCE);
 	}
 /* */
-	tmp     = tres / (tres + fabs(residual));
-	result *= tmp * tmp;
-	//result *= tmp * (tres / (tres + log10(epc_dist))) * (tres / (tres + pick_weight));
+	tmp     = fabs(residual) / tres;
+	result *= tres * tres * (log1p(tmp) + 1.0 / (1.0 + tmp) - 1.0);
 
 	return result;
 }
 
+/**
+ * @brief Get the Tukey's biweight of the residual, those primary picks always keep the full weight.
+ *
+ * @param residual
+ * @param scale
+ * @param pick_flag
+ * @return double
+ */
+static double get_robust_weight( const double residual, const double scale, const int pick_flag )
+{
+	double tmp;
+
+/* */
+	if ( scale <= 0.0 || pick_flag & PICK_FLAG_PRIMARY )
+		return 1.0;
+/* */
+	tmp = residual / (ROBUST_TUKEY_CONSTANT * scale);
+	if ( fabs(tmp) >= 1.0 )
+		return 0.0;
+	tmp = 1.0 - tmp * tmp;
+
+	return tmp * tmp;
+}
+
+/**
+ * @brief Get the residual clipped by the rejecting threshold of the Tukey's biweight, then the loss
+ *        of outliers will be constant.
+ *
+ * @param residual
+ * @param scale
+ * @param pick_flag
+ * @return double
+ */
+static double get_robust_residual( const double residual, const double scale, const int pick_flag )
+{
+	const double threshold = ROBUST_TUKEY_CONSTANT * scale;
+
+/* */
+	if ( scale <= 0.0 || pick_flag & PICK_FLAG_PRIMARY || fabs(residual) < threshold )
+		return residual;
+
+	return threshold;
+}
+
+/**
+ * @brief Get the robust scale of the residuals by the median absolute deviation (MAD).
+ *
+ * @param pool
+ * @return double
+ */
+static double get_robust_scale( const PICKS_POOL *pool )
+{
+	int         i = 0;
+	DL_NODE    *node;
+	PICK_STATE *pick;
+	double      median;
+	double      residuals[pool->totals + 1];
+
+/* */
+	DL_LIST_FOR_EACH_DATA( pool->entry, node, pick ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && i < pool->totals )
+			residuals[i++] = pick->residual;
+	}
+	if ( !i )
+		return ROBUST_MIN_SCALE;
+/* */
+	qsort(residuals, i, sizeof(double), compare_gap);
+	median = residuals[i / 2];
+	for ( int j = 0; j < i; j++ )
+		residuals[j] = fabs(residuals[j] - median);
+	qsort(residuals, i, sizeof(double), compare_gap);
+	median = residuals[i / 2] * ROBUST_MAD_FACTOR;
+
+	return median > ROBUST_MIN_SCALE ? median : ROBUST_MIN_SCALE;
+}
+
 /**
  * @brief Get the gap degree object
  *
@@ -1073,3 +2022,78 @@ static int compare_gap( const void *a, const void *b )
 
 	return 0;
 }
+
+/**
+ * @brief Get the 3D velocity model held by the hypo, the hypo will hold the current model at the first
+ *        use & keep using it until the end of its life, even the model has been reloaded. It returns
+ *        NULL when there isn't any 3D velocity model.
+ *
+ * @param hyp
+ * @return const RT_VELMOD*
+ */
+static const RT_VELMOD *get_hypo_velmod( HYPO_STATE *hyp )
+{
+	if ( !hyp->velmod )
+		hyp->velmod = el_velmod_acquire();
+
+	return hyp->velmod;
+}
+
+/**
+ * @brief Find the cached ray of the pick's station & phase within the hypo, it will be created when
+ *        there is nothing. The cache itself checks the receiver's coordinate, so the replaced pick of
+ *        the same station is still safe.
+ *
+ * @param hyp
+ * @param pick
+ * @return RT_RAY_CACHE*
+ */
+static RT_RAY_CACHE *get_ray_cache( HYPO_STATE *hyp, const PICK_STATE *pick )
+{
+	RAY_CACHE_NODE   key;
+	RAY_CACHE_NODE  *node;
+	RAY_CACHE_NODE **leaf;
+
+/* */
+	sprintf(
+		key.key, "%s.%s.%s.%s", pick->observe.station, pick->observe.network, pick->observe.location, pick->observe.phase_name
+	);
+	if ( (leaf = tfind(&key, &hyp->ray_caches, compare_ray_cache)) )
+		return &(*leaf)->cache;
+/* */
+	if ( (node = malloc(sizeof(RAY_CACHE_NODE))) == NULL )
+		return NULL;
+	strcpy(node->key, key.key);
+	RT_RAY_CACHE_INIT( node->cache );
+	if ( (leaf = tsearch(node, &hyp->ray_caches, compare_ray_cache)) == NULL ) {
+		free(node);
+		return NULL;
+	}
+
+	return &(*leaf)->cache;
+}
+
+/**
+ * @brief
+ *
+ * @param a
+ * @param b
+ * @return int
+ */
+static int compare_ray_cache( const void *a, const void *b )
+{
+	return strcmp(((const RAY_CACHE_NODE *)a)->key, ((const RAY_CACHE_NODE *)b)->key);
+}
+
+/**
+ * @brief
+ *
+ * @param node
+ */
+static void free_ray_cache( void *node )
+{
+	rt_ray_cache_free( &((RAY_CACHE_NODE *)node)->cache );
+	free(node);
+
+	return;
+}
@@ -13,9 +13,16 @@
 #include <time.h>
 #include <math.h>
 /* */
+#include <dl_chain_list.h>
+#include <earlyloc.h>
 #include <earlyloc_misc.h>
 
 #define TIMESTAMP_SIMPLE_FORMAT  "%04d%02d%02d%02d%02d%02d"
+/* The distance (in minute of arc) per degree of the longitude & latitude, by the polynomials of the latitude */
+#define MINUTE_PER_LON( _LAT ) \
+		(1.840708 + (_LAT)*(.0015269 + (_LAT)*(-.00034 + (_LAT)*(1.02337e-6))))
+#define MINUTE_PER_LAT( _LAT ) \
+		(1.843404 + (_LAT)*(-6.93799e-5 + (_LAT)*(8.79993e-6 + (_LAT)*(-6.47527e-8))))
 
 /**
  * @brief
@@ -32,6 +39,21 @@ double el_misc_timenow( void )
 	return time_sp.tv_sec + time_sp.tv_nsec * 1.0e-9;
 }
 
+/**
+ * @brief Get the monotonic time with full resolution, it is only used to measure the elapsed time.
+ *
+ * @return double
+ */
+double el_misc_timenow_precise( void )
+{
+	struct timespec time_sp;
+
+/* */
+	clock_gettime(CLOCK_MONOTONIC, &time_sp);
+
+	return time_sp.tv_sec + time_sp.tv_nsec * 1.0e-9;
+}
+
 /*
  *
  */
@@ -67,11 +89,61 @@ double el_misc_geog2distf( const double elon, const double elat, const double sl
 {
 	const double avlat = (elat + slat)*0.5;
 
-	double a = 1.840708 + avlat*(.0015269 + avlat*(-.00034 + avlat*(1.02337e-6)));
-	double b = 1.843404 + avlat*(-6.93799e-5 + avlat*(8.79993e-6 + avlat*(-6.47527e-8)));
+	double a = MINUTE_PER_LON( avlat );
+	double b = MINUTE_PER_LAT( avlat );
 
 	a *= (slon - elon) * 60.0;
 	b *= (slat - elat) * 60.0;
 
 	return sqrt(a * a + b * b);
 }
+
+/**
+ * @brief Get the local distance (unit: km) per degree of the longitude & latitude at the input latitude,
+ *        it is the same approximation as el_misc_geog2distf.
+ *
+ * @param lat
+ * @param km_per_lon
+ * @param km_per_lat
+ */
+void el_misc_geog_km_per_deg( const double lat, double *km_per_lon, double *km_per_lat )
+{
+	*km_per_lon = MINUTE_PER_LON( lat ) * 60.0;
+	*km_per_lat = MINUTE_PER_LAT( lat ) * 60.0;
+
+	return;
+}
+
+/**
+ * @brief Compute all the derived geometry of the station from its longitude & latitude.
+ *
+ * @param geometry
+ * @param lon
+ * @param lat
+ * @return STA_GEOMETRY*
+ */
+STA_GEOMETRY *el_misc_geometry_init( STA_GEOMETRY *geometry, const double lon, const double lat )
+{
+	geometry->longitude = lon;
+	geometry->latitude  = lat;
+	el_misc_geog_km_per_deg( lat, &geometry->km_per_lon, &geometry->km_per_lat );
+
+	return geometry;
+}
+
+/**
+ * @brief Transforms the precomputed geometries into distance(unit: km), the local scales of both stations
+ *        are averaged instead of evaluating the polynomials at the average latitude. It differs from
+ *        el_misc_geog2distf by up to 0.094 km at ~500 km, but less than 1e-4 km within the cluster distances.
+ *
+ * @param ga
+ * @param gb
+ * @return double
+ */
+double el_misc_geometry_distf( const STA_GEOMETRY *ga, const STA_GEOMETRY *gb )
+{
+	const double a = (ga->km_per_lon + gb->km_per_lon) * 0.5 * (gb->longitude - ga->longitude);
+	const double b = (ga->km_per_lat + gb->km_per_lat) * 0.5 * (gb->latitude - ga->latitude);
+
+	return sqrt(a * a + b * b);
+}
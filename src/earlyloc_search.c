@@ -0,0 +1,456 @@
+/**
+ * @file earlyloc_search.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief
+ * @version 0.1
+ * @date 2023-10-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+/* Standard C header include */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+/* Local header include */
+#include <dl_chain_list.h>
+#include <worker_pool.h>
+#include <earlyloc.h>
+#include <earlyloc_misc.h>
+#include <earlyloc_locate.h>
+#include <earlyloc_search.h>
+
+/* Travel time tables settings (in km) */
+#define TABLE_DIST_STEP     1.0f
+#define TABLE_MAX_DIST      600.0f
+#define TABLE_DEPTH_STEP    1.0f
+/* Coarse grid & oct-tree settings (in km) */
+#define GRID_MARGIN_DIST    100.0f
+#define GRID_STEP           10.0f
+#define GRID_DEPTH_STEP     10.0f
+#define OCTREE_LEVELS       4
+#define OCTREE_BEAM_NODES   8
+#define OCTREE_CHILDREN     8
+/* The picking uncertainty (in second) for the weight 0 pick */
+#define PICK_MIN_SIGMA      0.25f
+/* */
+#define TABLE_P_WAVE        0
+#define TABLE_S_WAVE        1
+#define TABLE_PHASE_COUNT   2
+
+/*
+ *
+ */
+typedef struct {
+	double       longitude;
+	double       latitude;
+	double       picktime;
+	double       km_per_lon;
+	double       km_per_lat;
+	double       sigma;
+	const float *table;
+} SEARCH_PICK;
+
+/*
+ *
+ */
+typedef struct {
+	double longitude;
+	double latitude;
+	double depth;
+	double score;
+} SEARCH_NODE;
+
+/*
+ *
+ */
+typedef struct {
+	const SEARCH_PICK *picks;
+	int                npicks;
+	SEARCH_NODE       *nodes;
+	int                nnodes;
+} SEARCH_TASK;
+
+/* */
+static void   evaluate_nodes_task( void *, const int );
+static void   evaluate_nodes( SEARCH_NODE *, const int, const SEARCH_PICK *, const int );
+static double get_node_score( const SEARCH_NODE *, const SEARCH_PICK *, const int );
+static double get_node_residuals( const SEARCH_NODE *, const SEARCH_PICK *, const int, double * );
+static double lookup_travel_time( const float *, double, double );
+static double get_median( double *, const int );
+static int    compare_score( const void *, const void * );
+static int    compare_double( const void *, const void * );
+
+/* */
+static float  *TTTables[TABLE_PHASE_COUNT] = { NULL };
+static int     TableDists   = 0;
+static int     TableDepths  = 0;
+static uint8_t ScoreType    = EL_SEARCH_SCORE_EDT;
+static WORKER_POOL *SearchPool = NULL;   /* NULL if the nodes are evaluated by the calling thread only */
+
+/**
+ * @brief Build the travel time tables of P & S phases from the 1D layer velocity model & start the
+ *        persistent pool for evaluating the nodes when nthreads is larger than 1.
+ *
+ * @param p_model
+ * @param s_model
+ * @param score_type
+ * @param nthreads
+ * @return int
+ */
+int el_search_init( const LAYER_VEL_MODEL *p_model, const LAYER_VEL_MODEL *s_model, const int score_type, const int nthreads )
+{
+	const char *phases[TABLE_PHASE_COUNT] = { "P", "S" };
+
+/* */
+	el_search_free();
+	ScoreType     = score_type < EL_SEARCH_SCORE_COUNT ? score_type : EL_SEARCH_SCORE_EDT;
+	TableDists    = (int)(TABLE_MAX_DIST / TABLE_DIST_STEP) + 1;
+	TableDepths   = (int)(MAX_HYPO_DEPTH / TABLE_DEPTH_STEP) + 1;
+/* */
+	for ( int i = 0; i < TABLE_PHASE_COUNT; i++ ) {
+		if ( !(TTTables[i] = (float *)malloc(sizeof(float) * TableDists * TableDepths)) ) {
+			el_search_free();
+			return -1;
+		}
+		for ( int j = 0; j < TableDists; j++ ) {
+			for ( int k = 0; k < TableDepths; k++ ) {
+				TTTables[i][j * TableDepths + k] = el_loc_travel_time(
+					j * TABLE_DIST_STEP, k * TABLE_DEPTH_STEP, phases[i], p_model, s_model
+				);
+			}
+		}
+	}
+/* Start the pool for evaluating the nodes in parallel, the calling thread is also counted */
+	if ( nthreads > 1 && (SearchPool = wp_create( nthreads )) == NULL ) {
+		el_search_free();
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Search the hypocenter by the coarse grid & then refine it by the oct-tree, the result will be
+ *        the initial guess of the Geiger's method.
+ *
+ * @param hyp
+ * @param stats
+ * @return int
+ */
+int el_search_location_guess( HYPO_STATE *hyp, SEARCH_STATS *stats )
+{
+	int          i, j, k;
+	int          npicks = 0;
+	int          nnodes;
+	int          nbeams;
+	int          nx, ny, nz;
+	DL_NODE     *node;
+	PICK_STATE  *pick;
+	SEARCH_NODE *nodes;
+	SEARCH_NODE  best;
+	SEARCH_NODE  beams[OCTREE_BEAM_NODES];
+	SEARCH_NODE  children[OCTREE_BEAM_NODES * OCTREE_CHILDREN];
+	double       min_lon = 0.0, max_lon = 0.0, min_lat = 0.0, max_lat = 0.0;
+	double       delta_x, delta_y;
+	double       dlon, dlat, ddep;
+	double       timestamp;
+	SEARCH_PICK  picks[hyp->pool.totals + 1];
+
+/* */
+	if ( !TTTables[TABLE_P_WAVE] || !TTTables[TABLE_S_WAVE] )
+		return -1;
+/* Collect the valid picks & the area of stations */
+	DL_LIST_FOR_EACH_DATA( hyp->pool.entry, node, pick ) {
+		if ( EL_PICK_VALID_LOCATE( pick ) && npicks < hyp->pool.totals ) {
+			picks[npicks].longitude = pick->observe.longitude;
+			picks[npicks].latitude  = pick->observe.latitude;
+			picks[npicks].km_per_lon = pick->geometry.km_per_lon;
+			picks[npicks].km_per_lat = pick->geometry.km_per_lat;
+			picks[npicks].picktime  = pick->observe.picktime;
+			picks[npicks].sigma     = PICK_MIN_SIGMA * (1.0 + pick->observe.weight);
+			picks[npicks].table     = TTTables[!strcmp(pick->observe.phase_name, "S") ? TABLE_S_WAVE : TABLE_P_WAVE];
+		/* */
+			if ( !npicks || pick->observe.longitude < min_lon )
+				min_lon = pick->observe.longitude;
+			if ( !npicks || pick->observe.longitude > max_lon )
+				max_lon = pick->observe.longitude;
+			if ( !npicks || pick->observe.latitude < min_lat )
+				min_lat = pick->observe.latitude;
+			if ( !npicks || pick->observe.latitude > max_lat )
+				max_lat = pick->observe.latitude;
+			npicks++;
+		}
+	}
+	if ( npicks < MIN_LOCATE_PICKS )
+		return -1;
+/* Build the coarse grid around those stations */
+	el_misc_geog_km_per_deg( (min_lat + max_lat) * 0.5, &delta_x, &delta_y );
+	min_lon -= GRID_MARGIN_DIST / delta_x;
+	max_lon += GRID_MARGIN_DIST / delta_x;
+	min_lat -= GRID_MARGIN_DIST / delta_y;
+	max_lat += GRID_MARGIN_DIST / delta_y;
+	dlon     = GRID_STEP / delta_x;
+	dlat     = GRID_STEP / delta_y;
+	ddep     = GRID_DEPTH_STEP;
+	nx       = (int)ceil((max_lon - min_lon) / dlon);
+	ny       = (int)ceil((max_lat - min_lat) / dlat);
+	nz       = (int)ceil((MAX_HYPO_DEPTH - MIN_HYPO_DEPTH) / ddep);
+	nnodes   = nx * ny * nz;
+	if ( !(nodes = (SEARCH_NODE *)malloc(sizeof(SEARCH_NODE) * nnodes)) )
+		return -1;
+/* */
+	for ( i = 0; i < nx; i++ ) {
+		for ( j = 0; j < ny; j++ ) {
+			for ( k = 0; k < nz; k++ ) {
+				nodes[(i * ny + j) * nz + k] = (SEARCH_NODE){
+					min_lon + (i + 0.5) * dlon, min_lat + (j + 0.5) * dlat, MIN_HYPO_DEPTH + (k + 0.5) * ddep, 0.0
+				};
+			}
+		}
+	}
+/* First stage, the coarse grid */
+	timestamp = el_misc_timenow_precise();
+	evaluate_nodes( nodes, nnodes, picks, npicks );
+	qsort(nodes, nnodes, sizeof(SEARCH_NODE), compare_score);
+	nbeams = nnodes < OCTREE_BEAM_NODES ? nnodes : OCTREE_BEAM_NODES;
+	memcpy(beams, nodes, sizeof(SEARCH_NODE) * nbeams);
+	best = nodes[0];
+	free(nodes);
+	if ( stats ) {
+		stats->coarse = el_misc_timenow_precise() - timestamp;
+		stats->nodes  = nnodes;
+	}
+/* Second stage, split the best cells into eight children level by level */
+	timestamp = el_misc_timenow_precise();
+	for ( int level = 0; level < OCTREE_LEVELS; level++ ) {
+		dlon *= 0.5;
+		dlat *= 0.5;
+		ddep *= 0.5;
+		for ( i = 0; i < nbeams; i++ ) {
+			for ( j = 0; j < OCTREE_CHILDREN; j++ ) {
+				SEARCH_NODE *child = &children[i * OCTREE_CHILDREN + j];
+			/* */
+				child->longitude = beams[i].longitude + (j & 0x01 ? 0.5 : -0.5) * dlon;
+				child->latitude  = beams[i].latitude + (j & 0x02 ? 0.5 : -0.5) * dlat;
+				child->depth     = beams[i].depth + (j & 0x04 ? 0.5 : -0.5) * ddep;
+				child->score     = 0.0;
+			}
+		}
+		nnodes = nbeams * OCTREE_CHILDREN;
+		evaluate_nodes( children, nnodes, picks, npicks );
+		qsort(children, nnodes, sizeof(SEARCH_NODE), compare_score);
+		memcpy(beams, children, sizeof(SEARCH_NODE) * nbeams);
+	/* */
+		if ( children[0].score > best.score )
+			best = children[0];
+		if ( stats )
+			stats->nodes += nnodes;
+	}
+	if ( stats )
+		stats->octree = el_misc_timenow_precise() - timestamp;
+/* The origin time is the median of the residuals without origin time */
+	hyp->longitude   = best.longitude;
+	hyp->latitude    = best.latitude;
+	hyp->depth       = best.depth;
+	hyp->origin_time = get_node_residuals( &best, picks, npicks, NULL );
+
+	return 0;
+}
+
+/**
+ * @brief
+ *
+ */
+void el_search_free( void )
+{
+	wp_destroy( SearchPool );
+	SearchPool = NULL;
+	for ( int i = 0; i < TABLE_PHASE_COUNT; i++ ) {
+		if ( TTTables[i] )
+			free(TTTables[i]);
+		TTTables[i] = NULL;
+	}
+
+	return;
+}
+
+/**
+ * @brief Evaluate one part of the nodes, it only writes the scores of its own nodes.
+ *
+ * @param arg
+ * @param index
+ */
+static void evaluate_nodes_task( void *arg, const int index )
+{
+	SEARCH_TASK *task = (SEARCH_TASK *)arg + index;
+
+/* */
+	for ( int i = 0; i < task->nnodes; i++ )
+		task->nodes[i].score = get_node_score( &task->nodes[i], task->picks, task->npicks );
+
+	return;
+}
+
+/**
+ * @brief Evaluate the nodes by splitting them into several parts which will be run on the persistent
+ *        worker pool, the calling thread also takes its share.
+ *
+ * @param nodes
+ * @param nnodes
+ * @param picks
+ * @param npicks
+ */
+static void evaluate_nodes( SEARCH_NODE *nodes, const int nnodes, const SEARCH_PICK *picks, const int npicks )
+{
+	const int   nthreads = wp_threads( SearchPool ) < nnodes ? wp_threads( SearchPool ) : nnodes;
+	int         begin    = 0;
+	SEARCH_TASK tasks[nthreads > 0 ? nthreads : 1];
+
+/* */
+	for ( int i = 0; i < nthreads; i++ ) {
+		tasks[i] = (SEARCH_TASK){ picks, npicks, nodes + begin, (nnodes - begin) / (nthreads - i) };
+		begin   += tasks[i].nnodes;
+	}
+	wp_run( SearchPool, evaluate_nodes_task, tasks, nthreads );
+
+	return;
+}
+
+/**
+ * @brief Get the score of the node, the larger is better. EDT (equal differential time) score is the sum
+ *        of Gaussian likelihood over all the pairs of picks & it doesn't need the origin time; L1 score is
+ *        the negative sum of the absolute normalized residuals with the median origin time.
+ *
+ * @param node
+ * @param picks
+ * @param npicks
+ * @return double
+ */
+static double get_node_score( const SEARCH_NODE *node, const SEARCH_PICK *picks, const int npicks )
+{
+	double result = 0.0;
+	double origin;
+	double tmp;
+	double residuals[npicks];
+
+/* */
+	origin = get_node_residuals( node, picks, npicks, residuals );
+/* */
+	if ( ScoreType == EL_SEARCH_SCORE_L1 ) {
+		for ( int i = 0; i < npicks; i++ )
+			result -= fabs(residuals[i] - origin) / picks[i].sigma;
+	}
+	else {
+		for ( int i = 0; i < npicks; i++ ) {
+			for ( int j = i + 1; j < npicks; j++ ) {
+				tmp     = residuals[i] - residuals[j];
+				result += exp(-0.5 * tmp * tmp / (picks[i].sigma * picks[i].sigma + picks[j].sigma * picks[j].sigma));
+			}
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Get the residuals without origin time (pick time - travel time) of the node & returns the
+ *        median of them which is the estimated origin time.
+ *
+ * @param node
+ * @param picks
+ * @param npicks
+ * @param residuals
+ * @return double
+ */
+static double get_node_residuals( const SEARCH_NODE *node, const SEARCH_PICK *picks, const int npicks, double *residuals )
+{
+	double _residuals[npicks];
+	double km_per_lon, km_per_lat;
+	double dx, dy;
+
+/* The local scales of the node are computed once, then averaged with the precomputed ones of each station */
+	el_misc_geog_km_per_deg( node->latitude, &km_per_lon, &km_per_lat );
+	for ( int i = 0; i < npicks; i++ ) {
+		dx = (km_per_lon + picks[i].km_per_lon) * 0.5 * (picks[i].longitude - node->longitude);
+		dy = (km_per_lat + picks[i].km_per_lat) * 0.5 * (picks[i].latitude - node->latitude);
+		_residuals[i] = picks[i].picktime - lookup_travel_time( picks[i].table, sqrt(dx * dx + dy * dy), node->depth );
+	}
+/* */
+	if ( residuals )
+		memcpy(residuals, _residuals, sizeof(double) * npicks);
+
+	return get_median( _residuals, npicks );
+}
+
+/**
+ * @brief Bilinear interpolation within the travel time table.
+ *
+ * @param table
+ * @param dist
+ * @param depth
+ * @return double
+ */
+static double lookup_travel_time( const float *table, double dist, double depth )
+{
+	int          i, j;
+	const float *t0, *t1;
+
+/* */
+	dist  = dist < 0.0 ? 0.0 : dist > TABLE_MAX_DIST ? TABLE_MAX_DIST : dist;
+	depth = depth < 0.0 ? 0.0 : depth > MAX_HYPO_DEPTH ? MAX_HYPO_DEPTH : depth;
+	dist /= TABLE_DIST_STEP;
+	depth /= TABLE_DEPTH_STEP;
+	if ( (i = (int)dist) >= TableDists - 1 )
+		i = TableDists - 2;
+	if ( (j = (int)depth) >= TableDepths - 1 )
+		j = TableDepths - 2;
+	dist  -= i;
+	depth -= j;
+/* */
+	t0 = table + i * TableDepths + j;
+	t1 = t0 + TableDepths;
+
+	return (1.0 - dist) * ((1.0 - depth) * t0[0] + depth * t0[1]) + dist * ((1.0 - depth) * t1[0] + depth * t1[1]);
+}
+
+/**
+ * @brief
+ *
+ * @param values
+ * @param nvalues
+ * @return double
+ */
+static double get_median( double *values, const int nvalues )
+{
+	qsort(values, nvalues, sizeof(double), compare_double);
+
+	return nvalues % 2 ? values[nvalues / 2] : (values[nvalues / 2 - 1] + values[nvalues / 2]) * 0.5;
+}
+
+/*
+ * compare_score() - Descending order of the node score
+ */
+static int compare_score( const void *a, const void *b )
+{
+	if ( ((SEARCH_NODE *)a)->score > ((SEARCH_NODE *)b)->score )
+		return -1;
+	if ( ((SEARCH_NODE *)a)->score < ((SEARCH_NODE *)b)->score )
+		return 1;
+
+	return 0;
+}
+
+/*
+ * compare_double()
+ */
+static int compare_double( const void *a, const void *b )
+{
+	if ( *(double *)a < *(double *)b )
+		return -1;
+	if ( *(double *)a > *(double *)b )
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,700 @@
+/**
+ * @file earlyloc_tttable.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Per-station travel time tables within the 3D velocity model. The tables are generated by the
+ *        background thread when the station is firstly requested & stored as the memory-mappable
+ *        files, therefore they can be reused after restarting. The travel times could be traced by
+ *        the pseudo-bending node by node, or solved by the eikonal solver for the whole grid at once.
+ *        The stations are kept in the fixed open-addressing hash, which is only modified by holding
+ *        the lock, so the lookups of the locating threads don't need any lock. Each table belongs to
+ *        the model it was derived within, after the model is reloaded the generator switches to the
+ *        new one & the tables are regenerated when they are requested by the hypos of the new model.
+ * @version 0.1
+ * @date 2023-10-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#define _GNU_SOURCE
+/* Standard C header include */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+/* Earthworm environment header include */
+#include <earthworm.h>
+/* Local header include */
+#include <constants.h>
+#include <raytracing.h>
+#include <eikonal.h>
+#include <tttable.h>
+#include <dl_chain_list.h>
+#include <earlyloc.h>
+#include <earlyloc_misc.h>
+#include <earlyloc_velmod.h>
+#include <earlyloc_tttable.h>
+
+/* The tolerance of the station's coordinate to use the table (in degree & km), the elevation is the depth of the pick */
+#define STATION_COORD_TOLERANCE  1.0e-4
+#define STATION_ELEV_TOLERANCE   1.0e-3
+
+/* The number of the slots of the stations' hash, it should be the power of two */
+#define TABLE_HASH_SLOTS     8192
+#define TABLE_HASH_MAX_LOAD  (TABLE_HASH_SLOTS / 4 * 3)
+/* The replaced stations will be freed after the number of seconds */
+#define TABLE_RETIRE_GRACE   10
+
+/* */
+#define TABLE_STATE_PENDING  0
+#define TABLE_STATE_READY    1
+#define TABLE_STATE_FAILED   2
+
+/*
+ *
+ */
+typedef struct station_table {
+	char      key[TRACE2_STA_LEN + TRACE2_NET_LEN + TRACE2_LOC_LEN + 4];
+	int       phase;
+	double    longitude;
+	double    latitude;
+	double    elevation;
+	uint64_t  model;
+	TT_TABLE *table;
+	time_t    retired;
+/* The table should be assigned before the state is changed to ready */
+	_Atomic uint8_t state;
+/* Next one in the pending queue or the retired list */
+	struct station_table *next;
+} STATION_TABLE;
+
+/*
+ *
+ */
+typedef struct {
+	const STATION_TABLE *station;
+	RAY_INFO            *ray_path;
+} GENERATOR_ARG;
+
+/* */
+static int     thread_generator( void * );
+static double  trace_travel_time( void *, const double, const double, const double );
+static int     solve_travel_time( const STATION_TABLE *, const TT_TABLE_HEADER *, const char * );
+static TT_TABLE *load_station_table( const STATION_TABLE * );
+static void    init_table_header( TT_TABLE_HEADER *, const STATION_TABLE * );
+static STATION_TABLE *find_station_table( const char *, uint32_t * );
+static void    queue_station_table( const STATION_TABLE *, const PICK_STATE * );
+static int     bind_station_model( const STATION_TABLE * );
+static int     is_same_station( const STATION_TABLE *, const PICK_STATE * );
+static void    free_retired_tables( const time_t );
+static void    free_station_table( STATION_TABLE * );
+
+/* */
+static uint8_t          TableReady = 0;
+static const RT_VELMOD *VelocityModel = NULL;  /* Held by the tables, only used by the generator after init */
+static volatile int     Terminate  = 0;
+static char             TablePath[MAX_PATH_STR];
+static double           HorizontalStep;
+static double           VerticalStep;
+static double           TableRadius;
+static int              EikonalThreads = 0;  /* 0 means tracing by the pseudo-bending */
+static double           ModelRange[6];
+static uint64_t         ModelFingerprint = 0;
+static uint32_t         Stations    = 0;
+static STATION_TABLE   *PendingHead = NULL;
+static STATION_TABLE   *PendingTail = NULL;
+static STATION_TABLE   *RetiredHead = NULL;
+static _Atomic(STATION_TABLE *) Slots[TABLE_HASH_SLOTS];
+static mtx_t            TableMutex;
+static cnd_t            TableCond;
+static thrd_t           GeneratorTid;
+/* Statistics */
+static uint32_t         Built   = 0;
+static uint32_t         Loaded  = 0;
+static atomic_uint_fast64_t Lookups = 0;
+static atomic_uint_fast64_t Hits    = 0;
+
+/**
+ * @brief Initialize the tables' settings & start the background generator with the current 3D
+ *        velocity model, the model will be held until it is replaced or the tables are freed.
+ *
+ * @param path the directory of the table files
+ * @param h_step horizontal step of the grid in degree
+ * @param v_step vertical step of the grid in km
+ * @param radius the half width of the grid centered at the station in degree
+ * @param eik_threads the number of threads of the eikonal solver, 0 for the pseudo-bending tracing
+ * @return int
+ */
+int el_tttable_init( const char *path, const double h_step, const double v_step, const double radius, const int eik_threads )
+{
+	const RT_VELMOD *model;
+
+/* */
+	if ( TableReady )
+		return 0;
+/* */
+	if ( h_step <= 0.0 || v_step <= 0.0 || radius < h_step )
+		return -1;
+	if ( (model = el_velmod_acquire()) == NULL )
+		return -1;
+	if ( rt_velmod_range( model, &ModelRange[0], &ModelRange[1], &ModelRange[2], &ModelRange[3], &ModelRange[4], &ModelRange[5] ) ) {
+		el_velmod_release( model );
+		return -1;
+	}
+/* */
+	VelocityModel    = model;
+	ModelFingerprint = rt_velmod_fingerprint( model );
+	strcpy(TablePath, path);
+	HorizontalStep = h_step;
+	VerticalStep   = v_step;
+	TableRadius    = radius;
+	EikonalThreads = eik_threads > 0 ? eik_threads : 0;
+	Terminate      = 0;
+	if ( mtx_init(&TableMutex, mtx_plain) != thrd_success )
+		goto init_error;
+	if ( cnd_init(&TableCond) != thrd_success ) {
+		mtx_destroy(&TableMutex);
+		goto init_error;
+	}
+	if ( thrd_create(&GeneratorTid, thread_generator, NULL) != thrd_success ) {
+		cnd_destroy(&TableCond);
+		mtx_destroy(&TableMutex);
+		goto init_error;
+	}
+	TableReady = 1;
+
+	return 0;
+
+init_error:
+	el_velmod_release( VelocityModel );
+	VelocityModel = NULL;
+
+	return -1;
+}
+
+/**
+ * @brief Interpolate the travel time & the gradient (in second per degree of longitude, latitude &
+ *        second per km of depth) of the pick from the hypocenter. The station's table will be queued
+ *        for generating when it hasn't been requested or its coordinate has been changed, and it returns
+ *        -1 until the table is ready. The tables are only valid for the model they were generated within,
+ *        the table of the former model will be regenerated when it's requested with the current model,
+ *        and the hypos still using the former model will get -1. It doesn't take any lock unless the
+ *        station should be queued.
+ *
+ * @param model
+ * @param pick
+ * @param lon
+ * @param lat
+ * @param dep
+ * @param travel_time
+ * @param gradient
+ * @return int
+ */
+int el_tttable_lookup(
+	const RT_VELMOD *model, const PICK_STATE *pick, const double lon, const double lat, const double dep, double *travel_time, double gradient[3]
+) {
+	STATION_TABLE  key;
+	STATION_TABLE *station;
+
+/* */
+	if ( !TableReady || !model )
+		return -1;
+	if ( !strcmp(pick->observe.phase_name, "P") )
+		key.phase = RT_P_WAVE_VELOCITY;
+	else if ( !strcmp(pick->observe.phase_name, "S") )
+		key.phase = RT_S_WAVE_VELOCITY;
+	else
+		return -1;
+	sprintf(
+		key.key, "%s.%s.%s.%s", pick->observe.station, pick->observe.network, pick->observe.location, pick->observe.phase_name
+	);
+	key.model = rt_velmod_fingerprint( model );
+/* */
+	atomic_fetch_add_explicit(&Lookups, 1, memory_order_relaxed);
+	if ( (station = find_station_table( key.key, NULL )) && station->model == key.model && is_same_station( station, pick ) ) {
+		if (
+			atomic_load_explicit(&station->state, memory_order_acquire) != TABLE_STATE_READY ||
+			tt_table_lookup( station->table, lon, lat, dep, travel_time, gradient )
+		) {
+			return -1;
+		}
+		atomic_fetch_add_explicit(&Hits, 1, memory_order_relaxed);
+		return 0;
+	}
+/* Not requested yet, the station has been moved or the model has been reloaded, it will wait for the pending one */
+	if ( !station || atomic_load_explicit(&station->state, memory_order_acquire) != TABLE_STATE_PENDING )
+		queue_station_table( &key, pick );
+
+	return -1;
+}
+
+/**
+ * @brief
+ *
+ */
+void el_tttable_free( void )
+{
+	if ( !TableReady )
+		return;
+/* Stop the generator, the tracing in progress will be aborted */
+	mtx_lock(&TableMutex);
+	Terminate = 1;
+	cnd_signal(&TableCond);
+	mtx_unlock(&TableMutex);
+	thrd_join(GeneratorTid, NULL);
+/* */
+	logit(
+		"o", "earlyloc: Travel time tables: %u built, %u loaded; %lu of %lu lookups hit the tables.\n",
+		Built, Loaded, (unsigned long)atomic_load(&Hits), (unsigned long)atomic_load(&Lookups)
+	);
+	for ( int i = 0; i < TABLE_HASH_SLOTS; i++ ) {
+		free_station_table( atomic_load(&Slots[i]) );
+		atomic_store(&Slots[i], NULL);
+	}
+	free_retired_tables( 0 );
+	Stations    = 0;
+	PendingHead = PendingTail = NULL;
+	el_velmod_release( VelocityModel );
+	VelocityModel = NULL;
+	cnd_destroy(&TableCond);
+	mtx_destroy(&TableMutex);
+	TableReady = 0;
+
+	return;
+}
+
+/**
+ * @brief The background generator, it will take the station from the pending queue one by one. It also
+ *        frees the replaced stations after the grace period.
+ *
+ * @param arg
+ * @return int
+ */
+static int thread_generator( void *arg )
+{
+	STATION_TABLE  *station;
+	TT_TABLE       *table;
+	struct timespec until;
+
+/* */
+	mtx_lock(&TableMutex);
+	while ( !Terminate ) {
+		free_retired_tables( time(NULL) );
+		if ( !(station = PendingHead) ) {
+			if ( RetiredHead ) {
+				timespec_get(&until, TIME_UTC);
+				until.tv_sec += TABLE_RETIRE_GRACE;
+				cnd_timedwait(&TableCond, &TableMutex, &until);
+			}
+			else {
+				cnd_wait(&TableCond, &TableMutex);
+			}
+			continue;
+		}
+		if ( !(PendingHead = station->next) )
+			PendingTail = NULL;
+		mtx_unlock(&TableMutex);
+	/* The station's coordinate & key won't be changed after queued, so it is safe without lock */
+		table = bind_station_model( station ) ? NULL : load_station_table( station );
+	/* */
+		mtx_lock(&TableMutex);
+		station->table = table;
+		atomic_store_explicit(&station->state, table ? TABLE_STATE_READY : TABLE_STATE_FAILED, memory_order_release);
+	}
+	mtx_unlock(&TableMutex);
+
+	return 0;
+}
+
+/**
+ * @brief Trace the ray from the input source to the station.
+ *
+ * @param arg
+ * @param lon
+ * @param lat
+ * @param dep
+ * @return double
+ */
+static double trace_travel_time( void *arg, const double lon, const double lat, const double dep )
+{
+	GENERATOR_ARG       *garg    = (GENERATOR_ARG *)arg;
+	const STATION_TABLE *station = garg->station;
+	int                  np;
+	double               result;
+
+/* Abort the generating */
+	if ( Terminate )
+		return NAN;
+/* */
+	if (
+		rt_main(
+			VelocityModel, garg->ray_path, &np, &result, lat, lon, dep, station->latitude, station->longitude, station->elevation, station->phase,
+			NULL, NULL
+		)
+	) {
+		return TT_TABLE_NULL;
+	}
+
+/* The tracing is degenerated when the source is just at the station */
+	return isnan(result) ? TT_TABLE_NULL : result;
+}
+
+/**
+ * @brief Solve the travel times of the whole grid by the eikonal solver with the source at the station,
+ *        by the reciprocity they are the travel times from each node to the station.
+ *
+ * @param station
+ * @param header
+ * @param path
+ * @return int
+ */
+static int solve_travel_time( const STATION_TABLE *station, const TT_TABLE_HEADER *header, const char *path )
+{
+	float   *velocity = NULL;
+	float   *tt       = NULL;
+	float   *vptr;
+	int      result   = -1;
+	EIK_GRID grid;
+/* */
+	const size_t nodes = (size_t)header->nlon * header->nlat * header->ndep;
+
+/* */
+	if ( !(velocity = malloc(sizeof(float) * nodes)) || !(tt = malloc(sizeof(float) * nodes)) )
+		goto end_process;
+	grid.nlon = header->nlon;
+	grid.nlat = header->nlat;
+	grid.ndep = header->ndep;
+	grid.lon0 = header->lon0;
+	grid.lat0 = header->lat0;
+	grid.dep0 = header->dep0;
+	grid.dlon = header->dlon;
+	grid.dlat = header->dlat;
+	grid.ddep = header->ddep;
+/* Sample the velocity model at the nodes */
+	vptr = velocity;
+	for ( uint32_t k = 0; k < header->ndep; k++ )
+		for ( uint32_t j = 0; j < header->nlat; j++ )
+			for ( uint32_t i = 0; i < header->nlon; i++, vptr++ )
+				*vptr = rt_velmod_velocity(
+					VelocityModel, grid.lat0 + j * grid.dlat, grid.lon0 + i * grid.dlon, grid.dep0 + k * grid.ddep, station->phase
+				);
+/* */
+	if ( Terminate )
+		goto end_process;
+	if ( eik_solve( &grid, velocity, station->longitude, station->latitude, station->elevation, EikonalThreads, tt ) < 0 )
+		goto end_process;
+	result = tt_table_save( path, header, tt );
+
+end_process:
+	free(velocity);
+	free(tt);
+
+	return result;
+}
+
+/**
+ * @brief Map the existing table file of the station, or generate a new one when it doesn't exist or
+ *        was built with different settings.
+ *
+ * @param station
+ * @return TT_TABLE*
+ */
+static TT_TABLE *load_station_table( const STATION_TABLE *station )
+{
+	char            path[MAX_PATH_STR * 2];
+	double          _timestamp;
+	TT_TABLE       *result;
+	TT_TABLE_HEADER header;
+	GENERATOR_ARG   garg;
+
+/* */
+	init_table_header( &header, station );
+	if ( !header.nlon || !header.nlat || !header.ndep ) {
+		logit("e", "earlyloc: Station %s is out of the 3D velocity model, skip the table.\n", station->key);
+		return NULL;
+	}
+	sprintf(path, "%s/%s.ttt", TablePath, station->key);
+/* */
+	if ( (result = tt_table_open( path )) ) {
+		if ( tt_table_match( result, &header ) ) {
+			Loaded++;
+			return result;
+		}
+		tt_table_close( result );
+	}
+/* */
+	_timestamp = el_misc_timenow_precise();
+	if ( EikonalThreads ) {
+		if ( solve_travel_time( station, &header, path ) ) {
+			if ( !Terminate )
+				logit("e", "earlyloc: Error solving the travel time table %s!\n", path);
+			return NULL;
+		}
+	}
+	else {
+		if ( (garg.ray_path = malloc(sizeof(RAY_INFO) * (RT_MAX_NODE + 1))) == NULL )
+			return NULL;
+		garg.station = station;
+		if ( tt_table_create( path, &header, trace_travel_time, &garg ) ) {
+			free(garg.ray_path);
+			if ( !Terminate )
+				logit("e", "earlyloc: Error generating the travel time table %s!\n", path);
+			return NULL;
+		}
+		free(garg.ray_path);
+	}
+/* */
+	if ( (result = tt_table_open( path )) ) {
+		Built++;
+		logit(
+			"o", "earlyloc: Travel time table %s (%u x %u x %u) generated, took %.3lf sec.\n",
+			station->key, header.nlon, header.nlat, header.ndep, el_misc_timenow_precise() - _timestamp
+		);
+	}
+
+	return result;
+}
+
+/**
+ * @brief The grid is centered at the station, clipped by the coverage of the 3D velocity model &
+ *        the depth range of the locating.
+ *
+ * @param header
+ * @param station
+ */
+static void init_table_header( TT_TABLE_HEADER *header, const STATION_TABLE *station )
+{
+	double lon1, lat1, dep1;
+
+/* */
+	memset(header, 0, sizeof(TT_TABLE_HEADER));
+	header->phase    = station->phase;
+	header->method   = EikonalThreads ? TT_TABLE_METHOD_EIKONAL : TT_TABLE_METHOD_BENDING;
+	header->model    = ModelFingerprint;
+	header->sta_lon  = station->longitude;
+	header->sta_lat  = station->latitude;
+	header->sta_elev = station->elevation;
+	header->dlon     = HorizontalStep;
+	header->dlat     = HorizontalStep;
+	header->ddep     = VerticalStep;
+/* */
+	header->lon0 = station->longitude - TableRadius;
+	header->lat0 = station->latitude - TableRadius;
+	header->dep0 = 0.0;
+	lon1 = station->longitude + TableRadius;
+	lat1 = station->latitude + TableRadius;
+	dep1 = MAX_HYPO_DEPTH;
+	if ( header->lon0 < ModelRange[0] )
+		header->lon0 = ModelRange[0];
+	if ( lon1 > ModelRange[1] )
+		lon1 = ModelRange[1];
+	if ( header->lat0 < ModelRange[2] )
+		header->lat0 = ModelRange[2];
+	if ( lat1 > ModelRange[3] )
+		lat1 = ModelRange[3];
+	if ( header->dep0 < ModelRange[4] )
+		header->dep0 = ModelRange[4];
+	if ( dep1 > ModelRange[5] )
+		dep1 = ModelRange[5];
+/* At least two nodes in each axis */
+	if ( lon1 - header->lon0 >= HorizontalStep )
+		header->nlon = (uint32_t)((lon1 - header->lon0) / HorizontalStep + EARLYLOC_EPSILON) + 1;
+	if ( lat1 - header->lat0 >= HorizontalStep )
+		header->nlat = (uint32_t)((lat1 - header->lat0) / HorizontalStep + EARLYLOC_EPSILON) + 1;
+	if ( dep1 - header->dep0 >= VerticalStep )
+		header->ndep = (uint32_t)((dep1 - header->dep0) / VerticalStep + EARLYLOC_EPSILON) + 1;
+
+	return;
+}
+
+/**
+ * @brief Find the station by the key without the lock, the probing slot of the key will be returned by
+ *        the slot when it isn't NULL.
+ *
+ * @param key
+ * @param slot
+ * @return STATION_TABLE*
+ */
+static STATION_TABLE *find_station_table( const char *key, uint32_t *slot )
+{
+	STATION_TABLE *result;
+	uint64_t       hash = 0;
+	uint32_t       index;
+
+/* */
+	for ( const char *ptr = key; *ptr; ptr++ )
+		hash = (hash ^ (uint8_t)*ptr) * 0x9e3779b97f4a7c15ULL;
+	index = (uint32_t)(hash ^ (hash >> 29)) & (TABLE_HASH_SLOTS - 1);
+/* The hash is never full, so the probing will stop at the empty slot */
+	while ( (result = atomic_load_explicit(&Slots[index], memory_order_acquire)) ) {
+		if ( !strcmp(result->key, key) )
+			break;
+		index = (index + 1) & (TABLE_HASH_SLOTS - 1);
+	}
+	if ( slot )
+		*slot = index;
+
+	return result;
+}
+
+/**
+ * @brief Queue the new station for generating its table, the former one of the same key (which has been
+ *        moved) will be replaced & retired.
+ *
+ * @param key
+ * @param pick
+ */
+static void queue_station_table( const STATION_TABLE *key, const PICK_STATE *pick )
+{
+	STATION_TABLE *station;
+	STATION_TABLE *former;
+	uint32_t       slot;
+
+/* */
+	mtx_lock(&TableMutex);
+/* Someone else might have queued it */
+	if ( (former = find_station_table( key->key, &slot )) ) {
+		if (
+			(former->model == key->model && is_same_station( former, pick )) ||
+			atomic_load(&former->state) == TABLE_STATE_PENDING
+		) {
+			goto end_process;
+		}
+	/* The hypos of the former models shouldn't take it back */
+		if ( former->model != key->model && key->model != rt_velmod_fingerprint( el_velmod_get() ) )
+			goto end_process;
+	}
+	else if ( Stations >= TABLE_HASH_MAX_LOAD ) {
+		goto end_process;
+	}
+/* */
+	if ( (station = calloc(1, sizeof(STATION_TABLE))) == NULL )
+		goto end_process;
+	strcpy(station->key, key->key);
+	station->phase     = key->phase;
+	station->longitude = pick->observe.longitude;
+	station->latitude  = pick->observe.latitude;
+	station->elevation = pick->observe.elevation;
+	station->model     = key->model;
+	station->table     = NULL;
+	station->next      = NULL;
+	atomic_init(&station->state, TABLE_STATE_PENDING);
+	atomic_store_explicit(&Slots[slot], station, memory_order_release);
+/* The former one is no longer used by the generator, but the lookups might still read it */
+	if ( former ) {
+		if ( former->model == station->model )
+			logit("o", "earlyloc: Station %s has been moved, regenerate its travel time table.\n", station->key);
+		former->retired = time(NULL);
+		former->next    = RetiredHead;
+		RetiredHead     = former;
+	}
+	else {
+		Stations++;
+	}
+/* Append to the pending queue & wake up the generator */
+	if ( PendingTail )
+		PendingTail->next = station;
+	else
+		PendingHead = station;
+	PendingTail = station;
+	cnd_signal(&TableCond);
+
+end_process:
+	mtx_unlock(&TableMutex);
+
+	return;
+}
+
+/**
+ * @brief Switch the generator to the model which the station is requested with, it should be the current
+ *        one & the former one will be released. It's only called by the generator, so the model & its
+ *        settings are safe without lock.
+ *
+ * @param station
+ * @return int
+ */
+static int bind_station_model( const STATION_TABLE *station )
+{
+	const RT_VELMOD *model;
+	double           range[6];
+
+/* */
+	if ( station->model == ModelFingerprint )
+		return 0;
+	if ( (model = el_velmod_acquire()) == NULL )
+		return -1;
+/* The model has been replaced again, the station will be requested by the current one later */
+	if (
+		rt_velmod_fingerprint( model ) != station->model ||
+		rt_velmod_range( model, &range[0], &range[1], &range[2], &range[3], &range[4], &range[5] )
+	) {
+		el_velmod_release( model );
+		return -1;
+	}
+/* */
+	el_velmod_release( VelocityModel );
+	VelocityModel    = model;
+	ModelFingerprint = station->model;
+	memcpy(ModelRange, range, sizeof(ModelRange));
+	logit("o", "earlyloc: Travel time tables are switched to the reloaded 3D velocity model.\n");
+
+	return 0;
+}
+
+/**
+ * @brief Check if the table of the station is derived with the same coordinate of the pick.
+ *
+ * @param station
+ * @param pick
+ * @return int
+ */
+static int is_same_station( const STATION_TABLE *station, const PICK_STATE *pick )
+{
+	return
+		fabs(station->longitude - pick->observe.longitude) < STATION_COORD_TOLERANCE &&
+		fabs(station->latitude - pick->observe.latitude) < STATION_COORD_TOLERANCE &&
+		fabs(station->elevation - pick->observe.elevation) < STATION_ELEV_TOLERANCE;
+}
+
+/**
+ * @brief Free the retired stations which have passed the grace period, it should be called with the lock.
+ *        All of them will be freed when the now is 0.
+ *
+ * @param now
+ */
+static void free_retired_tables( const time_t now )
+{
+	STATION_TABLE **prev;
+	STATION_TABLE  *station;
+
+/* */
+	for ( prev = &RetiredHead; (station = *prev); ) {
+		if ( !now || now - station->retired >= TABLE_RETIRE_GRACE ) {
+			*prev = station->next;
+			free_station_table( station );
+		}
+		else {
+			prev = &station->next;
+		}
+	}
+
+	return;
+}
+
+/**
+ * @brief
+ *
+ * @param station
+ */
+static void free_station_table( STATION_TABLE *station )
+{
+	if ( station ) {
+		tt_table_close( station->table );
+		free(station);
+	}
+
+	return;
+}
@@ -0,0 +1,427 @@
+/**
+ * @file earlyloc_velmod.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief The shared 3D velocity model with the reference counting. Each hypo holds the model which
+ *        was current when it started locating, so the model could be reloaded by the background
+ *        thread & swapped in without restarting; the replaced model will be freed after the last
+ *        hypo using it is finished.
+ * @version 0.1
+ * @date 2023-10-27
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+/* Standard C header include */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <threads.h>
+#include <sys/stat.h>
+/* Earthworm environment header include */
+#include <earthworm.h>
+/* Local header include */
+#include <raytracing.h>
+#include <dl_chain_list.h>
+#include <earlyloc.h>
+#include <earlyloc_velmod.h>
+
+/* The number of the sampling points along each axis when validating the reloaded model */
+#define VALIDATE_SAMPLES  8
+
+/*
+ * The loaded model & its reference count, the current model also holds one reference by itself
+ */
+typedef struct velmod_ref {
+	RT_VELMOD         *model;
+	int                refs;
+	struct velmod_ref *next;
+} VELMOD_REF;
+
+/* */
+static int        thread_reloader( void * );
+static RT_VELMOD *load_new_model( void );
+static int        validate_model( const RT_VELMOD * );
+static int        swap_current_model( RT_VELMOD * );
+static RT_VELMOD *release_model( const RT_VELMOD * );
+static int        is_same_file( const struct stat *, const struct stat * );
+
+/* */
+static uint8_t      ModelReady   = 0;
+static uint8_t      ModelCompact = 0;
+static VELMOD_REF  *Current      = NULL;  /* NULL after freeing */
+static VELMOD_REF  *AliveModels  = NULL;  /* All the models still referenced, including the current one */
+static char         ModelPath[MAX_PATH_STR];
+static struct stat  ModelStat;
+static mtx_t        ModelMutex;
+/* The reloader */
+static uint8_t      ReloaderReady  = 0;
+static int          ReloadInterval = 0;
+static volatile int Terminate      = 0;
+static cnd_t        ReloadCond;
+static thrd_t       ReloaderTid;
+/* Statistics */
+static uint32_t     Reloads = 0;
+static uint32_t     Rejects = 0;
+
+/**
+ * @brief Load the 3D velocity model as the current one, it should be called before any thread is started.
+ *
+ * @param model_path
+ * @return int
+ */
+int el_velmod_load( const char *model_path )
+{
+	RT_VELMOD *model;
+
+/* */
+	if ( ModelReady || stat(model_path, &ModelStat) )
+		return -1;
+	if ( (model = rt_velmod_load( model_path )) == NULL )
+		return -1;
+	if ( mtx_init(&ModelMutex, mtx_plain) != thrd_success ) {
+		rt_velmod_free( model );
+		return -1;
+	}
+	if ( swap_current_model( model ) ) {
+		mtx_destroy(&ModelMutex);
+		rt_velmod_free( model );
+		return -1;
+	}
+	strcpy(ModelPath, model_path);
+	ModelReady = 1;
+
+	return 0;
+}
+
+/**
+ * @brief Switch the current model to the compact layout, it should be called before the model is used
+ *        by the other threads. The reloaded models will also be switched before swapping in.
+ *
+ * @return int
+ */
+int el_velmod_compact( void )
+{
+	if ( !ModelReady || !Current || rt_velmod_compact( Current->model ) )
+		return -1;
+	ModelCompact = 1;
+
+	return 0;
+}
+
+/**
+ * @brief Start the background reloader, it checks the model file every interval (in second) & reloads it
+ *        after the file has been replaced & stayed the same for one more interval.
+ *
+ * @param interval
+ * @return int
+ */
+int el_velmod_reload_init( const int interval )
+{
+	if ( !ModelReady || interval <= 0 )
+		return -1;
+	if ( ReloaderReady )
+		return 0;
+/* */
+	ReloadInterval = interval;
+	Terminate      = 0;
+	if ( cnd_init(&ReloadCond) != thrd_success )
+		return -1;
+	if ( thrd_create(&ReloaderTid, thread_reloader, NULL) != thrd_success ) {
+		cnd_destroy(&ReloadCond);
+		return -1;
+	}
+	ReloaderReady = 1;
+
+	return 0;
+}
+
+/**
+ * @brief Get the current model without holding it, it is only for checking whether the model is loaded.
+ *
+ * @return const RT_VELMOD*
+ */
+const RT_VELMOD *el_velmod_get( void )
+{
+	const RT_VELMOD *result = NULL;
+
+/* */
+	if ( ModelReady ) {
+		mtx_lock(&ModelMutex);
+		if ( Current )
+			result = Current->model;
+		mtx_unlock(&ModelMutex);
+	}
+
+	return result;
+}
+
+/**
+ * @brief Hold the current model, it won't be freed until it is released by el_velmod_release.
+ *
+ * @return const RT_VELMOD*
+ */
+const RT_VELMOD *el_velmod_acquire( void )
+{
+	const RT_VELMOD *result = NULL;
+
+/* */
+	if ( ModelReady ) {
+		mtx_lock(&ModelMutex);
+		if ( Current ) {
+			Current->refs++;
+			result = Current->model;
+		}
+		mtx_unlock(&ModelMutex);
+	}
+
+	return result;
+}
+
+/**
+ * @brief Release the model held by el_velmod_acquire, the model will be freed when it is no longer
+ *        the current one & nobody holds it.
+ *
+ * @param model
+ */
+void el_velmod_release( const RT_VELMOD *model )
+{
+	RT_VELMOD *_model;
+
+/* */
+	if ( !ModelReady || !model )
+		return;
+/* */
+	mtx_lock(&ModelMutex);
+	_model = release_model( model );
+	mtx_unlock(&ModelMutex);
+	rt_velmod_free( _model );
+
+	return;
+}
+
+/**
+ * @brief Stop the reloader & release the current model, the models still held by the running hypos
+ *        will be freed by their last release.
+ *
+ */
+void el_velmod_free( void )
+{
+	RT_VELMOD *model = NULL;
+
+/* */
+	if ( !ModelReady )
+		return;
+/* */
+	if ( ReloaderReady ) {
+		mtx_lock(&ModelMutex);
+		Terminate = 1;
+		cnd_signal(&ReloadCond);
+		mtx_unlock(&ModelMutex);
+		thrd_join(ReloaderTid, NULL);
+		cnd_destroy(&ReloadCond);
+		ReloaderReady = 0;
+		logit("o", "earlyloc: 3D velocity model has been reloaded %u time(s), %u rejected.\n", Reloads, Rejects);
+	}
+/* */
+	mtx_lock(&ModelMutex);
+	if ( Current ) {
+		model   = release_model( Current->model );
+		Current = NULL;
+	}
+	mtx_unlock(&ModelMutex);
+	rt_velmod_free( model );
+
+	return;
+}
+
+/**
+ * @brief The background reloader, the model file should be replaced by renaming, since the mapped
+ *        binary model can't be overwritten while it is in use.
+ *
+ * @param arg
+ * @return int
+ */
+static int thread_reloader( void *arg )
+{
+	struct stat     st;
+	struct stat     pending;
+	struct timespec until;
+	int             has_pending = 0;
+	RT_VELMOD      *model;
+
+/* */
+	mtx_lock(&ModelMutex);
+	while ( !Terminate ) {
+		timespec_get(&until, TIME_UTC);
+		until.tv_sec += ReloadInterval;
+		if ( cnd_timedwait(&ReloadCond, &ModelMutex, &until) != thrd_timedout )
+			continue;
+		mtx_unlock(&ModelMutex);
+	/* Wait for one more interval after the file changed, in case it is still being written */
+		if ( stat(ModelPath, &st) || is_same_file( &st, &ModelStat ) ) {
+			has_pending = 0;
+		}
+		else if ( !has_pending || !is_same_file( &st, &pending ) ) {
+			pending     = st;
+			has_pending = 1;
+		}
+		else {
+			has_pending = 0;
+			ModelStat   = st;
+			if ( (model = load_new_model()) ) {
+				if ( swap_current_model( model ) ) {
+					rt_velmod_free( model );
+					Rejects++;
+				}
+				else {
+					logit("ot", "earlyloc: 3D velocity model %s has been reloaded, new hypos will use it.\n", ModelPath);
+					Reloads++;
+				}
+			}
+			else {
+				Rejects++;
+			}
+		}
+		mtx_lock(&ModelMutex);
+	}
+	mtx_unlock(&ModelMutex);
+
+	return 0;
+}
+
+/**
+ * @brief Load & validate the model file, then switch it to the compact layout when the current one is.
+ *
+ * @return RT_VELMOD*
+ */
+static RT_VELMOD *load_new_model( void )
+{
+	RT_VELMOD *result;
+
+/* */
+	if ( (result = rt_velmod_load( ModelPath )) == NULL ) {
+		logit("et", "earlyloc: Error reading the updated 3D velocity model %s, keep the current one!\n", ModelPath);
+		return NULL;
+	}
+	if ( validate_model( result ) ) {
+		logit("et", "earlyloc: The updated 3D velocity model %s is invalid, keep the current one!\n", ModelPath);
+		rt_velmod_free( result );
+		return NULL;
+	}
+	if ( ModelCompact && rt_velmod_compact( result ) ) {
+		logit("et", "earlyloc: Error switching the updated 3D velocity model to the compact layout, keep the current one!\n");
+		rt_velmod_free( result );
+		return NULL;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Check the coverage of the model & the velocities sampled inside it, both the P & S velocities
+ *        should be finite & positive, and the S one should be slower.
+ *
+ * @param model
+ * @return int
+ */
+static int validate_model( const RT_VELMOD *model )
+{
+	double range[6];
+	double lon, lat, dep;
+	double vp, vs;
+
+/* */
+	if ( rt_velmod_range( model, &range[0], &range[1], &range[2], &range[3], &range[4], &range[5] ) )
+		return -1;
+	if ( !(range[1] > range[0]) || !(range[3] > range[2]) || !(range[5] > range[4]) )
+		return -1;
+/* */
+	for ( int i = 0; i < VALIDATE_SAMPLES; i++ ) {
+		lon = range[0] + (range[1] - range[0]) * (i + 0.5) / VALIDATE_SAMPLES;
+		for ( int j = 0; j < VALIDATE_SAMPLES; j++ ) {
+			lat = range[2] + (range[3] - range[2]) * (j + 0.5) / VALIDATE_SAMPLES;
+			for ( int k = 0; k < VALIDATE_SAMPLES; k++ ) {
+				dep = range[4] + (range[5] - range[4]) * (k + 0.5) / VALIDATE_SAMPLES;
+				vp  = rt_velmod_velocity( model, lat, lon, dep, RT_P_WAVE_VELOCITY );
+				vs  = rt_velmod_velocity( model, lat, lon, dep, RT_S_WAVE_VELOCITY );
+				if ( !isfinite(vp) || !isfinite(vs) || vs <= 0.0 || vs >= vp )
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Make the input model the current one, the reference of the former current model will be
+ *        released & it will be freed at once when nobody holds it.
+ *
+ * @param model
+ * @return int
+ */
+static int swap_current_model( RT_VELMOD *model )
+{
+	VELMOD_REF *ref;
+	RT_VELMOD  *_model = NULL;
+
+/* */
+	if ( (ref = calloc(1, sizeof(VELMOD_REF))) == NULL )
+		return -1;
+	ref->model = model;
+	ref->refs  = 1;
+/* */
+	mtx_lock(&ModelMutex);
+	ref->next   = AliveModels;
+	AliveModels = ref;
+	if ( Current )
+		_model = release_model( Current->model );
+	Current = ref;
+	mtx_unlock(&ModelMutex);
+	rt_velmod_free( _model );
+
+	return 0;
+}
+
+/**
+ * @brief Release one reference of the model, it should be called with the lock. It returns the model
+ *        which should be freed (after unlocking), or NULL when it is still held.
+ *
+ * @param model
+ * @return RT_VELMOD*
+ */
+static RT_VELMOD *release_model( const RT_VELMOD *model )
+{
+	VELMOD_REF **prev;
+	VELMOD_REF  *ref;
+	RT_VELMOD   *result = NULL;
+
+/* */
+	for ( prev = &AliveModels; (ref = *prev); prev = &ref->next ) {
+		if ( ref->model == model ) {
+			if ( --ref->refs <= 0 ) {
+				*prev  = ref->next;
+				result = ref->model;
+				free(ref);
+			}
+			break;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief
+ *
+ * @param a
+ * @param b
+ * @return int
+ */
+static int is_same_file( const struct stat *a, const struct stat *b )
+{
+	return a->st_ino == b->st_ino && a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
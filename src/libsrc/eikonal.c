@@ -0,0 +1,348 @@
+/**
+ * @file eikonal.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Travel time field of the point source by the fast sweeping method on the regular geographic grid.
+ *        The travel time is factored into the straight ray time of the source's slowness plus a smooth
+ *        correction (Luo, Qian & Burridge, 2014), which is solved by the first-order Godunov upwind scheme;
+ *        it removes the error from the source singularity. The eight sweeping orderings could be run by
+ *        several threads on their own copies then merged by the minimum (Zhao, 2007), therefore the
+ *        result only depends on the number of threads but not the scheduling.
+ * @version 0.1
+ * @date 2023-10-25
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <threads.h>
+/* */
+#include <eikonal.h>
+
+/* */
+#define EIK_KM_PER_DEG     111.19492664455873  /* 6371.0 * PI / 180.0 */
+#define EIK_DEG2RAD        0.017453292519943295
+#define EIK_INFINITY       1.0e+10
+#define EIK_MAX_ITERATION  32
+#define EIK_TOLERANCE      1.0e-5  /* In second */
+#define EIK_SOURCE_RADIUS  1       /* The nodes around the source (in nodes) which are initialized by the straight ray */
+#define EIK_SWEEP_NUMBER   8
+
+/* Sort the neighbor's travel time & its step together */
+#define SORT_NEIGHBOR_PAIR(__TT, __STEP, __A, __B) \
+		__extension__({ \
+			if ( (__TT)[(__A)] > (__TT)[(__B)] ) { \
+				const double _tt_in_macro = (__TT)[(__A)]; \
+				const double _step_in_macro = (__STEP)[(__A)]; \
+				(__TT)[(__A)] = (__TT)[(__B)]; \
+				(__TT)[(__B)] = _tt_in_macro; \
+				(__STEP)[(__A)] = (__STEP)[(__B)]; \
+				(__STEP)[(__B)] = _step_in_macro; \
+			} \
+		})
+
+/*
+ *
+ */
+typedef struct {
+	const EIK_GRID *grid;
+	const double   *slowness;
+	const double   *hlon;      /* The longitude step (in km) of each latitude */
+	double          hlat;
+	double          hdep;
+	double          src[3];    /* The source position in the unit of nodes */
+	double          src_slow;  /* The slowness at the source */
+	double         *tt;        /* The travel time correction field swept by this worker */
+	int             first;     /* The first sweeping ordering of this worker */
+	int             step;
+	double          change;    /* The maximum decrease of the travel time in this iteration */
+} SWEEP_WORKER;
+
+/* */
+static int    thread_sweep( void * );
+static double update_node( const SWEEP_WORKER *, const int, const int, const int, const size_t );
+static double get_straight_time( const SWEEP_WORKER *, const int, const int, const int, double [3] );
+
+/**
+ * @brief Solve the travel time field of the source within the velocity (km/s) field of the grid. By the reciprocity,
+ *        it also could be the travel time from every node to the receiver at the source. It returns the number of
+ *        iterations, or -1 when something error.
+ *
+ * @param grid
+ * @param velocity
+ * @param src_lon
+ * @param src_lat
+ * @param src_dep
+ * @param nthreads
+ * @param travel_time
+ * @return int
+ */
+int eik_solve(
+	const EIK_GRID *grid, const float *velocity, const double src_lon, const double src_lat, const double src_dep,
+	const int nthreads, float *travel_time
+) {
+	int           iter;
+	int           nworkers = nthreads < 1 ? 1 : nthreads > EIK_MAX_THREADS ? EIK_MAX_THREADS : nthreads;
+	int           result   = -1;
+	int           is, js, ks;
+	size_t        n;
+	double        change;
+	double        src[3];
+	double       *slowness = NULL;
+	double       *hlon     = NULL;
+	double       *tt       = NULL;
+	double       *copies   = NULL;
+	thrd_t        tids[EIK_MAX_THREADS];
+	int           created[EIK_MAX_THREADS];
+	SWEEP_WORKER  workers[EIK_MAX_THREADS];
+/* */
+	const size_t nodes = (size_t)grid->nlon * grid->nlat * grid->ndep;
+
+/* */
+	if ( grid->nlon < 2 || grid->nlat < 2 || grid->ndep < 2 )
+		return -1;
+	if (
+		!(slowness = malloc(sizeof(double) * nodes)) || !(tt = malloc(sizeof(double) * nodes)) ||
+		!(hlon = malloc(sizeof(double) * grid->nlat))
+	) {
+		goto end_process;
+	}
+	if ( nworkers > 1 && !(copies = malloc(sizeof(double) * nodes * nworkers)) )
+		goto end_process;
+/* */
+	for ( size_t i = 0; i < nodes; i++ )
+		slowness[i] = velocity[i] > 0.0f ? 1.0 / velocity[i] : EIK_INFINITY;
+	for ( int j = 0; j < grid->nlat; j++ )
+		hlon[j] = grid->dlon * EIK_KM_PER_DEG * cos((grid->lat0 + j * grid->dlat) * EIK_DEG2RAD);
+/* The nearest node of the source, it might be outside of the grid (e.g. the receiver above the sea level) */
+	src[0] = (src_lon - grid->lon0) / grid->dlon;
+	src[1] = (src_lat - grid->lat0) / grid->dlat;
+	src[2] = (src_dep - grid->dep0) / grid->ddep;
+	is = (int)lround(src[0]);
+	js = (int)lround(src[1]);
+	ks = (int)lround(src[2]);
+	is = is < 0 ? 0 : is >= grid->nlon ? grid->nlon - 1 : is;
+	js = js < 0 ? 0 : js >= grid->nlat ? grid->nlat - 1 : js;
+	ks = ks < 0 ? 0 : ks >= grid->ndep ? grid->ndep - 1 : ks;
+/* The correction around the source is zero, the others will be infinity */
+	for ( size_t i = 0; i < nodes; i++ )
+		tt[i] = EIK_INFINITY;
+	for ( int k = ks - EIK_SOURCE_RADIUS; k <= ks + EIK_SOURCE_RADIUS; k++ )
+		for ( int j = js - EIK_SOURCE_RADIUS; j <= js + EIK_SOURCE_RADIUS; j++ )
+			for ( int i = is - EIK_SOURCE_RADIUS; i <= is + EIK_SOURCE_RADIUS; i++ )
+				if ( i >= 0 && i < grid->nlon && j >= 0 && j < grid->nlat && k >= 0 && k < grid->ndep )
+					tt[i + (size_t)grid->nlon * (j + (size_t)grid->nlat * k)] = 0.0;
+/* */
+	for ( int i = 0; i < nworkers; i++ ) {
+		workers[i].grid     = grid;
+		workers[i].slowness = slowness;
+		workers[i].hlon     = hlon;
+		workers[i].hlat     = grid->dlat * EIK_KM_PER_DEG;
+		workers[i].hdep     = grid->ddep;
+		workers[i].src[0]   = src[0];
+		workers[i].src[1]   = src[1];
+		workers[i].src[2]   = src[2];
+		workers[i].src_slow = slowness[is + (size_t)grid->nlon * (js + (size_t)grid->nlat * ks)];
+		workers[i].tt       = copies ? copies + nodes * i : tt;
+		workers[i].first    = i;
+		workers[i].step     = nworkers;
+	}
+/* */
+	for ( iter = 1; iter <= EIK_MAX_ITERATION; iter++ ) {
+		if ( nworkers == 1 ) {
+		/* The classic Gauss-Seidel sweeping in place */
+			thread_sweep( &workers[0] );
+			change = workers[0].change;
+		}
+		else {
+			for ( int i = 0; i < nworkers; i++ ) {
+				memcpy(workers[i].tt, tt, sizeof(double) * nodes);
+				created[i] = thrd_create(&tids[i], thread_sweep, &workers[i]) == thrd_success;
+			}
+			for ( int i = 0; i < nworkers; i++ ) {
+				if ( created[i] )
+					thrd_join(tids[i], NULL);
+				else
+					thread_sweep( &workers[i] );
+			}
+		/* Merge by the minimum, it is independent of the order */
+			change = 0.0;
+			for ( int i = 0; i < nworkers; i++ ) {
+				const double *_tt = workers[i].tt;
+				for ( n = 0; n < nodes; n++ ) {
+					if ( _tt[n] < tt[n] ) {
+						if ( tt[n] - _tt[n] > change )
+							change = tt[n] - _tt[n];
+						tt[n] = _tt[n];
+					}
+				}
+			}
+		}
+	/* */
+		if ( change < EIK_TOLERANCE )
+			break;
+	}
+/* Add back the straight ray time */
+	n = 0;
+	for ( int k = 0; k < grid->ndep; k++ )
+		for ( int j = 0; j < grid->nlat; j++ )
+			for ( int i = 0; i < grid->nlon; i++, n++ )
+				travel_time[n] = tt[n] < EIK_INFINITY ? (float)(get_straight_time( &workers[0], i, j, k, NULL ) + tt[n]) : -1.0f;
+	result = iter > EIK_MAX_ITERATION ? EIK_MAX_ITERATION : iter;
+
+end_process:
+	free(slowness);
+	free(hlon);
+	free(tt);
+	free(copies);
+
+	return result;
+}
+
+/**
+ * @brief Sweep the whole grid by the orderings of this worker, the bits of the ordering number are
+ *        the direction of longitude, latitude & depth.
+ *
+ * @param arg
+ * @return int
+ */
+static int thread_sweep( void *arg )
+{
+	SWEEP_WORKER   *worker = (SWEEP_WORKER *)arg;
+	const EIK_GRID *grid   = worker->grid;
+	double         *tt     = worker->tt;
+	double          _tt;
+	int             i, j, k;
+	size_t          n;
+
+/* */
+	worker->change = 0.0;
+	for ( int order = worker->first; order < EIK_SWEEP_NUMBER; order += worker->step ) {
+		const int si = order & 0x01 ? -1 : 1;
+		const int sj = order & 0x02 ? -1 : 1;
+		const int sk = order & 0x04 ? -1 : 1;
+	/* */
+		for ( int _k = 0; _k < grid->ndep; _k++ ) {
+			k = sk > 0 ? _k : grid->ndep - 1 - _k;
+			for ( int _j = 0; _j < grid->nlat; _j++ ) {
+				j = sj > 0 ? _j : grid->nlat - 1 - _j;
+				for ( int _i = 0; _i < grid->nlon; _i++ ) {
+					i = si > 0 ? _i : grid->nlon - 1 - _i;
+					n = i + (size_t)grid->nlon * (j + (size_t)grid->nlat * k);
+					if ( (_tt = update_node( worker, i, j, k, n )) < tt[n] ) {
+						if ( tt[n] - _tt > worker->change )
+							worker->change = tt[n] - _tt;
+						tt[n] = _tt;
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief The Godunov upwind update of the correction of single node with different steps in each axis.
+ *        Along each axis, the derivative of the total time is the straight ray's plus the correction's
+ *        one-sided difference, which could be written as (t - a) / h where a is the neighbor's correction
+ *        shifted by the straight ray's slope; then it is exactly the same as the unfactored update.
+ *
+ * @param worker
+ * @param i
+ * @param j
+ * @param k
+ * @param n
+ * @return double
+ */
+static double update_node( const SWEEP_WORKER *worker, const int i, const int j, const int k, const size_t n )
+{
+	const EIK_GRID *grid = worker->grid;
+	const double   *tt   = worker->tt;
+	const size_t    nx   = grid->nlon;
+	const size_t    nxy  = nx * grid->nlat;
+	const double    s    = worker->slowness[n];
+	double          a[3], h[3], p[3];
+	double          w, tmp, sum_w, sum_wa, sum_waa;
+	double          result;
+
+/* */
+	get_straight_time( worker, i, j, k, p );
+	h[0] = worker->hlon[j];
+	h[1] = worker->hlat;
+	h[2] = worker->hdep;
+/* The minimum shifted neighbor along each axis */
+	a[0] = EIK_INFINITY;
+	if ( i > 0 && tt[n - 1] < EIK_INFINITY )
+		a[0] = tt[n - 1] - h[0] * p[0];
+	if ( i < grid->nlon - 1 && tt[n + 1] < EIK_INFINITY && (tmp = tt[n + 1] + h[0] * p[0]) < a[0] )
+		a[0] = tmp;
+	a[1] = EIK_INFINITY;
+	if ( j > 0 && tt[n - nx] < EIK_INFINITY )
+		a[1] = tt[n - nx] - h[1] * p[1];
+	if ( j < grid->nlat - 1 && tt[n + nx] < EIK_INFINITY && (tmp = tt[n + nx] + h[1] * p[1]) < a[1] )
+		a[1] = tmp;
+	a[2] = EIK_INFINITY;
+	if ( k > 0 && tt[n - nxy] < EIK_INFINITY )
+		a[2] = tt[n - nxy] - h[2] * p[2];
+	if ( k < grid->ndep - 1 && tt[n + nxy] < EIK_INFINITY && (tmp = tt[n + nxy] + h[2] * p[2]) < a[2] )
+		a[2] = tmp;
+/* Sort by the shifted neighbor */
+	SORT_NEIGHBOR_PAIR( a, h, 0, 1 );
+	SORT_NEIGHBOR_PAIR( a, h, 1, 2 );
+	SORT_NEIGHBOR_PAIR( a, h, 0, 1 );
+/* One dimensional */
+	if ( a[0] >= EIK_INFINITY )
+		return EIK_INFINITY;
+	result  = a[0] + s * h[0];
+	w       = 1.0 / (h[0] * h[0]);
+	sum_w   = w;
+	sum_wa  = w * a[0];
+	sum_waa = w * a[0] * a[0];
+/* Include the next axis when the result is still later than its neighbor */
+	for ( int m = 1; m < 3 && result > a[m]; m++ ) {
+		w        = 1.0 / (h[m] * h[m]);
+		sum_w   += w;
+		sum_wa  += w * a[m];
+		sum_waa += w * a[m] * a[m];
+		if ( (tmp = sum_wa * sum_wa - sum_w * (sum_waa - s * s)) < 0.0 )
+			break;
+		result = (sum_wa + sqrt(tmp)) / sum_w;
+	}
+
+	return result;
+}
+
+/**
+ * @brief The straight ray time with the source's slowness of the node & its gradient (in second per km),
+ *        in the local flat frame around the source.
+ *
+ * @param worker
+ * @param i
+ * @param j
+ * @param k
+ * @param gradient
+ * @return double
+ */
+static double get_straight_time( const SWEEP_WORKER *worker, const int i, const int j, const int k, double gradient[3] )
+{
+	const double dx = (i - worker->src[0]) * worker->hlon[j];
+	const double dy = (j - worker->src[1]) * worker->hlat;
+	const double dz = (k - worker->src[2]) * worker->hdep;
+	const double r  = sqrt(dx * dx + dy * dy + dz * dz);
+
+/* */
+	if ( gradient ) {
+		if ( r > 0.0 ) {
+			gradient[0] = worker->src_slow * dx / r;
+			gradient[1] = worker->src_slow * dy / r;
+			gradient[2] = worker->src_slow * dz / r;
+		}
+		else {
+			gradient[0] = gradient[1] = gradient[2] = 0.0;
+		}
+	}
+
+	return worker->src_slow * r;
+}
@@ -11,6 +11,8 @@
 
 /* */
 #define MATRIX_DIAG_EPS  1.0e-5
+/* The tile size (in elements) of the blocked multiplication, three tiles are about 96 KiB */
+#define MATRIX_BLOCK_SIZE  64
 
 #define ARE_SAME_SIZE( _MATRIX_A, _MATRIX_B ) \
 		((_MATRIX_A)->i == (_MATRIX_B)->i && (_MATRIX_A)->j == (_MATRIX_B)->j)
@@ -26,8 +28,49 @@
 						(_MATRIX)->element[i * (_MATRIX)->j + i] += (_MATRIX)->element[i * (_MATRIX)->j + i] > 0.0 ? MATRIX_DIAG_EPS : -MATRIX_DIAG_EPS; \
 		})
 
+/* The number of the systems factored together by the batched solver, the temporaries are kept in L1 */
+#define MATRIX_BATCH_CHUNK  64
+/* The pivot of the batched LDLt below this ratio of its original diagonal is treated as rank deficient */
+#define MATRIX_BATCH_RANK_EPS  1.0e-12
+/* The index of the element (r, c) within the batched systems */
+#define BATCH_ELEMENT( _R, _C )  ((_R) * MATRIX_BATCH_RANK + (_C))
+
+/* The number of the doubles taken by the matrix header within the workspace */
+#define WORKSPACE_HEADER_SLOTS  ((long)((sizeof(MATRIX) + sizeof(double) - 1) / sizeof(double)))
+
+/*
+ * The block of the workspace, the blocks after the current one are always unused
+ */
+typedef struct matrix_ws_block {
+	struct matrix_ws_block *next;
+	long                    size;
+	long                    used;
+	double                  pool[];
+} MATRIX_WS_BLOCK;
+
+/*
+ * The position of the workspace, the temporaries taken after it will be given back by rewinding
+ */
+typedef struct {
+	MATRIX_WS_BLOCK *block;
+	long             used;
+} MATRIX_WS_MARK;
+
+/* */
+struct matrix_workspace {
+	MATRIX_WS_BLOCK *first;
+	MATRIX_WS_BLOCK *current;
+};
+
 /***/
-static MATRIX *duplicate_matrix( const MATRIX * );
+static void fused_normal_equations( MATRIX *, MATRIX *, const MATRIX *, const double *, const int, const MATRIX * );
+static MATRIX *solve_normal_equations(
+	MATRIX *, const MATRIX *, const MATRIX *, const double *, const int, const double, MATRIX_WORKSPACE *
+);
+static void solve_batch_chunk( MATRIX_BATCH *, const int, const int );
+static MATRIX_WS_BLOCK *new_workspace_block( const long );
+static MATRIX_WORKSPACE *enter_workspace( MATRIX_WORKSPACE *, MATRIX_WS_MARK *, const long );
+static void leave_workspace( MATRIX_WORKSPACE *, MATRIX_WORKSPACE *, const MATRIX_WS_MARK * );
 
 /***/
 MATRIX *matrix_new( const int row, const int column ) {
@@ -86,16 +129,40 @@ MATRIX *matrix_sub( const MATRIX *a, const MATRIX *b ) {
 
 /***/
 MATRIX *matrix_mul( const MATRIX *a, const MATRIX *b ) {
-	double  tmp;
 	MATRIX *res = NULL;
 
-	if ( a->j == b->i && (res = matrix_new( a->i, b->j )) ) {
-		for ( int i = 0; i < a->i; i++ ) {
-			for ( int k = 0; k < a->j; k++ ) {
-				if ( fabs(tmp = a->element[i * a->j + k]) > DBL_EPSILON ) {
-					for ( int j = 0; j < b->j; j++ ) {
-						if ( fabs(b->element[k * b->j + j]) > DBL_EPSILON )
-							res->element[i * b->j + j] += tmp * b->element[k * b->j + j];
+	if ( a->j == b->i && (res = matrix_new( a->i, b->j )) )
+		matrix_mul_into( res, a, b );
+
+	return res;
+}
+
+/*
+ * The result should be a->i x b->j & not be the same one as the inputs. It is blocked for the cache &
+ * the innermost loop is branch-free along the rows, so it could be vectorized by the compiler.
+ */
+MATRIX *matrix_mul_into( MATRIX *res, const MATRIX *a, const MATRIX *b ) {
+	const int rows = a->i;
+	const int cols = b->j;
+	const int inner = a->j;
+
+	if ( a->j != b->i || res->i != a->i || res->j != b->j )
+		return NULL;
+/* */
+	memset(res->element, 0, res->total * sizeof(double));
+	for ( int ii = 0; ii < rows; ii += MATRIX_BLOCK_SIZE ) {
+		const int iend = ii + MATRIX_BLOCK_SIZE < rows ? ii + MATRIX_BLOCK_SIZE : rows;
+		for ( int kk = 0; kk < inner; kk += MATRIX_BLOCK_SIZE ) {
+			const int kend = kk + MATRIX_BLOCK_SIZE < inner ? kk + MATRIX_BLOCK_SIZE : inner;
+			for ( int jj = 0; jj < cols; jj += MATRIX_BLOCK_SIZE ) {
+				const int jend = jj + MATRIX_BLOCK_SIZE < cols ? jj + MATRIX_BLOCK_SIZE : cols;
+				for ( int i = ii; i < iend; i++ ) {
+					double *restrict _res = res->element + (long)i * cols;
+					for ( int k = kk; k < kend; k++ ) {
+						const double          tmp = a->element[(long)i * inner + k];
+						const double *restrict _b = b->element + (long)k * cols;
+						for ( int j = jj; j < jend; j++ )
+							_res[j] += tmp * _b[j];
 					}
 				}
 			}
@@ -105,6 +172,46 @@ MATRIX *matrix_mul( const MATRIX *a, const MATRIX *b ) {
 	return res;
 }
 
+/*
+ * The result should be a->j x b->j, it is the transpose of a times b without forming the transpose
+ */
+MATRIX *matrix_mul_tn_into( MATRIX *res, const MATRIX *a, const MATRIX *b ) {
+	const int rows = a->j;
+	const int cols = b->j;
+
+	if ( a->i != b->i || res->i != a->j || res->j != b->j )
+		return NULL;
+/* Accumulate the outer products of the rows, the input rows are read once & in order */
+	memset(res->element, 0, res->total * sizeof(double));
+	for ( int k = 0; k < a->i; k++ ) {
+		const double *restrict _a = a->element + (long)k * rows;
+		const double *restrict _b = b->element + (long)k * cols;
+		for ( int i = 0; i < rows; i++ ) {
+			double *restrict _res = res->element + (long)i * cols;
+			const double     tmp  = _a[i];
+			for ( int j = 0; j < cols; j++ )
+				_res[j] += tmp * _b[j];
+		}
+	}
+
+	return res;
+}
+
+/*
+ * The normal equations of the least square with the diagonal weights, GtDG & GtDd, in one pass over the
+ * rows of G & d. The weights could be NULL for the identity, & GtDd (with d) could be NULL for skipping.
+ */
+MATRIX *matrix_gtdg_into( MATRIX *gtdg, MATRIX *gtdd, const MATRIX *g, const double *diag, const MATRIX *d ) {
+	if ( gtdg->i != g->j || gtdg->j != g->j )
+		return NULL;
+	if ( gtdd && (!d || d->i != g->i || gtdd->i != g->j || gtdd->j != d->j) )
+		return NULL;
+/* */
+	fused_normal_equations( gtdg, gtdd, g, diag, 1, d );
+
+	return gtdg;
+}
+
 /*
 MATRIX *matrix_mul_simd( const MATRIX *a, const MATRIX *b ) {
 	int     i, j, k;
@@ -139,11 +246,20 @@ MATRIX *matrix_mul_simd( const MATRIX *a, const MATRIX *b ) {
 MATRIX *matrix_transpose( const MATRIX *a ) {
 	MATRIX *res = matrix_new( a->j, a->i );
 
-	if ( res ) {
-		for ( int i = 0; i < a->i; i++ )
-			for ( int j = 0; j < a->j; j++ )
-				res->element[j * a->i + i] = a->element[i * a->j + j];
-	}
+	if ( res )
+		matrix_transpose_into( res, a );
+
+	return res;
+}
+
+/* The result should be a->j x a->i & not be the same one as the input */
+MATRIX *matrix_transpose_into( MATRIX *res, const MATRIX *a ) {
+	if ( res->i != a->j || res->j != a->i )
+		return NULL;
+/* */
+	for ( int i = 0; i < a->i; i++ )
+		for ( int j = 0; j < a->j; j++ )
+			res->element[j * a->i + i] = a->element[i * a->j + j];
 
 	return res;
 }
@@ -167,146 +283,198 @@ MATRIX *matrix_adjugate( const MATRIX *a ) {
 /***/
 MATRIX *matrix_inverse( const MATRIX *a ) 
 {
-	int     prow = 0;
-	double  pivot;
 	MATRIX *res = NULL;
-	MATRIX *tmp = NULL;
 
-	if ( IS_SQUARE( a ) ) {
-		tmp = duplicate_matrix( a );
-		res = matrix_identity( a->i );
+	if ( IS_SQUARE( a ) && (res = matrix_new( a->i, a->j )) ) {
+		if ( !matrix_inverse_into( res, a, NULL ) ) {
+			matrix_free( res );
+			res = NULL;
+		}
+	}
 
-		for ( int i = 0; i < a->i; i++ ) {
-		/* */
-			pivot = tmp->element[i * a->j + i];
-			prow = i;
-			for ( int j = i + 1; j < a->i; j++ ) {
-				if ( tmp->element[j * a->j + i] > pivot ) {
-					pivot = tmp->element[j * a->j + i];
-					prow  = j;
-				}
-			}
-		/* */
-			if ( prow != i ) {
-				for ( int j = 0; j < a->j; j++ ) {
-				/* */
-					pivot                         = tmp->element[i * a->j + j];
-					tmp->element[i * a->j + j]    = tmp->element[prow * a->j + j];
-					tmp->element[prow * a->j + j] = pivot;
-				/* */
-					pivot                         = res->element[i * a->j + j];
-					res->element[i * a->j + j]    = res->element[prow * a->j + j];
-					res->element[prow * a->j + j] = pivot;
-				}
+	return res;
+}
+
+/* The result should be the same size as the input, & it could be the input itself */
+MATRIX *matrix_inverse_into( MATRIX *res, const MATRIX *a, MATRIX_WORKSPACE *ws ) 
+{
+	int               prow = 0;
+	double            pivot;
+	MATRIX           *tmp = NULL;
+	MATRIX_WORKSPACE *_ws;
+	MATRIX_WS_MARK    mark;
+
+	if ( !IS_SQUARE( a ) || !ARE_SAME_SIZE( res, a ) )
+		return NULL;
+	if ( !(_ws = enter_workspace( ws, &mark, a->total + WORKSPACE_HEADER_SLOTS )) )
+		return NULL;
+	if ( !(tmp = matrix_workspace_get( _ws, a->i, a->j )) ) {
+		leave_workspace( ws, _ws, &mark );
+		return NULL;
+	}
+/* */
+	memcpy(tmp->element, a->element, a->total * sizeof(double));
+	memset(res->element, 0, res->total * sizeof(double));
+	for ( long i = 0; i < res->total; i += res->j + 1 )
+		res->element[i] = 1.0;
+/* */
+	for ( int i = 0; i < a->i; i++ ) {
+	/* */
+		pivot = tmp->element[i * a->j + i];
+		prow = i;
+		for ( int j = i + 1; j < a->i; j++ ) {
+			if ( tmp->element[j * a->j + i] > pivot ) {
+				pivot = tmp->element[j * a->j + i];
+				prow  = j;
 			}
-		/* */
-			pivot = tmp->element[i * a->j + i];
+		}
+	/* */
+		if ( prow != i ) {
 			for ( int j = 0; j < a->j; j++ ) {
 			/* */
-				tmp->element[i * a->j + j] /= pivot;
+				pivot                         = tmp->element[i * a->j + j];
+				tmp->element[i * a->j + j]    = tmp->element[prow * a->j + j];
+				tmp->element[prow * a->j + j] = pivot;
 			/* */
-				res->element[i * a->j + j] /= pivot;
+				pivot                         = res->element[i * a->j + j];
+				res->element[i * a->j + j]    = res->element[prow * a->j + j];
+				res->element[prow * a->j + j] = pivot;
 			}
+		}
+	/* */
+		pivot = tmp->element[i * a->j + i];
+		for ( int j = 0; j < a->j; j++ ) {
 		/* */
-			for ( int j = i + 1; j < a->i; j++ ) {
-				pivot = tmp->element[j * a->j + i];
-				if ( fabs(pivot) > DBL_EPSILON ) {
-					for ( int k = 0; k < a->j; k++ ) {
-					/* */
-						if ( fabs(tmp->element[i * a->j + k]) > DBL_EPSILON )
-							tmp->element[j * a->j + k] -= pivot * tmp->element[i * a->j + k];
-					/* */
-						if ( fabs(res->element[i * a->j + k]) > DBL_EPSILON )
-							res->element[j * a->j + k] -= pivot * res->element[i * a->j + k];
-					}
+			tmp->element[i * a->j + j] /= pivot;
+		/* */
+			res->element[i * a->j + j] /= pivot;
+		}
+	/* */
+		for ( int j = i + 1; j < a->i; j++ ) {
+			pivot = tmp->element[j * a->j + i];
+			if ( fabs(pivot) > DBL_EPSILON ) {
+				for ( int k = 0; k < a->j; k++ ) {
+				/* */
+					if ( fabs(tmp->element[i * a->j + k]) > DBL_EPSILON )
+						tmp->element[j * a->j + k] -= pivot * tmp->element[i * a->j + k];
+				/* */
+					if ( fabs(res->element[i * a->j + k]) > DBL_EPSILON )
+						res->element[j * a->j + k] -= pivot * res->element[i * a->j + k];
 				}
 			}
 		}
-	/* */
-		prow = a->i - 1;
-		for ( int i = 0; i < prow; i++ ) {
-			for ( int j = i + 1; j < a->i; j++ ) {
-				pivot = tmp->element[i * a->j + j];
-				if ( fabs(pivot) > DBL_EPSILON ) {
-					for ( int k = 0; k < a->j; k++ ) {
-					/* */
-						if ( fabs(tmp->element[j * a->j + k]) > DBL_EPSILON )
-							tmp->element[i * a->j + k] -= pivot * tmp->element[j * a->j + k];
-					/* */
-						if ( fabs(res->element[j * a->j + k]) > DBL_EPSILON )
-							res->element[i * a->j + k] -= pivot * res->element[j* a->j + k];
-					}
+	}
+/* */
+	prow = a->i - 1;
+	for ( int i = 0; i < prow; i++ ) {
+		for ( int j = i + 1; j < a->i; j++ ) {
+			pivot = tmp->element[i * a->j + j];
+			if ( fabs(pivot) > DBL_EPSILON ) {
+				for ( int k = 0; k < a->j; k++ ) {
+				/* */
+					if ( fabs(tmp->element[j * a->j + k]) > DBL_EPSILON )
+						tmp->element[i * a->j + k] -= pivot * tmp->element[j * a->j + k];
+				/* */
+					if ( fabs(res->element[j * a->j + k]) > DBL_EPSILON )
+						res->element[i * a->j + k] -= pivot * res->element[j* a->j + k];
 				}
 			}
 		}
-	/* */
-		matrix_free( tmp );
 	}
+/* */
+	leave_workspace( ws, _ws, &mark );
 
 	return res;
 }
 
 /* Least square */
 MATRIX *matrix_div( const MATRIX *a, const MATRIX *b ) {
-	MATRIX *gt;
-	MATRIX *gtg;
-	MATRIX *gtd;
-	MATRIX *igtg;
-	MATRIX *res;
-
-/* */
-	gt  = matrix_transpose( b );
-	gtg = matrix_mul( gt, b );
-	gtd = matrix_mul( gt, a );
-/* */
-	ADD_EPS_TO_DIAG( gtg );
-	igtg = matrix_inverse( gtg );
-	res  = matrix_mul( igtg, gtd );
+	MATRIX *res = NULL;
 
-	matrix_free( gt );
-	matrix_free( gtg );
-	matrix_free( gtd );
-	matrix_free( igtg );
+	if ( a->i == b->i && (res = matrix_new( b->j, a->j )) ) {
+		if ( !matrix_div_into( res, a, b, NULL ) ) {
+			matrix_free( res );
+			res = NULL;
+		}
+	}
 
 	return res;
 }
 
+/* The result should be b->j x a->j, the temporaries are taken from the workspace (or the heap when it is NULL) */
+MATRIX *matrix_div_into( MATRIX *res, const MATRIX *a, const MATRIX *b, MATRIX_WORKSPACE *ws ) {
+	return solve_normal_equations( res, a, b, NULL, 0, 0.0, ws );
+}
+
 /*
  *
  */
 MATRIX *matrix_div_weighted( const MATRIX *a, const MATRIX *b, const MATRIX *w ) {
-	MATRIX *wg;
-	MATRIX *gtw;
-	MATRIX *gtwg;
-	MATRIX *gtwd;
-	MATRIX *igtwg;
-	MATRIX *res;
+	return matrix_div_weighted_damped( a, b, w, 0.0 );
+}
 
-/* */
-	wg = duplicate_matrix( b );
-	for ( int i = 0; i < wg->i; i++ ) {
-		double tmp = w->element[i * w->j + i];
-		for ( int j = 0; j < wg->j; j++ ) 
-			wg->element[i * wg->j + j] *= tmp;
+/*
+ *
+ */
+MATRIX *matrix_div_weighted_into( MATRIX *res, const MATRIX *a, const MATRIX *b, const MATRIX *w, MATRIX_WORKSPACE *ws ) {
+	return matrix_div_weighted_damped_into( res, a, b, w, 0.0, ws );
+}
+
+/*
+ * Levenberg-Marquardt style, the diagonal of GtWG will be scaled by (1 + damping)
+ */
+MATRIX *matrix_div_weighted_damped( const MATRIX *a, const MATRIX *b, const MATRIX *w, const double damping ) {
+	MATRIX *res = NULL;
+
+	if ( a->i == b->i && (res = matrix_new( b->j, a->j )) ) {
+		if ( !matrix_div_weighted_damped_into( res, a, b, w, damping, NULL ) ) {
+			matrix_free( res );
+			res = NULL;
+		}
 	}
-/* */
-	gtw  = matrix_transpose( wg );
-	gtwg = matrix_mul( gtw, b );
-	gtwd = matrix_mul( gtw, a );
-/* */
-	ADD_EPS_TO_DIAG( gtwg );
-	igtwg = matrix_inverse( gtwg );
-	res   = matrix_mul( igtwg, gtwd );
-/* */
-	matrix_free( wg );
-	matrix_free( gtw );
-	matrix_free( gtwg );
-	matrix_free( gtwd );
-	matrix_free( igtwg );
 
 	return res;
 }
 
+/*
+ * The result should be b->j x a->j, the temporaries are taken from the workspace (or the heap when it is NULL)
+ */
+MATRIX *matrix_div_weighted_damped_into(
+	MATRIX *res, const MATRIX *a, const MATRIX *b, const MATRIX *w, const double damping, MATRIX_WORKSPACE *ws
+) {
+	if ( w->i != b->i || !IS_SQUARE( w ) )
+		return NULL;
+/* Only the diagonal of the weighting matrix is used */
+	return solve_normal_equations( res, a, b, w->element, w->j + 1, damping, ws );
+}
+
+/*
+ * The same as matrix_div_weighted_damped but the weights are the vector (b->i elements) instead of the
+ * diagonal matrix. Each column of a is one right-hand side, all of them are solved at once by the same
+ * normal matrix, so the batch costs one GtWG & one inversion.
+ */
+MATRIX *matrix_div_weighted_vector( const MATRIX *a, const MATRIX *b, const double *w, const double damping ) {
+	MATRIX *res = NULL;
+
+	if ( a->i == b->i && (res = matrix_new( b->j, a->j )) ) {
+		if ( !matrix_div_weighted_vector_into( res, a, b, w, damping, NULL ) ) {
+			matrix_free( res );
+			res = NULL;
+		}
+	}
+
+	return res;
+}
+
+/*
+ * The result should be b->j x a->j, the temporaries are taken from the workspace (or the heap when it is NULL)
+ */
+MATRIX *matrix_div_weighted_vector_into(
+	MATRIX *res, const MATRIX *a, const MATRIX *b, const double *w, const double damping, MATRIX_WORKSPACE *ws
+) {
+	return solve_normal_equations( res, a, b, w, 1, damping, ws );
+}
+
 /* Assignment functions */
 
 /***/
@@ -488,12 +656,392 @@ void matrix_free( MATRIX *a )
 }
 
 /***/
-static MATRIX *duplicate_matrix( const MATRIX *src ) 
+MATRIX_WORKSPACE *matrix_workspace_new( const long size ) 
+{
+	MATRIX_WORKSPACE *res = (MATRIX_WORKSPACE *)calloc(1, sizeof(MATRIX_WORKSPACE));
+
+	if ( res && size > 0 ) {
+		if ( !(res->first = new_workspace_block( size )) ) {
+			free(res);
+			res = NULL;
+		}
+		else {
+			res->current = res->first;
+		}
+	}
+
+	return res;
+}
+
+/* The zeroed matrix from the workspace, it should not be freed by matrix_free */
+MATRIX *matrix_workspace_get( MATRIX_WORKSPACE *ws, const int row, const int column ) 
+{
+	const long       size  = WORKSPACE_HEADER_SLOTS + (long)row * column;
+	MATRIX_WS_BLOCK *block = ws->current;
+	MATRIX_WS_BLOCK *last  = NULL;
+	MATRIX          *res;
+	long             total = 0;
+
+/* The current block is full, try the following (unused) ones or append the new one */
+	if ( !block || block->size - block->used < size ) {
+		for ( block = ws->first; block; last = block, block = block->next )
+			total += block->size;
+		for ( block = ws->current ? ws->current->next : NULL; block && block->size < size; block = block->next );
+		if ( !block ) {
+			if ( !(block = new_workspace_block( total > size ? total : size )) )
+				return NULL;
+			if ( last )
+				last->next = block;
+			else
+				ws->first = block;
+		}
+		ws->current = block;
+	}
+/* */
+	res = (MATRIX *)(block->pool + block->used);
+	block->used += size;
+	res->i       = row;
+	res->j       = column;
+	res->total   = (long)row * column;
+	res->element = (double *)res + WORKSPACE_HEADER_SLOTS;
+	memset(res->element, 0, res->total * sizeof(double));
+
+	return res;
+}
+
+/* All the matrices taken from the workspace will be given back, & the blocks will be merged into one */
+void matrix_workspace_reset( MATRIX_WORKSPACE *ws ) 
+{
+	MATRIX_WS_BLOCK *block;
+	MATRIX_WS_BLOCK *merged;
+	long             total = 0;
+
+	if ( ws->first && ws->first->next ) {
+		for ( block = ws->first; block; block = block->next )
+			total += block->size;
+		if ( (merged = new_workspace_block( total )) ) {
+			while ( (block = ws->first) ) {
+				ws->first = block->next;
+				free(block);
+			}
+			ws->first = merged;
+		}
+	}
+/* */
+	for ( block = ws->first; block; block = block->next )
+		block->used = 0;
+	ws->current = ws->first;
+
+	return;
+}
+
+/***/
+void matrix_workspace_free( MATRIX_WORKSPACE *ws ) 
+{
+	MATRIX_WS_BLOCK *block;
+
+	if ( ws ) {
+		while ( (block = ws->first) ) {
+			ws->first = block->next;
+			free(block);
+		}
+		free(ws);
+	}
+
+	return;
+}
+
+/* All the systems are zeroed, the count should be positive */
+MATRIX_BATCH *matrix_batch_new( const int count ) 
+{
+	MATRIX_BATCH *res = NULL;
+	const long    elements = (long)count * (MATRIX_BATCH_RANK * MATRIX_BATCH_RANK + 2 * MATRIX_BATCH_RANK);
+
+	if ( count > 0 && (res = (MATRIX_BATCH *)calloc(1, sizeof(MATRIX_BATCH))) ) {
+		res->count = count;
+		res->a     = (double *)calloc(elements, sizeof(double));
+		res->rank  = (int *)calloc(count, sizeof(int));
+		if ( !res->a || !res->rank ) {
+			free(res->a);
+			free(res->rank);
+			free(res);
+			return NULL;
+		}
+		res->b = res->a + (long)count * MATRIX_BATCH_RANK * MATRIX_BATCH_RANK;
+		res->x = res->b + (long)count * MATRIX_BATCH_RANK;
+	}
+
+	return res;
+}
+
+/* Copy the 4x4 a & the 4x1 b into the system of the index (from 0) */
+MATRIX_BATCH *matrix_batch_assign( MATRIX_BATCH *batch, const int index, const MATRIX *a, const MATRIX *b ) 
+{
+	const int count = batch->count;
+
+	if ( index < 0 || index >= count || a->i != MATRIX_BATCH_RANK || !IS_SQUARE( a ) || b->i != MATRIX_BATCH_RANK || b->j != 1 )
+		return NULL;
+/* */
+	for ( int i = 0; i < MATRIX_BATCH_RANK; i++ ) {
+		for ( int j = 0; j < MATRIX_BATCH_RANK; j++ )
+			batch->a[(long)BATCH_ELEMENT( i, j ) * count + index] = a->element[i * MATRIX_BATCH_RANK + j];
+		batch->b[(long)i * count + index] = b->element[i];
+	}
+
+	return batch;
+}
+
+/* Factor & solve all the systems, it returns the number of the rank deficient ones (their x are zeroed) */
+int matrix_batch_solve( MATRIX_BATCH *batch ) 
+{
+	int result = 0;
+
+	for ( int k = 0; k < batch->count; k += MATRIX_BATCH_CHUNK )
+		solve_batch_chunk( batch, k, batch->count - k < MATRIX_BATCH_CHUNK ? batch->count - k : MATRIX_BATCH_CHUNK );
+/* */
+	for ( int k = 0; k < batch->count; k++ )
+		if ( batch->rank[k] < MATRIX_BATCH_RANK )
+			result++;
+
+	return result;
+}
+
+/* Copy the solution of the index into the 4x1 x, it returns the rank of the system or -1 */
+int matrix_batch_extract( const MATRIX_BATCH *batch, const int index, MATRIX *x ) 
+{
+	if ( index < 0 || index >= batch->count || x->i != MATRIX_BATCH_RANK || x->j != 1 )
+		return -1;
+/* */
+	for ( int i = 0; i < MATRIX_BATCH_RANK; i++ )
+		x->element[i] = batch->x[(long)i * batch->count + index];
+
+	return batch->rank[index];
+}
+
+/***/
+void matrix_batch_free( MATRIX_BATCH *batch ) 
+{
+	if ( batch ) {
+		free(batch->a);
+		free(batch->rank);
+		free(batch);
+	}
+
+	return;
+}
+
+/***/
+static MATRIX_WS_BLOCK *new_workspace_block( const long size ) 
+{
+	MATRIX_WS_BLOCK *result = (MATRIX_WS_BLOCK *)malloc(sizeof(MATRIX_WS_BLOCK) + size * sizeof(double));
+
+	if ( result ) {
+		result->next = NULL;
+		result->size = size;
+		result->used = 0;
+	}
+
+	return result;
+}
+
+/* Mark the position of the workspace before taking the temporaries, or create the temporary one when it is NULL */
+static MATRIX_WORKSPACE *enter_workspace( MATRIX_WORKSPACE *ws, MATRIX_WS_MARK *mark, const long size ) 
+{
+	if ( !ws )
+		return matrix_workspace_new( size );
+/* */
+	mark->block = ws->current;
+	mark->used  = ws->current ? ws->current->used : 0;
+
+	return ws;
+}
+
+/* Give back the temporaries taken after the mark, or free the temporary workspace */
+static void leave_workspace( MATRIX_WORKSPACE *ws, MATRIX_WORKSPACE *_ws, const MATRIX_WS_MARK *mark ) 
 {
-	MATRIX *result = matrix_new( src->i, src->j );
-	
-	if ( result )
-		memcpy(result->element, src->element, src->total * sizeof(double));
-		
+	MATRIX_WS_BLOCK *block;
+
+	if ( !ws ) {
+		matrix_workspace_free( _ws );
+		return;
+	}
+/* */
+	if ( (ws->current = mark->block) ) {
+		ws->current->used = mark->used;
+		block = ws->current->next;
+	}
+	else {
+		ws->current = ws->first;
+		block = ws->first;
+	}
+	for ( ; block; block = block->next )
+		block->used = 0;
+
+	return;
+}
+
+/*
+ * The weights are read with the step, so the diagonal of the dense matrix could be used directly.
+ * The products are accumulated row by row in the same order as the transposed multiplication.
+ */
+static void fused_normal_equations(
+	MATRIX *gtdg, MATRIX *gtdd, const MATRIX *g, const double *diag, const int diag_step, const MATRIX *d
+) {
+	const int cols  = g->j;
+	const int dcols = gtdd ? d->j : 0;
+
+/* */
+	memset(gtdg->element, 0, gtdg->total * sizeof(double));
+	if ( gtdd )
+		memset(gtdd->element, 0, gtdd->total * sizeof(double));
+/* */
+	for ( int k = 0; k < g->i; k++ ) {
+		const double *restrict _g = g->element + (long)k * cols;
+		const double           wk = diag ? diag[(long)k * diag_step] : 1.0;
+		for ( int i = 0; i < cols; i++ ) {
+			double *restrict _res = gtdg->element + (long)i * cols;
+			const double     tmp  = wk * _g[i];
+			for ( int j = 0; j < cols; j++ )
+				_res[j] += tmp * _g[j];
+		}
+		if ( gtdd ) {
+			const double *restrict _d = d->element + (long)k * dcols;
+			for ( int i = 0; i < cols; i++ ) {
+				double *restrict _res = gtdd->element + (long)i * dcols;
+				const double     tmp  = wk * _g[i];
+				for ( int j = 0; j < dcols; j++ )
+					_res[j] += tmp * _d[j];
+			}
+		}
+	}
+
+	return;
+}
+
+/*
+ * Solve the (weighted & damped) least square by the normal equations, the weights are read with the step
+ * like fused_normal_equations & NULL for the identity. Levenberg-Marquardt style, the diagonal of GtWG will
+ * be scaled by (1 + damping).
+ */
+static MATRIX *solve_normal_equations(
+	MATRIX *res, const MATRIX *a, const MATRIX *b, const double *diag, const int diag_step, const double damping,
+	MATRIX_WORKSPACE *ws
+) {
+	MATRIX           *gtwg;
+	MATRIX           *gtwd;
+	MATRIX           *igtwg;
+	MATRIX           *result = NULL;
+	MATRIX_WORKSPACE *_ws;
+	MATRIX_WS_MARK    mark;
+
+/* */
+	if ( a->i != b->i || res->i != b->j || res->j != a->j )
+		return NULL;
+	if ( !(_ws = enter_workspace( ws, &mark, 3 * b->j * b->j + b->j * a->j + 4 * WORKSPACE_HEADER_SLOTS )) )
+		return NULL;
+/* */
+	gtwg  = matrix_workspace_get( _ws, b->j, b->j );
+	gtwd  = matrix_workspace_get( _ws, b->j, a->j );
+	igtwg = matrix_workspace_get( _ws, b->j, b->j );
+	if ( gtwg && gtwd && igtwg ) {
+		fused_normal_equations( gtwg, gtwd, b, diag, diag_step, a );
+	/* */
+		if ( damping > 0.0 )
+			for ( int i = 0; i < gtwg->i; i++ )
+				gtwg->element[i * gtwg->j + i] *= 1.0 + damping;
+		ADD_EPS_TO_DIAG( gtwg );
+		if ( matrix_inverse_into( igtwg, gtwg, _ws ) )
+			result = matrix_mul_into( res, igtwg, gtwd );
+	}
+	leave_workspace( ws, _ws, &mark );
+
 	return result;
 }
+
+/*
+ * LDLt of the systems from the offset, all the innermost loops run over the systems so they are vectorized.
+ * The pivot which is not positive enough is dropped instead of branching, the rank counts the kept ones.
+ */
+static void solve_batch_chunk( MATRIX_BATCH *batch, const int offset, const int num ) 
+{
+	const long count = batch->count;
+	const double *restrict a = batch->a + offset;
+	const double *restrict b = batch->b + offset;
+	double       *restrict x = batch->x + offset;
+	int          *restrict rank = batch->rank + offset;
+/* The lower triangle of L * D, the inversed D & the intermediate solution */
+	double l[MATRIX_BATCH_RANK * MATRIX_BATCH_RANK][MATRIX_BATCH_CHUNK];
+	double id[MATRIX_BATCH_RANK][MATRIX_BATCH_CHUNK];
+	double y[MATRIX_BATCH_RANK][MATRIX_BATCH_CHUNK];
+
+/* */
+	for ( int k = 0; k < num; k++ )
+		rank[k] = 0;
+/* Factorization, column by column. Here l keeps L * D below the diagonal, so the dropped pivot only zeroes its terms */
+	for ( int j = 0; j < MATRIX_BATCH_RANK; j++ ) {
+		const double *restrict ajj = a + BATCH_ELEMENT( j, j ) * count;
+		double       *restrict d   = id[j];
+		for ( int k = 0; k < num; k++ )
+			d[k] = ajj[k];
+		for ( int p = 0; p < j; p++ ) {
+			const double *restrict ljp = l[BATCH_ELEMENT( j, p )];
+			const double *restrict idp = id[p];
+			for ( int k = 0; k < num; k++ )
+				d[k] -= ljp[k] * ljp[k] * idp[k];
+		}
+		for ( int k = 0; k < num; k++ ) {
+			const int ok = ajj[k] > 0.0 && d[k] > MATRIX_BATCH_RANK_EPS * ajj[k];
+			d[k]     = ok ? 1.0 / d[k] : 0.0;
+			rank[k] += ok;
+		}
+	/* */
+		for ( int i = j + 1; i < MATRIX_BATCH_RANK; i++ ) {
+			const double *restrict aij = a + BATCH_ELEMENT( i, j ) * count;
+			double       *restrict lij = l[BATCH_ELEMENT( i, j )];
+			for ( int k = 0; k < num; k++ )
+				lij[k] = aij[k];
+			for ( int p = 0; p < j; p++ ) {
+				const double *restrict lip = l[BATCH_ELEMENT( i, p )];
+				const double *restrict ljp = l[BATCH_ELEMENT( j, p )];
+				const double *restrict idp = id[p];
+				for ( int k = 0; k < num; k++ )
+					lij[k] -= lip[k] * ljp[k] * idp[k];
+			}
+		}
+	}
+/* Forward substitution with L = (L * D) * inv(D) */
+	for ( int i = 0; i < MATRIX_BATCH_RANK; i++ ) {
+		const double *restrict bi = b + i * count;
+		double       *restrict yi = y[i];
+		for ( int k = 0; k < num; k++ )
+			yi[k] = bi[k];
+		for ( int p = 0; p < i; p++ ) {
+			const double *restrict lip = l[BATCH_ELEMENT( i, p )];
+			const double *restrict idp = id[p];
+			const double *restrict yp  = y[p];
+			for ( int k = 0; k < num; k++ )
+				yi[k] -= lip[k] * idp[k] * yp[k];
+		}
+	}
+/* Backward substitution, the solution of the rank deficient system is zeroed */
+	for ( int i = MATRIX_BATCH_RANK - 1; i >= 0; i-- ) {
+		double       *restrict yi  = y[i];
+		const double *restrict idi = id[i];
+		for ( int k = 0; k < num; k++ )
+			yi[k] *= idi[k];
+		for ( int p = i + 1; p < MATRIX_BATCH_RANK; p++ ) {
+			const double *restrict lpi = l[BATCH_ELEMENT( p, i )];
+			const double *restrict yp  = y[p];
+			for ( int k = 0; k < num; k++ )
+				yi[k] -= lpi[k] * idi[k] * yp[k];
+		}
+	}
+	for ( int i = 0; i < MATRIX_BATCH_RANK; i++ ) {
+		double       *restrict xi = x + i * count;
+		const double *restrict yi = y[i];
+		for ( int k = 0; k < num; k++ )
+			xi[k] = rank[k] == MATRIX_BATCH_RANK ? yi[k] : 0.0;
+	}
+
+	return;
+}
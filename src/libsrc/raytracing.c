@@ -9,10 +9,17 @@
  * @copyright Copyright (c) 2023
  *
  */
+#define _GNU_SOURCE
+/* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <raytracing.h>
 
@@ -28,17 +35,16 @@
 
 /*
  * Parameters for calculation:
- * XFAC    = enhancement factor (see um and thurber, 1987)
- * NLOOP   = number of bending iterations
  * N1, N2  = min & max of ray segments
- * MINS    = min. length of segment (km)
+ * The enhancement factor, number of bending iterations, tolerance & min. length of segment are in the RT_PROFILE
 */
-#define XFAC         1.9
 #define N1           2
 #define N2           RT_MAX_NODE
-#define NLOOP        12800
-#define FLIMIT       1.e-6
-#define MINS         2.0
+/*
+ * The warm started bending will begin from the cached ray with 1/WARM_DECIMATE nodes then double the
+ * segments as usual, since the shifted full ray converges much slower than the doubled coarse ray.
+ */
+#define WARM_DECIMATE  8
 
 /**
  * @brief
@@ -50,6 +56,17 @@ typedef struct {
 	double z;
 } NODE_INFO;
 
+/**
+ * @brief The ray node of the Cartesian pseudo-bending
+ *
+ */
+typedef struct {
+	double x;
+	double y;
+	double z;
+	double v;
+} CART_NODE;
+
 /**
  * @brief
  *
@@ -58,6 +75,39 @@ typedef struct {
 	double vel[8];
 } VEL_GRID;
 
+/*
+ * The compact layout: the node velocities in float are grouped into tiles of VEL_TILE_CELLS^3 cells,
+ * each tile keeps its own boundary nodes (VEL_TILE_NODES^3 nodes padded to VEL_TILE_SIZE floats) so
+ * the eight corners of any cell are always inside one tile at the fixed offsets.
+ */
+#define VEL_TILE_CELLS  4
+#define VEL_TILE_NODES  (VEL_TILE_CELLS + 1)
+#define VEL_TILE_SIZE   128
+
+/* Four floats handled together, by the vector extension of GCC & Clang */
+typedef float VEC4F __attribute__((vector_size(16)));
+
+/* */
+#define VELMOD_MAGIC    0x4d564c45  /* "ELVM" in little-endian */
+#define VELMOD_VERSION  1
+
+/**
+ * @brief The header of the binary model, it will be followed by the longitude, latitude & depth axes
+ *        in double, then the P & S cell grids (VEL_GRID) which are ordered by longitude first.
+ *
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nlon;
+	uint32_t nlat;
+	uint32_t ndep;
+	uint32_t reserved;
+/* The steps of the index mapping, in degree & km */
+	double   bld3;
+	double   bld4;
+} VELMOD_HEADER;
+
 
 #define POLAR2CARTESIAN( _R_MACRO, _THETA_MACRO, _PHI_MACRO, _X_MACRO, _Y_MACRO, _Z_MACRO ) \
 		__extension__({ \
@@ -67,40 +117,81 @@ typedef struct {
 			(_Z_MACRO) = (_R_MACRO) * cos((_THETA_MACRO)); \
 		})
 
+/**
+ * @brief The 3D velocity model & its index mapping, it will never be modified after loading,
+ *        therefore it could be shared by several tracing threads.
+ *
+ */
+struct rt_velmod {
 /* For 3D-velocity model maping */
-static double *Lat_c, *Lon_c, *Dep_c;
-static double *Vel_p, *Vel_s;
-static VEL_GRID *Velgrid_p, *Velgrid_s;
-static VEL_GRID * volatile Vel_grid;
-
-static int *Ilon_c, *Ilat_c, *Idep_c;
-
+	double   *lat_c, *lon_c, *dep_c;
+	VEL_GRID *velgrid_p, *velgrid_s;
+	int      *ilon_c, *ilat_c, *idep_c;
+/* The compact layout, NULL when using the cell grids */
+	float *veltile_p, *veltile_s;
+	int   *tileoff_lon, *tileoff_lat, *tileoff_dep;
+	int    ntile_x, ntile_xy;
+/* The mapping of the binary model, NULL for the text model */
+	void  *map;
+	size_t map_size;
+/* The hash of the axes & the cell grids, it stays the same after switching to the compact layout */
+	uint64_t fingerprint;
 /* Constant */
-static double Ro, Rs;
-static int Ilat1_c, Ilon1_c, Idep1_c;
-static int Ilonmax, Ilatmax, Idepmax;
-static int Ibld3, Ibld4;
-static int Nlat_c, Nlon_c, Ndep_c;
-static int Nxyz_c, Nxy_c, Nx_c;
+	double bld3, bld4;
+	double ro, rs;
+	int    ilat1_c, ilon1_c, idep1_c;
+	int    ilonmax, ilatmax, idepmax;
+	int    ibld3, ibld4;
+	int    nlat_c, nlon_c, ndep_c;
+	int    nxyz_c, nxy_c, nx_c;
+};
 
 /* */
-static void raytracing_pb( double, double, double, double, double, double, RAY_INFO *, int *, double * );
+static int raytracing_pb(
+	const RT_VELMOD *, const int, double, double, double, double, double, double, RAY_INFO *, int *, double *, RT_RAY_CACHE *,
+	const RT_PROFILE *, RT_TRACE_INFO *
+);
+static int raytracing_pb_cart(
+	const RT_VELMOD *, const int, double, double, double, double, double, double, RAY_INFO *, int *, double *, RT_RAY_CACHE *,
+	const RT_PROFILE *, RT_TRACE_INFO *
+);
+static double get_shifted_frame( const RT_VELMOD *, double, double, double, double, double, double, NODE_INFO [2] );
+static int check_coordinates( const RT_VELMOD *, const double, const double, const double, const double, const double, const double );
+static double get_source_shift( const RT_RAY_CACHE *, const double, const double, const double );
+static int store_ray_cache( RT_RAY_CACHE *, const RAY_INFO *, const int, const double, const double, const double );
 static void step_ray_node( RAY_INFO *, const RAY_INFO *, const double, const double );
 static double get_ray_traveltime( const RAY_INFO *, const int );
-static double get_vel_ray( const RAY_INFO *, const double );
-static double get_vel_geog( const double, const double, const double );
-static int intmap_3d( int *, int *, int * );
-static int input_vel_model( const char * );
-static int bldmap( const double, const double );
+static double get_cart_traveltime( const CART_NODE *, const int );
+static double get_vel_ray( const RAY_INFO *, const double, const RT_VELMOD *, const int );
+static double get_vel_cart( const double, const double, const double, const double, const RT_VELMOD *, const int );
+static double get_vel_geog( const double, const double, const double, const RT_VELMOD *, const int );
+static double get_vel_tile( const float *, const double, const double, const double );
+static int intmap_3d( const RT_VELMOD *, int *, int *, int * );
+static int input_vel_model( RT_VELMOD *, const char *, double **, double ** );
+static int read_model_line( FILE *, char **, size_t *, double *, const int );
+static int is_binary_model( const char * );
+static int map_vel_model( RT_VELMOD *, const char * );
+static size_t get_binary_model_size( const size_t, const size_t, const size_t );
+static int init_vel_model( RT_VELMOD * );
+static int bldmap( RT_VELMOD *, const double, const double );
 static int vel_point2grid( const double *, VEL_GRID *, const int, const int, const int );
+static void vel_grid2tile( const RT_VELMOD *, const VEL_GRID *, float * );
+static uint64_t hash_model_data( uint64_t, const void *, const size_t );
 
 static double geog2geoc( const double );
 static double geoc2geog( const double );
 static double get_earth_radius( double );
 
+/* */
+const RT_PROFILE rt_profile_fine   = { 1.9, 12800, 1.0e-5, 2.0, 0 };
+/* Against the fine one, 1e-3 sec. & 4 km segments gave up to 0.37 sec. error (p99 0.34 sec.) of the trial
+   travel times, 1e-4 sec. & 2 km segments gave p99 0.006~0.10 sec. & max 0.09~0.15 sec. over the test models */
+const RT_PROFILE rt_profile_coarse = { 1.9, 12800, 1.0e-4, 2.0, 0 };
+
 /**
  * @brief
  *
+ * @param model
  * @param ray_out
  * @param np
  * @param travel_time
@@ -111,42 +202,25 @@ static double get_earth_radius( double );
  * @param stlo
  * @param stdp
  * @param vel_type
+ * @param profile the termination of the bending, rt_profile_fine will be used when it is NULL
+ * @param info the cost of this tracing, could be NULL
  * @return int
  */
-int rt_main( RAY_INFO *ray_out, int *np, double *travel_time, double evla, double evlo, double evdp, double stla, double stlo, double stdp, const int vel_type )
-{
+int rt_main(
+	const RT_VELMOD *model, RAY_INFO *ray_out, int *np, double *travel_time,
+	double evla, double evlo, double evdp, double stla, double stlo, double stdp, const int vel_type,
+	const RT_PROFILE *profile, RT_TRACE_INFO *info
+) {
 /* Check coordinates */
-	if ( evla < Lat_c[0] || evla > Lat_c[Nlat_c - 1] ) {
-		fprintf(stderr, "rt_main: Latitude(%lf) of source is out of range!\n", evla);
+	if ( check_coordinates( model, evla, evlo, evdp, stla, stlo, stdp ) )
 		return -1;
-	}
-	if ( stla < Lat_c[0] || stla > Lat_c[Nlat_c - 1] ) {
-		fprintf(stderr, "rt_main: Latitude(%lf) of station is out of range!\n", stla);
-		return -1;
-	}
-	if ( evlo < Lon_c[0] || evlo > Lon_c[Nlon_c - 1] ) {
-		fprintf(stderr, "rt_main: Longitude(%lf) of source is out of range!\n", evlo);
-		return -1;
-	}
-	if ( stlo < Lon_c[0] || stlo > Lon_c[Nlon_c - 1] ) {
-		fprintf(stderr, "rt_main: Longitude(%lf) of station is out of range!\n", stlo);
-		return -1;
-	}
-	if ( evdp < Dep_c[0] || evdp > Dep_c[Ndep_c - 1] ) {
-		fprintf(stderr, "rt_main: Depth(%lf) of source is out of range!\n", evdp);
-		return -1;
-	}
-	if ( stdp < Dep_c[0] || stdp > Dep_c[Ndep_c - 1] ) {
-		fprintf(stderr, "rt_main: Depth(%lf) of station is out of range!\n", stdp);
-		return -1;
-	}
 /* */
 	stla = geog2geoc( stla );
 	evla = geog2geoc( evla );
 /* Define the velocity type, P or S */
-	Vel_grid = vel_type == RT_P_WAVE_VELOCITY ? Velgrid_p : Velgrid_s;
-/* */
-	raytracing_pb( evla, evlo, evdp, stla, stlo, stdp, ray_out, np, travel_time );
+	(profile && profile->cartesian ? raytracing_pb_cart : raytracing_pb)(
+		model, vel_type, evla, evlo, evdp, stla, stlo, stdp, ray_out, np, travel_time, NULL, profile, info
+	);
 /* Show full information */
 #ifdef _DEBUG
 	printf("# nodes = %d, travel time = %lf\n", np, tt);
@@ -156,44 +230,346 @@ int rt_main( RAY_INFO *ray_out, int *np, double *travel_time, double evla, doubl
 	return 0;
 }
 
+/**
+ * @brief Same as rt_main but with the cached ray of the same receiver & phase. When the source is exactly the
+ *        same as the cached one, the cached ray will be returned directly; when the source moved less than
+ *        RT_WARM_START_DIST, the cached ray will be shifted to the new source & used as the initial path of the
+ *        pseudo-bending, instead of the straight line. The cache will be updated by the new ray. The cached ray
+ *        traced by the looser tolerance won't be returned directly, it will be bent from itself instead.
+ *
+ * @param model
+ * @param cache
+ * @param ray_out
+ * @param np
+ * @param travel_time
+ * @param evla
+ * @param evlo
+ * @param evdp
+ * @param stla
+ * @param stlo
+ * @param stdp
+ * @param vel_type
+ * @param profile the termination of the bending, rt_profile_fine will be used when it is NULL
+ * @param info the cost of this tracing, could be NULL
+ * @return int RT_RAY_CACHE_HIT, RT_RAY_CACHE_WARM, RT_RAY_CACHE_COLD or -1 when something error
+ */
+int rt_main_cache(
+	const RT_VELMOD *model, RT_RAY_CACHE *cache, RAY_INFO *ray_out, int *np, double *travel_time,
+	double evla, double evlo, double evdp, double stla, double stlo, double stdp, const int vel_type,
+	const RT_PROFILE *profile, RT_TRACE_INFO *info
+) {
+	int result = RT_RAY_CACHE_WARM;
+	const double tolerance = profile ? profile->tolerance : rt_profile_fine.tolerance;
+
+/* Check coordinates */
+	if ( check_coordinates( model, evla, evlo, evdp, stla, stlo, stdp ) )
+		return -1;
+/* Is it the same receiver & phase? */
+	if (
+		!cache->np || cache->vel_type != vel_type ||
+		cache->stla != stla || cache->stlo != stlo || cache->stdp != stdp
+	) {
+		cache->np = 0;
+		result = RT_RAY_CACHE_COLD;
+	}
+	else if ( cache->evla == evla && cache->evlo == evlo && cache->evdp == evdp && cache->tolerance <= tolerance ) {
+		memcpy(ray_out, cache->ray, sizeof(RAY_INFO) * cache->np);
+		*np = cache->np;
+		*travel_time = cache->travel_time;
+		if ( info )
+			*info = (RT_TRACE_INFO){ 0, cache->np - 1 };
+		return RT_RAY_CACHE_HIT;
+	}
+	else if ( get_source_shift( cache, evla, evlo, evdp ) > RT_WARM_START_DIST ) {
+		cache->np = 0;
+		result = RT_RAY_CACHE_COLD;
+	}
+/* */
+	(profile && profile->cartesian ? raytracing_pb_cart : raytracing_pb)(
+		model, vel_type, geog2geoc( evla ), evlo, evdp, geog2geoc( stla ), stlo, stdp, ray_out, np, travel_time, cache,
+		profile, info
+	);
+/* Only keep the source & receiver when the ray has been stored */
+	if ( cache->np ) {
+		cache->evla     = evla;
+		cache->evlo     = evlo;
+		cache->evdp     = evdp;
+		cache->stla     = stla;
+		cache->stlo     = stlo;
+		cache->stdp     = stdp;
+		cache->vel_type = vel_type;
+	}
+
+	return result;
+}
+
 /**
  * @brief
  *
+ * @param cache
+ */
+void rt_ray_cache_free( RT_RAY_CACHE *cache )
+{
+	if ( cache ) {
+		free(cache->ray);
+		RT_RAY_CACHE_INIT( *cache );
+	}
+
+	return;
+}
+
+/**
+ * @brief Load the 3D velocity model, the binary model (generated by velmod_conv) will be mapped
+ *        directly, otherwise it will be parsed as the text model.
+ *
+ * @param model_path
+ * @return RT_VELMOD*
+ */
+RT_VELMOD *rt_velmod_load( const char *model_path )
+{
+	RT_VELMOD *result;
+	double    *vel_p = NULL;
+	double    *vel_s = NULL;
+
+/* */
+	if ( (result = calloc(1, sizeof(RT_VELMOD))) == NULL )
+		return NULL;
+/* */
+	if ( is_binary_model( model_path ) ) {
+		if ( map_vel_model( result, model_path ) || init_vel_model( result ) ) {
+			rt_velmod_free( result );
+			return NULL;
+		}
+	}
+	else {
+		if ( input_vel_model( result, model_path, &vel_p, &vel_s ) || init_vel_model( result ) ) {
+			free(vel_p);
+			free(vel_s);
+			rt_velmod_free( result );
+			return NULL;
+		}
+	/* */
+		result->velgrid_p = calloc(result->nxyz_c, sizeof(VEL_GRID));
+		result->velgrid_s = calloc(result->nxyz_c, sizeof(VEL_GRID));
+		if ( !result->velgrid_p || !result->velgrid_s ) {
+			free(vel_p);
+			free(vel_s);
+			rt_velmod_free( result );
+			return NULL;
+		}
+		vel_point2grid( vel_p, result->velgrid_p, result->nxyz_c, result->nxy_c, result->nx_c );
+		vel_point2grid( vel_s, result->velgrid_s, result->nxyz_c, result->nxy_c, result->nx_c );
+		free(vel_p);
+		free(vel_s);
+	}
+/* The text & binary models of the same content get the same fingerprint */
+	result->fingerprint = hash_model_data( 0xcbf29ce484222325ULL, result->lon_c, sizeof(double) * result->nlon_c );
+	result->fingerprint = hash_model_data( result->fingerprint, result->lat_c, sizeof(double) * result->nlat_c );
+	result->fingerprint = hash_model_data( result->fingerprint, result->dep_c, sizeof(double) * result->ndep_c );
+	result->fingerprint = hash_model_data( result->fingerprint, result->velgrid_p, sizeof(VEL_GRID) * result->nxyz_c );
+	result->fingerprint = hash_model_data( result->fingerprint, result->velgrid_s, sizeof(VEL_GRID) * result->nxyz_c );
+
+	return result;
+}
+
+/**
+ * @brief Write the loaded model as the binary model, include the precomputed cell grids. It will be
+ *        written to a temporary file first & renamed after finishing, therefore the other processes
+ *        will never map a half-written model.
+ *
+ * @param model
  * @param model_path
  * @return int
  */
-int rt_velmod_load( const char *model_path )
+int rt_velmod_save( const RT_VELMOD *model, const char *model_path )
+{
+	char          tmp_path[strlen(model_path) + 8];
+	FILE         *fp;
+	VELMOD_HEADER header;
+	int           ret = 0;
+
+/* */
+	if ( !model || !model->velgrid_p || !model->velgrid_s )
+		return -1;
+/* */
+	memset(&header, 0, sizeof(VELMOD_HEADER));
+	header.magic   = VELMOD_MAGIC;
+	header.version = VELMOD_VERSION;
+	header.nlon    = model->nlon_c;
+	header.nlat    = model->nlat_c;
+	header.ndep    = model->ndep_c;
+	header.bld3    = model->bld3;
+	header.bld4    = model->bld4;
+/* */
+	sprintf(tmp_path, "%s.tmp", model_path);
+	if ( (fp = fopen(tmp_path, "wb")) == NULL )
+		return -1;
+	if (
+		fwrite(&header, sizeof(VELMOD_HEADER), 1, fp) != 1 ||
+		fwrite(model->lon_c, sizeof(double), model->nlon_c, fp) != (size_t)model->nlon_c ||
+		fwrite(model->lat_c, sizeof(double), model->nlat_c, fp) != (size_t)model->nlat_c ||
+		fwrite(model->dep_c, sizeof(double), model->ndep_c, fp) != (size_t)model->ndep_c ||
+		fwrite(model->velgrid_p, sizeof(VEL_GRID), model->nxyz_c, fp) != (size_t)model->nxyz_c ||
+		fwrite(model->velgrid_s, sizeof(VEL_GRID), model->nxyz_c, fp) != (size_t)model->nxyz_c
+	) {
+		ret = -1;
+	}
+	if ( fclose(fp) )
+		ret = -1;
+/* */
+	if ( ret || rename(tmp_path, model_path) ) {
+		remove(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Switch the model to the compact layout: the node velocities in float grouped by tiles, it
+ *        takes 1/8 memory of the cell grids & the interpolation is vectorized. The cell grids of the
+ *        text model will be released, therefore the model can't be saved after switching. It should
+ *        be called before the model is shared by the tracing threads.
+ *
+ * @param model
+ * @return int
+ */
+int rt_velmod_compact( RT_VELMOD *model )
 {
+	int    i;
+	size_t tile_bytes;
+
 /* */
-	if ( input_vel_model( model_path ) )
+	if ( !model || !model->velgrid_p || !model->velgrid_s )
+		return -1;
+	if ( model->veltile_p )
+		return 0;
+/* */
+	model->ntile_x  = (model->nlon_c - 2) / VEL_TILE_CELLS + 1;
+	model->ntile_xy = model->ntile_x * ((model->nlat_c - 2) / VEL_TILE_CELLS + 1);
+	tile_bytes      = (size_t)model->ntile_xy * ((model->ndep_c - 2) / VEL_TILE_CELLS + 1) * VEL_TILE_SIZE * sizeof(float);
+	model->veltile_p   = aligned_alloc(64, tile_bytes);
+	model->veltile_s   = aligned_alloc(64, tile_bytes);
+	model->tileoff_lon = malloc(sizeof(int) * model->nlon_c);
+	model->tileoff_lat = malloc(sizeof(int) * model->nlat_c);
+	model->tileoff_dep = malloc(sizeof(int) * model->ndep_c);
+	if ( !model->veltile_p || !model->veltile_s || !model->tileoff_lon || !model->tileoff_lat || !model->tileoff_dep ) {
+		free(model->veltile_p);
+		free(model->veltile_s);
+		free(model->tileoff_lon);
+		free(model->tileoff_lat);
+		free(model->tileoff_dep);
+		model->veltile_p = model->veltile_s = NULL;
+		model->tileoff_lon = model->tileoff_lat = model->tileoff_dep = NULL;
+		return -1;
+	}
+/* The offset of each cell index, so the tile & the corner inside it are found by three additions */
+	for ( i = 0; i < model->nlon_c; i++ )
+		model->tileoff_lon[i] = (i / VEL_TILE_CELLS) * VEL_TILE_SIZE + i % VEL_TILE_CELLS;
+	for ( i = 0; i < model->nlat_c; i++ )
+		model->tileoff_lat[i] = (i / VEL_TILE_CELLS) * model->ntile_x * VEL_TILE_SIZE + (i % VEL_TILE_CELLS) * VEL_TILE_NODES;
+	for ( i = 0; i < model->ndep_c; i++ )
+		model->tileoff_dep[i] =
+			(i / VEL_TILE_CELLS) * model->ntile_xy * VEL_TILE_SIZE + (i % VEL_TILE_CELLS) * VEL_TILE_NODES * VEL_TILE_NODES;
+/* The padding of each tile won't be used, but keep it clean */
+	memset(model->veltile_p, 0, tile_bytes);
+	memset(model->veltile_s, 0, tile_bytes);
+	vel_grid2tile( model, model->velgrid_p, model->veltile_p );
+	vel_grid2tile( model, model->velgrid_s, model->veltile_s );
+/* The cell grids of the binary model are inside the mapping & will be just untouched */
+	if ( !model->map ) {
+		free(model->velgrid_p);
+		free(model->velgrid_s);
+		model->velgrid_p = model->velgrid_s = NULL;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the interpolated velocity of the model at the input point, in degree & km.
+ *
+ * @param model
+ * @param lat
+ * @param lon
+ * @param dep
+ * @param vel_type
+ * @return double
+ */
+double rt_velmod_velocity( const RT_VELMOD *model, const double lat, const double lon, const double dep, const int vel_type )
+{
+	return get_vel_geog( lon, lat, dep, model, vel_type );
+}
+
+/**
+ * @brief Get the coverage of the loaded model, in degree & km.
+ *
+ * @param model
+ * @param lon_min
+ * @param lon_max
+ * @param lat_min
+ * @param lat_max
+ * @param dep_min
+ * @param dep_max
+ * @return int
+ */
+int rt_velmod_range( const RT_VELMOD *model, double *lon_min, double *lon_max, double *lat_min, double *lat_max, double *dep_min, double *dep_max )
+{
+	if ( !model || !model->lon_c || !model->lat_c || !model->dep_c )
 		return -1;
 /* */
-	Velgrid_p = calloc(Nxyz_c, sizeof(VEL_GRID));
-	Velgrid_s = calloc(Nxyz_c, sizeof(VEL_GRID));
-	vel_point2grid( Vel_p, Velgrid_p, Nxyz_c, Nxy_c, Nx_c );
-	vel_point2grid( Vel_s, Velgrid_s, Nxyz_c, Nxy_c, Nx_c );
-	free(Vel_p);
-	free(Vel_s);
-/* Default to P-wave velocity */
-	Vel_grid = Velgrid_p;
+	*lon_min = model->lon_c[0];
+	*lon_max = model->lon_c[model->nlon_c - 1];
+	*lat_min = model->lat_c[0];
+	*lat_max = model->lat_c[model->nlat_c - 1];
+	*dep_min = model->dep_c[0];
+	*dep_max = model->dep_c[model->ndep_c - 1];
 
 	return 0;
 }
 
+/**
+ * @brief Get the fingerprint of the loaded model, it's the hash of the axes & the velocities, so the
+ *        products derived from the model (e.g. the travel time tables) could tell which model they
+ *        belong to.
+ *
+ * @param model
+ * @return uint64_t
+ */
+uint64_t rt_velmod_fingerprint( const RT_VELMOD *model )
+{
+	return model ? model->fingerprint : 0;
+}
+
 /**
  * @brief
  *
+ * @param model
  */
-void rt_velmod_free( void )
+void rt_velmod_free( RT_VELMOD *model )
 {
-	free(Lat_c);
-	free(Lon_c);
-	free(Dep_c);
-	free(Velgrid_p);
-	free(Velgrid_s);
-	free(Ilon_c);
-	free(Ilat_c);
-	free(Idep_c);
+	if ( !model )
+		return;
+/* The axes & the cell grids of the binary model are inside the mapping */
+	if ( model->map ) {
+		munmap(model->map, model->map_size);
+	}
+	else {
+		free(model->lat_c);
+		free(model->lon_c);
+		free(model->dep_c);
+		free(model->velgrid_p);
+		free(model->velgrid_s);
+	}
+	free(model->veltile_p);
+	free(model->veltile_s);
+	free(model->tileoff_lon);
+	free(model->tileoff_lat);
+	free(model->tileoff_dep);
+	free(model->ilon_c);
+	free(model->ilat_c);
+	free(model->idep_c);
+	free(model);
 
 	return;
 }
@@ -245,7 +621,9 @@ void rt_tko_azi_cal( const RAY_INFO *ray, const int np, double *tko, double *azi
 }
 
 /**
- * @brief
+ * @brief Get the derivatives of the travel time with respect to the source position, it is the take-off
+ *        direction of the ray scaled by the slowness at the source. They are projected onto the local
+ *        east, north & downward axes at the source (in s/km), the same as the derivatives of the 1D model.
  *
  * @param ray
  * @param np
@@ -257,6 +635,7 @@ void rt_drvt_cal( const RAY_INFO *ray, const int np, double *dx, double *dy, dou
 {
 	double x1, y1, z1;
 	double x2, y2, z2;
+	double sina, cosa, sinb, cosb;
 	double us;
 
 /* */
@@ -267,16 +646,20 @@ void rt_drvt_cal( const RAY_INFO *ray, const int np, double *dx, double *dy, dou
 /* Get coordinate of next point of ray */
 	POLAR2CARTESIAN( ray[1].r, ray[1].a, ray[1].b, x2, y2, z2 );
 /* */
-	*dx = x2 - x1;
-	*dy = y2 - y1;
-	*dz = z2 - z1;
+	x2 -= x1;
+	y2 -= y1;
+	z2 -= z1;
 /* */
 	us = -1.0 / ray[0].v;
-	us /= sqrt((*dx) * (*dx) + (*dy) * (*dy) + (*dz) * (*dz));
-/* */
-	*dx *= us;
-	*dy *= us;
-	*dz *= us;
+	us /= sqrt(x2 * x2 + y2 * y2 + z2 * z2);
+/* From the (shifted) geocentric axes to the local axes at the source, the colatitude increases southward */
+	sina = sin(ray[0].a);
+	cosa = cos(ray[0].a);
+	sinb = sin(ray[0].b);
+	cosb = cos(ray[0].b);
+	*dx = us * (cosb * y2 - sinb * x2);
+	*dy = us * (sina * z2 - cosa * (cosb * x2 + sinb * y2));
+	*dz = -us * (sina * (cosb * x2 + sinb * y2) + cosa * z2);
 
 	return;
 }
@@ -284,11 +667,12 @@ void rt_drvt_cal( const RAY_INFO *ray, const int np, double *dx, double *dy, dou
 /**
  * @brief Return coordinates to the origin
  *
+ * @param model
  * @param ray
  * @param np
  * @return RAY_INFO*
  */
-RAY_INFO *rt_ray_rad2deg( RAY_INFO *ray, const int np, double stlo, double evlo )
+RAY_INFO *rt_ray_rad2deg( const RT_VELMOD *model, RAY_INFO *ray, const int np, double stlo, double evlo )
 {
 	RAY_INFO *ray_now  = ray;
 	double    shiftlon = 0.0;
@@ -316,7 +700,7 @@ RAY_INFO *rt_ray_rad2deg( RAY_INFO *ray, const int np, double stlo, double evlo
 /* */
 	for ( int i = 0; i < np; i++, ray_now++ ) {
 	/* */
-		ray_now->r  = Ro - ray_now->r;
+		ray_now->r  = model->ro - ray_now->r;
 		ray_now->a *= RT_RAD2DEG;
 		ray_now->b *= RT_RAD2DEG;
 	/* */
@@ -331,6 +715,8 @@ RAY_INFO *rt_ray_rad2deg( RAY_INFO *ray, const int np, double stlo, double evlo
 /**
  * @brief
  *
+ * @param model
+ * @param vel_type
  * @param evla
  * @param evlo
  * @param evdp
@@ -340,10 +726,19 @@ RAY_INFO *rt_ray_rad2deg( RAY_INFO *ray, const int np, double stlo, double evlo
  * @param record
  * @param np
  * @param tk
+ * @param cache
+ * @param profile
+ * @param info
+ * @return int the number of the bending iterations
  */
-static void raytracing_pb( double evla, double evlo, double evdp, double stla, double stlo, double stel, RAY_INFO *ray, int *np, double *tk )
-{
+static int raytracing_pb(
+	const RT_VELMOD *model, const int vel_type,
+	double evla, double evlo, double evdp, double stla, double stlo, double stel, RAY_INFO *ray, int *np, double *tk,
+	RT_RAY_CACHE *cache, const RT_PROFILE *profile, RT_TRACE_INFO *info
+) {
 	int ni, i, j, k, l;
+	int iters = 0;
+	int stride = 1;
 
 	RAY_INFO _ray[RT_MAX_NODE + 1];
 
@@ -370,72 +765,40 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 	double upz, dwz;
 	double vr, vb, va;
 	double rvs, cc, rcur;
+	double dshift = 0.0;
+
+	const RAY_INFO *ray_init = NULL;
 
 /* Parameters for calculation initialization */
-	xfac = XFAC;
+	if ( !profile )
+		profile = &rt_profile_fine;
+	xfac = profile->xfac;
 /* ni : number of ray segments */
 	ni = N1;
 /* Random algorism used */
 	//srand(time(NULL));
+/* Initial straight ray */
+	shiftlo = get_shifted_frame( model, evla, evlo, evdp, stla, stlo, stel, terminal );
+
 /*
- * Longitude and latitude range from 0 to 180. This program does not work with angles greater than 180.
- * Pass from latitude to colatitude
+ * Warm start from the decimated cached ray, it will be rotated to the new shifted frame & each node will be
+ * moved by the source's movement linearly decreased to zero at the receiver.
  */
-	evla = (90.0 - evla) * RT_DEG2RAD;
-	stla = (90.0 - stla) * RT_DEG2RAD;
-/* da = bre, db = bso, dr = dlo */
-	if ( stlo < 0.0 )
-		da = 360.0 + stlo;
-	else
-		da = stlo;
-
-	if ( evlo < 0.0 )
-		db = 360.0 + evlo;
-	else
-		db = evlo;
-/* */
-	dr = fabs(db - da);
-	shiftlo = 0.0;
-	if ( dr < 180.0 ) {
-		if ( db < da ) {
-			evlo = (180.0 - dr) * 0.5;
-			stlo = evlo + dr;
-			shiftlo = db - evlo;
-		}
-		else {
-			stlo = (180.0 - dr) * 0.5;
-			evlo = stlo + dr;
-			shiftlo = da - stlo;
-		}
+	if ( cache && cache->np > 2 ) {
+		ray_init = cache->ray;
+		for ( stride = WARM_DECIMATE; stride > 1 && (cache->np - 1) / stride < N1; stride >>= 1 );
+		ni = (cache->np - 1) / stride;
+		dshift = (cache->shiftlo - shiftlo) * RT_DEG2RAD;
+		POLAR2CARTESIAN( ray_init->r, ray_init->a, ray_init->b + dshift, x2, y2, z2 );
+		dr = (terminal[0].x - x2) / ni;
+		da = (terminal[0].y - y2) / ni;
+		db = (terminal[0].z - z2) / ni;
 	}
 	else {
-		dr = 360.0 - dr;
-		if ( db < da ) {
-			evlo = 90.0 + 0.5 * dr;
-			stlo = evlo - dr;
-			shiftlo = db - evlo;
-		}
-		else {
-			stlo = 90.0 + 0.5 * dr;
-			evlo = stlo - dr;
-			shiftlo = da - stlo;
-		}
+		dr = (terminal[1].x - terminal[0].x) / ni;
+		da = (terminal[1].y - terminal[0].y) / ni;
+		db = (terminal[1].z - terminal[0].z) / ni;
 	}
-/* */
-	evlo *= RT_DEG2RAD;
-	stlo *= RT_DEG2RAD;
-/* */
-	evdp = Ro - evdp;
-	stel = Ro - stel;
-/* Initial straight ray */
-/* Epc. coordinates */
-	POLAR2CARTESIAN( evdp, evla, evlo, terminal[0].x, terminal[0].y, terminal[0].z );
-/* Rec. coordinates */
-	POLAR2CARTESIAN( stel, stla, stlo, terminal[1].x, terminal[1].y, terminal[1].z );
-
-	dr = (terminal[1].x - terminal[0].x) / ni;
-	da = (terminal[1].y - terminal[0].y) / ni;
-	db = (terminal[1].z - terminal[0].z) / ni;
 	dseg = sqrt(dr * dr + da * da + db * db + RT_EPS);
 
 	ray_now = _ray;
@@ -444,9 +807,17 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 	do {
 		i = ray_now - _ray;
 
-		x1 = terminal[0].x + dr * i;
-		y1 = terminal[0].y + da * i;
-		z1 = terminal[0].z + db * i;
+		if ( ray_init ) {
+			POLAR2CARTESIAN( ray_init[i * stride].r, ray_init[i * stride].a, ray_init[i * stride].b + dshift, x1, y1, z1 );
+			x1 += dr * (ni - i);
+			y1 += da * (ni - i);
+			z1 += db * (ni - i);
+		}
+		else {
+			x1 = terminal[0].x + dr * i;
+			y1 = terminal[0].y + da * i;
+			z1 = terminal[0].z + db * i;
+		}
 
 		dn = x1 * x1 + y1 * y1 + z1 * z1;
 		ray_now->r = sqrt(dn + RT_EPS);
@@ -471,16 +842,17 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 		if ( y1 < 0.0 )
 			ray_now->b = RT_PI2 - ray_now->b;
 /* */
-		ray_now->v = get_vel_ray( ray_now, shiftlo );
+		ray_now->v = get_vel_ray( ray_now, shiftlo, model, vel_type );
 	} while ( ray_now++ < ray_end );
 /* */
 	tn = get_ray_traveltime( _ray, ni );
 
 /* interation loop */
 	while ( ni <= N2 ) {
-		xfac = XFAC;
+		xfac = profile->xfac;
 		l = ni - 1;
-		for ( k = 0; k < NLOOP; k++ ) {
+		for ( k = 0; k < profile->max_loops; k++ ) {
+			iters++;
 			if ( ni > 2 || k == 0 ) {
 				for( j = 0; j < l; j++ ) {
 				/* See Um & Thurber (1987) p.974. */
@@ -546,7 +918,7 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 
 					/* Determine velocity at 3 points */
 						/* v1 = ray_prev->v; */
-						ray_mid.v = get_vel_ray( &ray_mid, shiftlo );
+						ray_mid.v = get_vel_ray( &ray_mid, shiftlo, model, vel_type );
 						/* v3 = ray_next->v; */
 					}
 					else {
@@ -572,15 +944,15 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 				/* Begin to determine coordinates of pints surroundibg point a2, b2, r2 at the distance ddseg */
 					upz = ray_mid.r + ddseg;
 					dwz = ray_mid.r - ddseg;
-					if ( upz > Rs ) {
-					/* I guess it should be Ro + 10.0(Rs) */
-						upz = Rs;
+					if ( upz > model->rs ) {
+					/* I guess it should be model->ro + 10.0(model->rs) */
+						upz = model->rs;
 						dwz = upz - dseg;
 					}
 					if ( dwz <= RT_EPS ) {
 						dwz = RT_EPS;
 						upz = dwz + dseg;
-					/* Set to Ro, the old mistake? */
+					/* Set to model->ro, the old mistake? */
 						//upz = Ro;
 					}
 
@@ -591,19 +963,19 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 					calc_tmp.a = ray_mid.a;
 					calc_tmp.b = ray_mid.b;
 					calc_tmp.r = upz;
-					vr = get_vel_ray( &calc_tmp, shiftlo );
+					vr = get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					calc_tmp.r = dwz;
-					vr -= get_vel_ray( &calc_tmp, shiftlo );
+					vr -= get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					//vr = calc_tmp.v; /* Orig. vr = calc_tmp.v/dseg */
 					step_ray_node( &calc_tmp, &ray_mid, ddseg, RT_RNULL );
-					vb = get_vel_ray( &calc_tmp, shiftlo );
+					vb = get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					step_ray_node( &calc_tmp, &ray_mid, -ddseg, RT_RNULL );
-					vb -= get_vel_ray( &calc_tmp, shiftlo );
+					vb -= get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					//vb = calc_tmp.v; /* Orig. vb = calc_tmp.v/dseg */
 					step_ray_node( &calc_tmp, &ray_mid, RT_RNULL, ddseg );
-					va = get_vel_ray( &calc_tmp, shiftlo );
+					va = get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					step_ray_node( &calc_tmp, &ray_mid, RT_RNULL, -ddseg );
-					va -= get_vel_ray( &calc_tmp, shiftlo );
+					va -= get_vel_ray( &calc_tmp, shiftlo, model, vel_type );
 					//va = calc_tmp.v; /* Orig. va = calc_tmp.v/dseg */
 				/*
 				 * spherical velocity gradient:
@@ -656,27 +1028,27 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 						da += ray_mid.a;
 						db += ray_mid.b;
 					/* if ray_now->r > 6371 then force it to the surface. */
-						if ( (ray_now->r = (dr - ray_now->r) * xfac + ray_now->r) > Rs )
-							ray_now->r = Rs;
+						if ( (ray_now->r = (dr - ray_now->r) * xfac + ray_now->r) > model->rs )
+							ray_now->r = model->rs;
 						ray_now->a = (da - ray_now->a) * xfac + ray_now->a;
 						ray_now->b = (db - ray_now->b) * xfac + ray_now->b;
-						ray_now->v = get_vel_ray( ray_now, shiftlo );
+						ray_now->v = get_vel_ray( ray_now, shiftlo, model, vel_type );
 					}
 				}
 			}
 			else {
 			/* ray_now = ray + (ni >> 1); */
 			/* if ray_now->r > 6371 then force it to the surface. */
-				if ( (ray_now->r = (dr - ray_now->r) * xfac + ray_now->r) > Rs )
-					ray_now->r = Rs;
+				if ( (ray_now->r = (dr - ray_now->r) * xfac + ray_now->r) > model->rs )
+					ray_now->r = model->rs;
 				ray_now->a = (da - ray_now->a) * xfac + ray_now->a;
 				ray_now->b = (db - ray_now->b) * xfac + ray_now->b;
-				ray_now->v = get_vel_ray( ray_now, shiftlo );
+				ray_now->v = get_vel_ray( ray_now, shiftlo, model, vel_type );
 			}
 /* */
 			to = tn;
 			tn = get_ray_traveltime( _ray, ni );
-			if ( fabs(to - tn) <= to * FLIMIT )
+			if ( fabs(to - tn) <= profile->tolerance )
 				break;
 		/* Random algorism, it will be faster but the result is not stable! */
 			//xfac = (double)(rand()%10 + 10)/10.0;
@@ -686,7 +1058,7 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 		}
 
 	/* Skip increasing of segment number if minimum length of segment is exceed or maximum number of segments was reached */
-		if ( dseg < MINS || ni >= N2 )
+		if ( dseg < profile->min_segment || ni >= N2 )
 			break;
 		/* igood = 1; */
 
@@ -739,7 +1111,7 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 				ray_now->b = RT_PI2 - ray_now->b;
 		/* */
 			ray_now->r *= 0.5;
-			ray_now->v = get_vel_ray( ray_now, shiftlo );
+			ray_now->v = get_vel_ray( ray_now, shiftlo, model, vel_type );
 		/* */
 			x1 = x3;
 			y1 = y3;
@@ -751,7 +1123,7 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 		to = tn;
 		tn = get_ray_traveltime( _ray, ni );
 	/* */
-		if ( fabs(to - tn) <= to * FLIMIT )
+		if ( fabs(to - tn) <= profile->tolerance )
 			break;
 		/* igood = 1; */
 	}
@@ -760,37 +1132,447 @@ static void raytracing_pb( double evla, double evlo, double evdp, double stla, d
 	*tk = tn;
 	*np = ni + 1;
 	memcpy(ray, _ray, sizeof(RAY_INFO) * (*np));
+	if ( info )
+		*info = (RT_TRACE_INFO){ iters, ni };
+/* */
+	if ( cache )
+		store_ray_cache( cache, _ray, *np, shiftlo, tn, profile->tolerance );
 
-	return;
+	return iters;
 }
 
 /**
- * @brief This subroutine calculate position of new point in polar coordinates basing on the coordinates
- *        of main point in radians (la is colatitude) and dx and dy in kilometers
+ * @brief The same pseudo-bending as raytracing_pb, but the nodes are kept in the Cartesian coordinates of
+ *        the shifted frame during the bending. The velocity gradient is taken along the Cartesian axes &
+ *        the nodes are converted to the geographic coordinates only for the velocity lookup, then the
+ *        whole ray is converted back to the spherical coordinates once at the end.
  *
- * @param new
- * @param origin
- * @param dx
- * @param dy
+ * @param model
+ * @param vel_type
+ * @param evla
+ * @param evlo
+ * @param evdp
+ * @param stla
+ * @param stlo
+ * @param stel
+ * @param ray
+ * @param np
+ * @param tk
+ * @param cache
+ * @param profile
+ * @param info
+ * @return int the number of the bending iterations
  */
-static void step_ray_node( RAY_INFO *new, const RAY_INFO *origin, const double dx, const double dy )
-{
-	const int flag_x = fabs(dx - RT_RNULL) > RT_RNULL;
-	const int flag_y = fabs(dy - RT_RNULL) > RT_RNULL;
+static int raytracing_pb_cart(
+	const RT_VELMOD *model, const int vel_type,
+	double evla, double evlo, double evdp, double stla, double stlo, double stel, RAY_INFO *ray, int *np, double *tk,
+	RT_RAY_CACHE *cache, const RT_PROFILE *profile, RT_TRACE_INFO *info
+) {
+	int ni, i, j, k;
+	int iters = 0;
+	int stride = 1;
 
-/* */
-	new->b = origin->b;
-	new->a = origin->a;
-/* */
-	if ( flag_y ) {
-		new->a += atan2(dy, origin->r);
-		if ( new->a > RT_PI ) {
-			new->a = RT_PI2 - new->a;
-			new->b += RT_PI;
-		}
-		if ( new->a < 0.0 ) {
-			new->a = fabs(new->a);
-			new->b += RT_PI;
+	CART_NODE _node[RT_MAX_NODE + 1];
+
+	CART_NODE *node_now = NULL;
+	CART_NODE *node_prev = NULL;
+	CART_NODE *node_next = NULL;
+
+	NODE_INFO terminal[2];
+
+	double xfac;
+	double shiftlo;
+	double to, tn;
+
+	double x1, y1, z1;
+	double mx, my, mz, mv;
+	double tx, ty, tz;
+	double gx, gy, gz;
+	double dx, dy, dz;
+	double dn, dseg, ddseg;
+	double rvs, cc, rcur;
+	double dshift = 0.0;
+
+	const RAY_INFO *ray_init = NULL;
+
+/* Parameters for calculation initialization */
+	if ( !profile )
+		profile = &rt_profile_fine;
+/* ni : number of ray segments */
+	ni = N1;
+	shiftlo = get_shifted_frame( model, evla, evlo, evdp, stla, stlo, stel, terminal );
+/* Warm start from the decimated cached ray, just like raytracing_pb */
+	if ( cache && cache->np > 2 ) {
+		ray_init = cache->ray;
+		for ( stride = WARM_DECIMATE; stride > 1 && (cache->np - 1) / stride < N1; stride >>= 1 );
+		ni = (cache->np - 1) / stride;
+		dshift = (cache->shiftlo - shiftlo) * RT_DEG2RAD;
+		POLAR2CARTESIAN( ray_init->r, ray_init->a, ray_init->b + dshift, x1, y1, z1 );
+		dx = (terminal[0].x - x1) / ni;
+		dy = (terminal[0].y - y1) / ni;
+		dz = (terminal[0].z - z1) / ni;
+	}
+	else {
+		dx = (terminal[1].x - terminal[0].x) / ni;
+		dy = (terminal[1].y - terminal[0].y) / ni;
+		dz = (terminal[1].z - terminal[0].z) / ni;
+	}
+/* */
+	for ( i = 0, node_now = _node; i <= ni; i++, node_now++ ) {
+		if ( i == 0 ) {
+			node_now->x = terminal[0].x;
+			node_now->y = terminal[0].y;
+			node_now->z = terminal[0].z;
+		}
+		else if ( i == ni ) {
+			node_now->x = terminal[1].x;
+			node_now->y = terminal[1].y;
+			node_now->z = terminal[1].z;
+		}
+		else if ( ray_init ) {
+			POLAR2CARTESIAN( ray_init[i * stride].r, ray_init[i * stride].a, ray_init[i * stride].b + dshift, x1, y1, z1 );
+			node_now->x = x1 + dx * (ni - i);
+			node_now->y = y1 + dy * (ni - i);
+			node_now->z = z1 + dz * (ni - i);
+		}
+		else {
+			node_now->x = terminal[0].x + dx * i;
+			node_now->y = terminal[0].y + dy * i;
+			node_now->z = terminal[0].z + dz * i;
+		}
+		node_now->v = get_vel_cart( node_now->x, node_now->y, node_now->z, shiftlo, model, vel_type );
+	}
+/* */
+	tn = get_cart_traveltime( _node, ni );
+	dseg = 0.0;
+
+/* interation loop */
+	while ( ni <= N2 ) {
+		xfac = profile->xfac;
+		for ( k = 0; k < profile->max_loops; k++ ) {
+			iters++;
+			for ( j = 0; j < ni - 1; j++ ) {
+			/* See Um & Thurber (1987) p.974. */
+				if ( !(j & 0x01) )
+					node_now = _node + (j >> 1) + 1;
+				else
+					node_now = _node + ni - ((j + 1) >> 1);
+				node_prev = node_now - 1;
+				node_next = node_now + 1;
+			/* The mid point & the chord between the neighbors */
+				mx = 0.5 * (node_prev->x + node_next->x);
+				my = 0.5 * (node_prev->y + node_next->y);
+				mz = 0.5 * (node_prev->z + node_next->z);
+				tx = node_next->x - node_prev->x;
+				ty = node_next->y - node_prev->y;
+				tz = node_next->z - node_prev->z;
+				dn = tx * tx + ty * ty + tz * tz;
+				dseg = 0.5 * sqrt(dn + RT_EPS);
+				ddseg = 0.5 * dseg;
+			/* The velocity & its gradient (multiplied by dseg) along the axes at the mid point */
+				mv = get_vel_cart( mx, my, mz, shiftlo, model, vel_type );
+			/* Keep all the probing points under the surface, just like the radial probing of raytracing_pb */
+				x1 = mx;
+				y1 = my;
+				z1 = mz;
+				if ( (rcur = sqrt(mx * mx + my * my + mz * mz + RT_EPS)) + ddseg > model->rs ) {
+					rcur = (model->rs - ddseg) / rcur;
+					x1 *= rcur;
+					y1 *= rcur;
+					z1 *= rcur;
+				}
+				gx = get_vel_cart( x1 + ddseg, y1, z1, shiftlo, model, vel_type ) - get_vel_cart( x1 - ddseg, y1, z1, shiftlo, model, vel_type );
+				gy = get_vel_cart( x1, y1 + ddseg, z1, shiftlo, model, vel_type ) - get_vel_cart( x1, y1 - ddseg, z1, shiftlo, model, vel_type );
+				gz = get_vel_cart( x1, y1, z1 + ddseg, shiftlo, model, vel_type ) - get_vel_cart( x1, y1, z1 - ddseg, shiftlo, model, vel_type );
+			/* The component normal to the chord */
+				rcur = (gx * tx + gy * ty + gz * tz) / dn;
+				dx = gx - rcur * tx;
+				dy = gy - rcur * ty;
+				dz = gz - rcur * tz;
+				rvs = dx * dx + dy * dy + dz * dz;
+			/* */
+				if ( rvs <= RT_EPS ) {
+				/* Special condition: velocity gradient equal to zero */
+					x1 = mx;
+					y1 = my;
+					z1 = mz;
+				}
+				else {
+					rvs = 1.0 / sqrt(rvs);
+					cc = 0.5 / node_prev->v + 0.5 / node_next->v;
+					rcur = (gx * dx + gy * dy + gz * dz) / dseg * rvs;
+					mv *= cc;
+					rcur = -(mv + 1.0) / (4.0 * cc * rcur);
+					rcur += sqrt(rcur * rcur + dn / (8.0 * mv) + RT_EPS);
+					rcur *= rvs;
+					x1 = mx + dx * rcur;
+					y1 = my + dy * rcur;
+					z1 = mz + dz * rcur;
+				}
+			/* Enhanced, & force it under the surface */
+				node_now->x += (x1 - node_now->x) * xfac;
+				node_now->y += (y1 - node_now->y) * xfac;
+				node_now->z += (z1 - node_now->z) * xfac;
+				if ( (rcur = node_now->x * node_now->x + node_now->y * node_now->y + node_now->z * node_now->z) > model->rs * model->rs ) {
+					rcur = model->rs / sqrt(rcur);
+					node_now->x *= rcur;
+					node_now->y *= rcur;
+					node_now->z *= rcur;
+				}
+				node_now->v = get_vel_cart( node_now->x, node_now->y, node_now->z, shiftlo, model, vel_type );
+			}
+		/* */
+			to = tn;
+			tn = get_cart_traveltime( _node, ni );
+			if ( fabs(to - tn) <= profile->tolerance )
+				break;
+			if ( (xfac *= 0.98) < 1.0 )
+				xfac = 1.0;
+		}
+
+	/* Skip increasing of segment number if minimum length of segment is exceed or maximum number of segments was reached */
+		if ( dseg < profile->min_segment || ni >= N2 )
+			break;
+	/* Double the number of points */
+		for ( i = ni; i > 0; i-- )
+			_node[i << 1] = _node[i];
+		ni <<= 1;
+		for ( i = 1; i < ni; i += 2 ) {
+			node_now = _node + i;
+			node_now->x = 0.5 * (node_now[-1].x + node_now[1].x);
+			node_now->y = 0.5 * (node_now[-1].y + node_now[1].y);
+			node_now->z = 0.5 * (node_now[-1].z + node_now[1].z);
+			node_now->v = get_vel_cart( node_now->x, node_now->y, node_now->z, shiftlo, model, vel_type );
+		}
+	/* */
+		to = tn;
+		tn = get_cart_traveltime( _node, ni );
+		if ( fabs(to - tn) <= profile->tolerance )
+			break;
+	}
+
+/* Output the result, back to the spherical coordinates */
+	*tk = tn;
+	*np = ni + 1;
+	for ( i = 0; i <= ni; i++ ) {
+		node_now = _node + i;
+		ray[i].r = sqrt(node_now->x * node_now->x + node_now->y * node_now->y + node_now->z * node_now->z + RT_EPS);
+		ray[i].a = atan2(sqrt(node_now->x * node_now->x + node_now->y * node_now->y), node_now->z);
+		if ( (ray[i].b = atan2(node_now->y, node_now->x)) < 0.0 )
+			ray[i].b += RT_PI2;
+		ray[i].v = node_now->v;
+	}
+	if ( info )
+		*info = (RT_TRACE_INFO){ iters, ni };
+/* */
+	if ( cache )
+		store_ray_cache( cache, ray, *np, shiftlo, tn, profile->tolerance );
+
+	return iters;
+}
+
+/**
+ * @brief Set up the shifted frame of the tracing, the longitudes of the source & receiver are shifted to
+ *        be symmetric about 90 degree. It returns the shift of longitude (in degree), & the Cartesian
+ *        coordinates of the source & receiver.
+ *
+ * @param model
+ * @param evla geocentric latitude of the source
+ * @param evlo
+ * @param evdp
+ * @param stla geocentric latitude of the receiver
+ * @param stlo
+ * @param stel
+ * @param terminal
+ * @return double
+ */
+static double get_shifted_frame(
+	const RT_VELMOD *model, double evla, double evlo, double evdp, double stla, double stlo, double stel, NODE_INFO terminal[2]
+) {
+	double da, db, dr;
+	double shiftlo;
+
+/*
+ * Longitude and latitude range from 0 to 180. This program does not work with angles greater than 180.
+ * Pass from latitude to colatitude
+ */
+	evla = (90.0 - evla) * RT_DEG2RAD;
+	stla = (90.0 - stla) * RT_DEG2RAD;
+/* da = bre, db = bso, dr = dlo */
+	if ( stlo < 0.0 )
+		da = 360.0 + stlo;
+	else
+		da = stlo;
+
+	if ( evlo < 0.0 )
+		db = 360.0 + evlo;
+	else
+		db = evlo;
+/* */
+	dr = fabs(db - da);
+	shiftlo = 0.0;
+	if ( dr < 180.0 ) {
+		if ( db < da ) {
+			evlo = (180.0 - dr) * 0.5;
+			stlo = evlo + dr;
+			shiftlo = db - evlo;
+		}
+		else {
+			stlo = (180.0 - dr) * 0.5;
+			evlo = stlo + dr;
+			shiftlo = da - stlo;
+		}
+	}
+	else {
+		dr = 360.0 - dr;
+		if ( db < da ) {
+			evlo = 90.0 + 0.5 * dr;
+			stlo = evlo - dr;
+			shiftlo = db - evlo;
+		}
+		else {
+			stlo = 90.0 + 0.5 * dr;
+			evlo = stlo - dr;
+			shiftlo = da - stlo;
+		}
+	}
+/* */
+	evlo *= RT_DEG2RAD;
+	stlo *= RT_DEG2RAD;
+/* */
+	evdp = model->ro - evdp;
+	stel = model->ro - stel;
+/* Epc. coordinates */
+	POLAR2CARTESIAN( evdp, evla, evlo, terminal[0].x, terminal[0].y, terminal[0].z );
+/* Rec. coordinates */
+	POLAR2CARTESIAN( stel, stla, stlo, terminal[1].x, terminal[1].y, terminal[1].z );
+
+	return shiftlo;
+}
+
+/**
+ * @brief
+ *
+ * @param model
+ * @param evla
+ * @param evlo
+ * @param evdp
+ * @param stla
+ * @param stlo
+ * @param stdp
+ * @return int
+ */
+static int check_coordinates(
+	const RT_VELMOD *model, const double evla, const double evlo, const double evdp, const double stla, const double stlo, const double stdp
+) {
+	if ( evla < model->lat_c[0] || evla > model->lat_c[model->nlat_c - 1] ) {
+		fprintf(stderr, "rt_main: Latitude(%lf) of source is out of range!\n", evla);
+		return -1;
+	}
+	if ( stla < model->lat_c[0] || stla > model->lat_c[model->nlat_c - 1] ) {
+		fprintf(stderr, "rt_main: Latitude(%lf) of station is out of range!\n", stla);
+		return -1;
+	}
+	if ( evlo < model->lon_c[0] || evlo > model->lon_c[model->nlon_c - 1] ) {
+		fprintf(stderr, "rt_main: Longitude(%lf) of source is out of range!\n", evlo);
+		return -1;
+	}
+	if ( stlo < model->lon_c[0] || stlo > model->lon_c[model->nlon_c - 1] ) {
+		fprintf(stderr, "rt_main: Longitude(%lf) of station is out of range!\n", stlo);
+		return -1;
+	}
+	if ( evdp < model->dep_c[0] || evdp > model->dep_c[model->ndep_c - 1] ) {
+		fprintf(stderr, "rt_main: Depth(%lf) of source is out of range!\n", evdp);
+		return -1;
+	}
+	if ( stdp < model->dep_c[0] || stdp > model->dep_c[model->ndep_c - 1] ) {
+		fprintf(stderr, "rt_main: Depth(%lf) of station is out of range!\n", stdp);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the approximate distance (in km) between the cached source & the new one.
+ *
+ * @param cache
+ * @param evla
+ * @param evlo
+ * @param evdp
+ * @return double
+ */
+static double get_source_shift( const RT_RAY_CACHE *cache, const double evla, const double evlo, const double evdp )
+{
+	const double km_per_deg = RT_DEG2RAD * 6371.0;
+	const double dx = (evlo - cache->evlo) * km_per_deg * cos(evla * RT_DEG2RAD);
+	const double dy = (evla - cache->evla) * km_per_deg;
+	const double dz = evdp - cache->evdp;
+
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/**
+ * @brief
+ *
+ * @param cache
+ * @param ray
+ * @param np
+ * @param shiftlo
+ * @param travel_time
+ * @param tolerance
+ * @return int
+ */
+static int store_ray_cache(
+	RT_RAY_CACHE *cache, const RAY_INFO *ray, const int np, const double shiftlo, const double travel_time, const double tolerance
+) {
+	RAY_INFO *_ray;
+
+/* */
+	if ( np > cache->capacity ) {
+		if ( (_ray = realloc(cache->ray, sizeof(RAY_INFO) * np)) == NULL ) {
+			cache->np = 0;
+			return -1;
+		}
+		cache->ray      = _ray;
+		cache->capacity = np;
+	}
+	memcpy(cache->ray, ray, sizeof(RAY_INFO) * np);
+	cache->np          = np;
+	cache->shiftlo     = shiftlo;
+	cache->travel_time = travel_time;
+	cache->tolerance   = tolerance;
+
+	return 0;
+}
+
+/**
+ * @brief This subroutine calculate position of new point in polar coordinates basing on the coordinates
+ *        of main point in radians (la is colatitude) and dx and dy in kilometers
+ *
+ * @param new
+ * @param origin
+ * @param dx
+ * @param dy
+ */
+static void step_ray_node( RAY_INFO *new, const RAY_INFO *origin, const double dx, const double dy )
+{
+	const int flag_x = fabs(dx - RT_RNULL) > RT_RNULL;
+	const int flag_y = fabs(dy - RT_RNULL) > RT_RNULL;
+
+/* */
+	new->b = origin->b;
+	new->a = origin->a;
+/* */
+	if ( flag_y ) {
+		new->a += atan2(dy, origin->r);
+		if ( new->a > RT_PI ) {
+			new->a = RT_PI2 - new->a;
+			new->b += RT_PI;
+		}
+		if ( new->a < 0.0 ) {
+			new->a = fabs(new->a);
+			new->b += RT_PI;
 		}
 	}
 /* */
@@ -853,22 +1635,74 @@ static double get_ray_traveltime( const RAY_INFO *ray, const int np )
 	return result;
 }
 
+/**
+ * @brief
+ *
+ * @param node
+ * @param ni
+ * @return double
+ */
+static double get_cart_traveltime( const CART_NODE *node, const int ni )
+{
+	const CART_NODE * const node_end = node + ni;
+
+	double dx, dy, dz;
+	double result = 0.0;
+
+	for ( ; node < node_end; node++ ) {
+		dx = node[1].x - node->x;
+		dy = node[1].y - node->y;
+		dz = node[1].z - node->z;
+		result += sqrt(dx * dx + dy * dy + dz * dz + RT_EPS) * (0.5 / node->v + 0.5 / node[1].v);
+	}
+
+	return result;
+}
+
 /**
  * @brief
  *
  * @param ray
  * @param shiftlon
+ * @param model
+ * @param vel_type
  * @return double
  */
-static double get_vel_ray( const RAY_INFO *ray, const double shiftlon )
+static double get_vel_ray( const RAY_INFO *ray, const double shiftlon, const RT_VELMOD *model, const int vel_type )
 {
 	double lat, lon, dep;
 
 	lat = geoc2geog(90.0 - ray->a * RT_RAD2DEG);
 	lon = ray->b * RT_RAD2DEG + shiftlon;
-	dep = Ro - ray->r;
+	dep = model->ro - ray->r;
+
+	return get_vel_geog(lon, lat, dep, model, vel_type);
+}
 
-	return get_vel_geog(lon, lat, dep);
+/**
+ * @brief Get the velocity at the Cartesian point of the shifted frame, the geographic latitude comes from
+ *        the geocentric one directly, tan(lat) = tan(geocentric lat) / RT_B2A_SQ.
+ *
+ * @param x
+ * @param y
+ * @param z
+ * @param shiftlon
+ * @param model
+ * @param vel_type
+ * @return double
+ */
+static double get_vel_cart(
+	const double x, const double y, const double z, const double shiftlon, const RT_VELMOD *model, const int vel_type
+) {
+	const double rxy = sqrt(x * x + y * y);
+	double       lon = atan2(y, x);
+
+	if ( lon < 0.0 )
+		lon += RT_PI2;
+
+	return get_vel_geog(
+		lon * RT_RAD2DEG + shiftlon, atan2(z, rxy * RT_B2A_SQ) * RT_RAD2DEG, model->ro - sqrt(rxy * rxy + z * z + RT_EPS), model, vel_type
+	);
 }
 
 /**
@@ -877,33 +1711,44 @@ static double get_vel_ray( const RAY_INFO *ray, const double shiftlon )
  * @param lon
  * @param lat
  * @param dep
+ * @param model
+ * @param vel_type
  * @return double
  */
-static double get_vel_geog( const double lon, const double lat, const double dep )
+static double get_vel_geog( const double lon, const double lat, const double dep, const RT_VELMOD *model, const int vel_type )
 {
 	double lonf, latf, depf;
 	double wv[8];
 	int ip, jp, kp;
 
+	const VEL_GRID *grid;
+	const float    *tile;
 	VEL_GRID velg;
 
-	ip = (int)(lon * Ibld3);
-	jp = (int)(lat * Ibld3);
-	kp = (int)(dep * Ibld4);
+	ip = (int)(lon * model->ibld3);
+	jp = (int)(lat * model->ibld3);
+	kp = (int)(dep * model->ibld4);
 
 /* If the ray point out of range, give it the center velocity */
-	if ( intmap_3d(&ip, &jp, &kp) )
+	if ( intmap_3d(model, &ip, &jp, &kp) )
 		return RT_EPS;
 /* */
-	lonf = Lon_c[ip];
-	lonf = (lon - lonf) / (Lon_c[ip + 1] - lonf);
-	latf = Lat_c[jp];
-	latf = (lat - latf) / (Lat_c[jp + 1] - latf);
-	depf = Dep_c[kp];
-	depf = (dep - depf) / (Dep_c[kp + 1] - depf);
+	lonf = model->lon_c[ip];
+	lonf = (lon - lonf) / (model->lon_c[ip + 1] - lonf);
+	latf = model->lat_c[jp];
+	latf = (lat - latf) / (model->lat_c[jp + 1] - latf);
+	depf = model->dep_c[kp];
+	depf = (dep - depf) / (model->dep_c[kp + 1] - depf);
+
+/* The compact layout */
+	if ( (tile = vel_type == RT_P_WAVE_VELOCITY ? model->veltile_p : model->veltile_s) ) {
+		tile += model->tileoff_lon[ip] + model->tileoff_lat[jp] + model->tileoff_dep[kp];
+		return get_vel_tile( tile, lonf, latf, depf );
+	}
 
 	//memcpy(&velg, Vel_grid + ip + jp*Nx_c + kp*Nxy_c, sizeof(VEL_GRID));
-	velg = *(Vel_grid + ip + jp * Nx_c + kp * Nxy_c);
+	grid = vel_type == RT_P_WAVE_VELOCITY ? model->velgrid_p : model->velgrid_s;
+	velg = *(grid + ip + jp * model->nx_c + kp * model->nxy_c);
 
 /*
  * lonf1 = 1.0 - lonf
@@ -940,14 +1785,42 @@ static double get_vel_geog( const double lon, const double lat, const double dep
 	return wv[0];
 }
 
+/**
+ * @brief The trilinear interpolation within the tile, the four corners of the upper & the lower
+ *        plane are weighted together as one vector.
+ *
+ * @param corner the (0,0,0) corner of the cell inside the tile
+ * @param lonf
+ * @param latf
+ * @param depf
+ * @return double
+ */
+static double get_vel_tile( const float *corner, const double lonf, const double latf, const double depf )
+{
+	const float  _lonf = lonf;
+	const float  _latf = latf;
+	const VEC4F  upper = { corner[0], corner[1], corner[VEL_TILE_NODES], corner[VEL_TILE_NODES + 1] };
+	const float *lower = corner + VEL_TILE_NODES * VEL_TILE_NODES;
+	const VEC4F  weight = {
+		(1.0f - _lonf) * (1.0f - _latf), _lonf * (1.0f - _latf), (1.0f - _lonf) * _latf, _lonf * _latf
+	};
+	VEC4F        vel = { lower[0], lower[1], lower[VEL_TILE_NODES], lower[VEL_TILE_NODES + 1] };
+
+/* */
+	vel = (upper + (vel - upper) * (float)depf) * weight;
+
+	return (double)(vel[0] + vel[1] + vel[2] + vel[3]);
+}
+
 /**
  * @brief
  *
+ * @param model
  * @param ip
  * @param jp
  * @param kp
  */
-static int intmap_3d( int *ip, int *jp, int *kp )
+static int intmap_3d( const RT_VELMOD *model, int *ip, int *jp, int *kp )
 {
 	const int lon = *ip;
 	const int lat = *jp;
@@ -958,180 +1831,263 @@ static int intmap_3d( int *ip, int *jp, int *kp )
  * *jp = (int)((lat + Lat1_c)/Bld3-1.0);
  * *kp = (int)((dep + Dep1_c)/Bld4-1.0);
  */
-	*ip += Ilon1_c;
-	*jp += Ilat1_c;
-	*kp += Idep1_c;
+	*ip += model->ilon1_c;
+	*jp += model->ilat1_c;
+	*kp += model->idep1_c;
 /* Checking process */
 	if ( *ip < 0 || *jp < 0 || *kp < 0 ||
-		*ip >= (Ilonmax - 2) || *jp >= (Ilatmax - 2) || *kp >= (Idepmax - 2)
+		*ip >= (model->ilonmax - 2) || *jp >= (model->ilatmax - 2) || *kp >= (model->idepmax - 2)
 	) {
 		fprintf(stderr, "intmap_3d: NOTICE!!! lon, lat or dep out of range! Force back to the nearest bolder.\n" );
-		fprintf(stderr, "lon = %lf, lat = %lf, dep = %lf\n", (double)lon / Ibld3, (double)lat / Ibld3, (double)dep / Ibld4);
+		fprintf(stderr, "lon = %lf, lat = %lf, dep = %lf\n", (double)lon / model->ibld3, (double)lat / model->ibld3, (double)dep / model->ibld4);
 		fprintf(stderr, "ip = %d, jp = %d, kp = %d\n", *ip, *jp, *kp);
 		return -1;
 	}
 /* */
-	*ip = Ilon_c[*ip];
-	*jp = Ilat_c[*jp];
-	*kp = Idep_c[*kp];
+	*ip = model->ilon_c[*ip];
+	*jp = model->ilat_c[*jp];
+	*kp = model->idep_c[*kp];
 
 	return 0;
 }
 
 /**
- * @brief
+ * @brief Read the text model: the header line "bld3 bld4 nlon nlat ndep", the longitude, latitude & depth
+ *        axes in one line each, then the P & S velocities with one line per latitude. The lines are read
+ *        by getline, so there isn't any limit of the line length.
  *
+ * @param model
  * @param modelfile
+ * @param vel_p
+ * @param vel_s
  * @return int
  */
-static int input_vel_model( const char *modelfile )
+static int input_vel_model( RT_VELMOD *model, const char *modelfile, double **vel_p, double **vel_s )
 {
 	double *ptrtmp = NULL;
-	double bld3, bld4;
-	double average;
-	char fracline[1024] = { 0 };
-	FILE *fp = NULL;
+	char   *line = NULL;
+	size_t  line_size = 0;
+	int     result = -1;
+	FILE   *fp = NULL;
 
 /* */
 	if ( (fp = fopen(modelfile, "r")) == NULL ) {
 		fprintf(stderr, "input_vel_model: Opening %s file ERROR; exiting!\n", modelfile);
 		return -1;
 	}
-	if ( fscanf(fp, "%lf %lf %d %d %d\n", &bld3, &bld4, &Nlon_c, &Nlat_c, &Ndep_c) != 5 ) {
+	if (
+		getline(&line, &line_size, fp) < 0 ||
+		sscanf(line, "%lf %lf %d %d %d", &model->bld3, &model->bld4, &model->nlon_c, &model->nlat_c, &model->ndep_c) != 5 ||
+		model->nlon_c < 2 || model->nlat_c < 2 || model->ndep_c < 2
+	) {
 		fprintf(stderr, "input_vel_model: Reading VpVs Model header ERROR; exiting!\n" );
-		return -1;
+		goto end_process;
 	}
 /* */
-	Lon_c = calloc(Nlon_c, sizeof(double));
-	Lat_c = calloc(Nlat_c, sizeof(double));
-	Dep_c = calloc(Ndep_c, sizeof(double));
-
-	Nx_c = Nlon_c;
-	Nxy_c = Nx_c * Nlat_c;
-	Nxyz_c = Nxy_c * Ndep_c;
-
-	Vel_p = calloc(Nxyz_c, sizeof(double));
-	Vel_s = calloc(Nxyz_c, sizeof(double));
-/* */
-	if ( fgets(fracline, sizeof(fracline) - 1, fp) != NULL ) {
-		ptrtmp = Lon_c;
-		for ( int i = 0; i < Nlon_c; i++ ) {
-			if ( i < Nlon_c - 1 ) {
-				if ( sscanf(fracline, " %lf %[^\n]", ptrtmp, fracline) != 2 ) {
-					fprintf(stderr, "input_vel_model: Reading VpVs Model lon_c ERROR; exiting!\n" );
-					return -1;
-				}
-			}
-			else {
-				if ( sscanf(fracline, "%lf", ptrtmp) != 1 ) {
-					fprintf(stderr, "input_vel_model: Reading VpVs Model lon_c ERROR; exiting!\n" );
-					return -1;
-				}
-			}
-			ptrtmp++;
-		}
+	model->lon_c = calloc(model->nlon_c, sizeof(double));
+	model->lat_c = calloc(model->nlat_c, sizeof(double));
+	model->dep_c = calloc(model->ndep_c, sizeof(double));
+
+	model->nx_c = model->nlon_c;
+	model->nxy_c = model->nx_c * model->nlat_c;
+	model->nxyz_c = model->nxy_c * model->ndep_c;
+
+	*vel_p = calloc(model->nxyz_c, sizeof(double));
+	*vel_s = calloc(model->nxyz_c, sizeof(double));
+	if ( !model->lon_c || !model->lat_c || !model->dep_c || !*vel_p || !*vel_s ) {
+		fprintf(stderr, "input_vel_model: Error allocating memory for VpVs Model; exiting!\n" );
+		goto end_process;
 	}
 /* */
-	if ( fgets( fracline, sizeof(fracline) - 1, fp ) != NULL ) {
-		ptrtmp = Lat_c;
-		for ( int i = 0; i < Nlat_c; i++ ) {
-			if ( i < Nlat_c - 1 ) {
-				if ( sscanf( fracline, "%lf %[^\n]", ptrtmp, fracline ) != 2 ) {
-					printf("Reading VpVs Model lat_c error; exiting!\n");
-					return -1;
-				}
-			}
-			else {
-				if ( sscanf( fracline, "%lf", ptrtmp ) != 1 ) {
-					fprintf(stderr, "input_vel_model: Reading VpVs Model lat_c ERROR; exiting!\n" );
-					return -1;
-				}
-			}
-			ptrtmp++;
-		}
+	if ( read_model_line( fp, &line, &line_size, model->lon_c, model->nlon_c ) ) {
+		fprintf(stderr, "input_vel_model: Reading VpVs Model lon_c ERROR; exiting!\n" );
+		goto end_process;
 	}
-/* */
-	if ( fgets( fracline, sizeof(fracline) - 1, fp ) != NULL ) {
-		ptrtmp = Dep_c;
-		for ( int i = 0; i < Ndep_c; i++ ) {
-			if ( i < Ndep_c - 1 ) {
-				if ( sscanf( fracline, "%lf %[^\n]", ptrtmp, fracline ) != 2 ) {
-					fprintf(stderr, "input_vel_model: Reading VpVs Model dep_c ERROR; exiting!\n" );
-					return -1;
-				}
-			}
-			else {
-				if ( sscanf( fracline, "%lf", ptrtmp ) != 1 ) {
-					fprintf(stderr, "input_vel_model: Reading VpVs Model dep_c ERROR; exiting!\n" );
-					return -1;
-				}
-			}
-			ptrtmp++;
-		}
+	if ( read_model_line( fp, &line, &line_size, model->lat_c, model->nlat_c ) ) {
+		fprintf(stderr, "input_vel_model: Reading VpVs Model lat_c ERROR; exiting!\n" );
+		goto end_process;
+	}
+	if ( read_model_line( fp, &line, &line_size, model->dep_c, model->ndep_c ) ) {
+		fprintf(stderr, "input_vel_model: Reading VpVs Model dep_c ERROR; exiting!\n" );
+		goto end_process;
 	}
 /* Read P velocity model */
-	ptrtmp = Vel_p;
-	for ( int k = 0; k < Ndep_c; k++ ) {
-		for ( int j = 0; j < Nlat_c; j++ ) {
-			if ( fgets(fracline, sizeof(fracline) - 1, fp) != NULL ) {
-				for ( int i = 0; i < Nlon_c; i++ ) {
-					if ( i < Nlon_c - 1 ) {
-						if ( sscanf(fracline, "%lf %[^\n]", ptrtmp, fracline) != 2 ) {
-							fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_p ERROR; exiting!\n" );
-							return -1;
-						}
-					}
-					else {
-						if ( sscanf(fracline, "%lf", ptrtmp) != 1 ) {
-							fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_p ERROR; exiting!\n" );
-							return -1;
-						}
-					}
-					ptrtmp++;
-				}
-			}
+	ptrtmp = *vel_p;
+	for ( int i = 0; i < model->nxyz_c; i += model->nx_c, ptrtmp += model->nx_c ) {
+		if ( read_model_line( fp, &line, &line_size, ptrtmp, model->nx_c ) ) {
+			fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_p ERROR; exiting!\n" );
+			goto end_process;
 		}
 	}
 /* Read S velocity model */
-	ptrtmp = Vel_s;
-	for ( int k = 0; k < Ndep_c; k++ ) {
-		for ( int j = 0; j < Nlat_c; j++ ) {
-			if ( fgets( fracline, sizeof(fracline) - 1, fp ) != NULL ) {
-				for ( int i = 0; i < Nlon_c; i++ ) {
-					if ( i < Nlon_c - 1 ) {
-						if ( sscanf( fracline, "%lf %[^\n]", ptrtmp, fracline ) != 2 ) {
-							fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_s ERROR; exiting!\n" );
-							return -1;
-						}
-					}
-					else {
-						if ( sscanf( fracline, "%lf", ptrtmp ) != 1 ) {
-							fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_s ERROR; exiting!\n" );
-							return -1;
-						}
-					}
-					ptrtmp++;
-				}
-			}
+	ptrtmp = *vel_s;
+	for ( int i = 0; i < model->nxyz_c; i += model->nx_c, ptrtmp += model->nx_c ) {
+		if ( read_model_line( fp, &line, &line_size, ptrtmp, model->nx_c ) ) {
+			fprintf(stderr, "input_vel_model: Reading VpVs Model Vel_s ERROR; exiting!\n" );
+			goto end_process;
 		}
 	}
 /* */
+	result = 0;
+end_process:
+	free(line);
+	fclose(fp);
+
+	return result;
+}
+
+/**
+ * @brief Read one line of the text model & parse the first count values of it by strtod, which
+ *        keeps the cost linear to the line length.
+ *
+ * @param fp
+ * @param line
+ * @param line_size
+ * @param dest
+ * @param count
+ * @return int
+ */
+static int read_model_line( FILE *fp, char **line, size_t *line_size, double *dest, const int count )
+{
+	char *ptr;
+	char *endptr;
+
+/* */
+	if ( getline(line, line_size, fp) < 0 )
+		return -1;
+/* */
+	ptr = *line;
+	for ( int i = 0; i < count; i++, ptr = endptr ) {
+		dest[i] = strtod(ptr, &endptr);
+		if ( endptr == ptr )
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check the magic number at the beginning of the model file.
+ *
+ * @param modelfile
+ * @return int
+ */
+static int is_binary_model( const char *modelfile )
+{
+	uint32_t magic = 0;
+	FILE    *fp;
+
+/* */
+	if ( (fp = fopen(modelfile, "rb")) == NULL )
+		return 0;
+	if ( fread(&magic, sizeof(uint32_t), 1, fp) != 1 )
+		magic = 0;
 	fclose(fp);
+
+	return magic == VELMOD_MAGIC;
+}
+
+/**
+ * @brief Map the binary model into the memory read-only & shared, so the cell grids are used in
+ *        place & several processes with the same model will share the same physical pages.
+ *
+ * @param model
+ * @param modelfile
+ * @return int
+ */
+static int map_vel_model( RT_VELMOD *model, const char *modelfile )
+{
+	int                   fd;
+	void                 *map;
+	struct stat           fs;
+	const VELMOD_HEADER  *header;
+
 /* */
-	if ( bldmap( bld3, bld4 ) )
+	if ( (fd = open(modelfile, O_RDONLY)) < 0 ) {
+		fprintf(stderr, "map_vel_model: Opening %s file ERROR; exiting!\n", modelfile);
+		return -1;
+	}
+	if ( fstat(fd, &fs) || fs.st_size < (off_t)sizeof(VELMOD_HEADER) ) {
+		fprintf(stderr, "map_vel_model: Binary model %s is truncated; exiting!\n", modelfile);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED ) {
+		fprintf(stderr, "map_vel_model: Mapping %s file ERROR; exiting!\n", modelfile);
+		return -1;
+	}
+	model->map      = map;
+	model->map_size = fs.st_size;
+/* Check the header & the size */
+	header = (const VELMOD_HEADER *)map;
+	if (
+		header->magic != VELMOD_MAGIC || header->version != VELMOD_VERSION ||
+		header->nlon < 2 || header->nlat < 2 || header->ndep < 2 ||
+		(size_t)fs.st_size != get_binary_model_size( header->nlon, header->nlat, header->ndep )
+	) {
+		fprintf(stderr, "map_vel_model: Binary model %s header ERROR; exiting!\n", modelfile);
+		return -1;
+	}
+/* */
+	model->bld3   = header->bld3;
+	model->bld4   = header->bld4;
+	model->nlon_c = header->nlon;
+	model->nlat_c = header->nlat;
+	model->ndep_c = header->ndep;
+	model->nx_c   = model->nlon_c;
+	model->nxy_c  = model->nx_c * model->nlat_c;
+	model->nxyz_c = model->nxy_c * model->ndep_c;
+/* The axes & the cell grids are just pointing into the mapping */
+	model->lon_c     = (double *)(header + 1);
+	model->lat_c     = model->lon_c + model->nlon_c;
+	model->dep_c     = model->lat_c + model->nlat_c;
+	model->velgrid_p = (VEL_GRID *)(model->dep_c + model->ndep_c);
+	model->velgrid_s = model->velgrid_p + model->nxyz_c;
+
+	return 0;
+}
+
+/**
+ * @brief
+ *
+ * @param nlon
+ * @param nlat
+ * @param ndep
+ * @return size_t
+ */
+static size_t get_binary_model_size( const size_t nlon, const size_t nlat, const size_t ndep )
+{
+	return sizeof(VELMOD_HEADER) + (nlon + nlat + ndep) * sizeof(double) + 2 * nlon * nlat * ndep * sizeof(VEL_GRID);
+}
+
+/**
+ * @brief Build the index mapping & the radius constants, they are derived from the axes & not stored
+ *        in the binary model.
+ *
+ * @param model
+ * @return int
+ */
+static int init_vel_model( RT_VELMOD *model )
+{
+	double average;
+
+/* */
+	if ( bldmap( model, model->bld3, model->bld4 ) )
 		return -1;
 
 /*
- * Nx2_c = Nlon_c - 2;
- * Nxy2_c = Nx2_c * (Nlat_c-2);
- * Nxyz2_c = Nxy2_c * (Ndep_c-2);
+ * Nx2_c = model->nlon_c - 2;
+ * Nxy2_c = Nx2_c * (model->nlat_c-2);
+ * Nxyz2_c = Nxy2_c * (model->ndep_c-2);
  */
 	average = 0.0;
-	for ( int i = 0; i < Nlat_c; i++ )
-		average += Lat_c[i];
-	average /= (double)Nlat_c;
-	Ro = get_earth_radius(average);
-	Rs = Ro + 10.0;
+	for ( int i = 0; i < model->nlat_c; i++ )
+		average += model->lat_c[i];
+	average /= (double)model->nlat_c;
+	model->ro = get_earth_radius(average);
+	model->rs = model->ro + 10.0;
 
 	return 0;
 }
@@ -1139,58 +2095,59 @@ static int input_vel_model( const char *modelfile )
 /**
  * @brief
  *
+ * @param model
  * @param bld3
  * @param bld4
  * @return int
  */
-static int bldmap( const double bld3, const double bld4 )
+static int bldmap( RT_VELMOD *model, const double bld3, const double bld4 )
 {
 	int matrix_index;
 /* For crustal velocity */
-	const double lon1 = -Lon_c[0];
-	const double lat1 = -Lat_c[0];
-	const double dep1 = -Dep_c[0];
+	const double lon1 = -model->lon_c[0];
+	const double lat1 = -model->lat_c[0];
+	const double dep1 = -model->dep_c[0];
 
-	Ilonmax = (int)(RT_EPS + (Lon_c[Nlon_c-1] + lon1) / bld3);
-	Ilatmax = (int)(RT_EPS + (Lat_c[Nlat_c-1] + lat1) / bld3);
-	Idepmax = (int)(RT_EPS + (Dep_c[Ndep_c-1] + dep1) / bld4);
+	model->ilonmax = (int)(RT_EPS + (model->lon_c[model->nlon_c-1] + lon1) / bld3);
+	model->ilatmax = (int)(RT_EPS + (model->lat_c[model->nlat_c-1] + lat1) / bld3);
+	model->idepmax = (int)(RT_EPS + (model->dep_c[model->ndep_c-1] + dep1) / bld4);
 
-	if ( Ilonmax > RT_MAX_NODE || Ilatmax > RT_MAX_NODE || Idepmax > RT_MAX_NODE ) {
+	if ( model->ilonmax > RT_MAX_NODE || model->ilatmax > RT_MAX_NODE || model->idepmax > RT_MAX_NODE ) {
 		fprintf(stderr, "bldmap: ERROR!! Model dimension too big (Max. %d)!\n", RT_MAX_NODE);
 		return -1;
 	}
 
-	Ilon_c = calloc(Ilonmax, sizeof(int));
-	Ilat_c = calloc(Ilatmax, sizeof(int));
-	Idep_c = calloc(Idepmax, sizeof(int));
+	model->ilon_c = calloc(model->ilonmax, sizeof(int));
+	model->ilat_c = calloc(model->ilatmax, sizeof(int));
+	model->idep_c = calloc(model->idepmax, sizeof(int));
 
 	matrix_index = 0;
-	for ( int i = 0; i < Ilonmax; i++ ) {
-		if ( (i * bld3 - lon1) >= Lon_c[matrix_index + 1] )
+	for ( int i = 0; i < model->ilonmax; i++ ) {
+		if ( (i * bld3 - lon1) >= model->lon_c[matrix_index + 1] )
 			matrix_index++;
-		Ilon_c[i] = matrix_index;
+		model->ilon_c[i] = matrix_index;
 	}
 
 	matrix_index = 0;
-	for ( int i = 0; i < Ilatmax; i++ ) {
-		if ( (i * bld3 - lat1) >= Lat_c[matrix_index + 1] )
+	for ( int i = 0; i < model->ilatmax; i++ ) {
+		if ( (i * bld3 - lat1) >= model->lat_c[matrix_index + 1] )
 			matrix_index++;
-		Ilat_c[i] = matrix_index;
+		model->ilat_c[i] = matrix_index;
 	}
 
 	matrix_index = 0;
-	for ( int i = 0; i < Idepmax; i++ ) {
-		if ( (i * bld4 - dep1) >= Dep_c[matrix_index + 1] )
+	for ( int i = 0; i < model->idepmax; i++ ) {
+		if ( (i * bld4 - dep1) >= model->dep_c[matrix_index + 1] )
 			matrix_index++;
-		Idep_c[i] = matrix_index;
+		model->idep_c[i] = matrix_index;
 	}
 
 /* Change coordinates to integer */
-	Ilon1_c = (int)(lon1 / bld3);
-	Ilat1_c = (int)(lat1 / bld3);
-	Idep1_c = (int)(dep1 / bld4 + RT_EPS);
-	Ibld3 = (int)(1.0 / bld3 + RT_EPS);
-	Ibld4 = (int)(1.0 / bld4 + RT_EPS);
+	model->ilon1_c = (int)(lon1 / bld3);
+	model->ilat1_c = (int)(lat1 / bld3);
+	model->idep1_c = (int)(dep1 / bld4 + RT_EPS);
+	model->ibld3 = (int)(1.0 / bld3 + RT_EPS);
+	model->ibld4 = (int)(1.0 / bld4 + RT_EPS);
 
 	return 0;
 }
@@ -1257,6 +2214,45 @@ static int vel_point2grid( const double *vel_p, VEL_GRID *vel_g, const int nxyz,
 	return 0;
 }
 
+/**
+ * @brief Copy the node velocities (the first corner of each cell grid) into the tiles, the nodes
+ *        beyond the model's edge are filled by the edge's.
+ *
+ * @param model
+ * @param vel_g
+ * @param tiles
+ */
+static void vel_grid2tile( const RT_VELMOD *model, const VEL_GRID *vel_g, float *tiles )
+{
+	int ii, jj, kk;
+	const int ntile_y = model->ntile_xy / model->ntile_x;
+	const int ntile_z = (model->ndep_c - 2) / VEL_TILE_CELLS + 1;
+
+/* */
+	for ( int tk = 0; tk < ntile_z; tk++ ) {
+		for ( int tj = 0; tj < ntile_y; tj++ ) {
+			for ( int ti = 0; ti < model->ntile_x; ti++, tiles += VEL_TILE_SIZE ) {
+				for ( int k = 0; k < VEL_TILE_NODES; k++ ) {
+					if ( (kk = tk * VEL_TILE_CELLS + k) >= model->ndep_c )
+						kk = model->ndep_c - 1;
+					for ( int j = 0; j < VEL_TILE_NODES; j++ ) {
+						if ( (jj = tj * VEL_TILE_CELLS + j) >= model->nlat_c )
+							jj = model->nlat_c - 1;
+						for ( int i = 0; i < VEL_TILE_NODES; i++ ) {
+							if ( (ii = ti * VEL_TILE_CELLS + i) >= model->nlon_c )
+								ii = model->nlon_c - 1;
+							tiles[i + VEL_TILE_NODES * (j + VEL_TILE_NODES * k)] =
+								vel_g[ii + jj * model->nx_c + kk * model->nxy_c].vel[0];
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return;
+}
+
 /**
  * @brief
  *
@@ -1304,3 +2300,30 @@ static double get_earth_radius( double xlat )
 
 	return re * (1.0 - dlt1 / ell);
 }
+
+/**
+ * @brief Hash the data by 64-bit words with the FNV-1a like mixing, the remaining bytes are hashed one
+ *        by one.
+ *
+ * @param hash
+ * @param data
+ * @param size
+ * @return uint64_t
+ */
+static uint64_t hash_model_data( uint64_t hash, const void *data, const size_t size )
+{
+	const uint8_t *ptr = (const uint8_t *)data;
+	uint64_t       word;
+	size_t         i;
+
+/* */
+	for ( i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t) ) {
+		memcpy(&word, ptr + i, sizeof(uint64_t));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	for ( ; i < size; i++ )
+		hash = (hash ^ ptr[i]) * 0x100000001b3ULL;
+
+	return hash;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file tttable.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Memory-mappable travel time grid of single station & single phase.
+ * @version 0.1
+ * @date 2023-10-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#define _GNU_SOURCE
+/* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* */
+#include <tttable.h>
+
+/* The tolerance when comparing the header's coordinates */
+#define TT_HEADER_TOLERANCE  1.0e-6
+
+/* */
+static size_t get_table_nodes( const TT_TABLE_HEADER * );
+
+/**
+ * @brief Generate the travel time of each node by the input function, then write it to the file.
+ *        The file will be written to a temporary file first & renamed after finishing, therefore
+ *        the other processes will never map a half-written table.
+ *
+ * @param path
+ * @param header
+ * @param func
+ * @param arg
+ * @return int
+ */
+int tt_table_create( const char *path, const TT_TABLE_HEADER *header, TT_TABLE_TRAVEL_FUNC func, void *arg )
+{
+	float   *data;
+	float   *dptr;
+	double   tt;
+	int      ret;
+/* */
+	const size_t nodes = get_table_nodes( header );
+
+/* */
+	if ( !nodes || !(data = malloc(nodes * sizeof(float))) )
+		return -1;
+/* */
+	dptr = data;
+	for ( uint32_t k = 0; k < header->ndep; k++ ) {
+		for ( uint32_t j = 0; j < header->nlat; j++ ) {
+			for ( uint32_t i = 0; i < header->nlon; i++, dptr++ ) {
+				tt = func(
+					arg, header->lon0 + i * header->dlon, header->lat0 + j * header->dlat, header->dep0 + k * header->ddep
+				);
+			/* Aborted by the travel time function */
+				if ( isnan(tt) ) {
+					free(data);
+					return -1;
+				}
+				*dptr = tt < 0.0 ? TT_TABLE_NULL : (float)tt;
+			}
+		}
+	}
+/* */
+	ret = tt_table_save( path, header, data );
+	free(data);
+
+	return ret;
+}
+
+/**
+ * @brief Write the travel times which are already derived to the file, by the same way as the above.
+ *
+ * @param path
+ * @param header
+ * @param data
+ * @return int
+ */
+int tt_table_save( const char *path, const TT_TABLE_HEADER *header, const float *data )
+{
+	char     tmp_path[strlen(path) + 8];
+	FILE    *fp;
+	int      ret = 0;
+/* */
+	TT_TABLE_HEADER _header = *header;
+	const size_t    nodes   = get_table_nodes( header );
+
+/* */
+	if ( !nodes )
+		return -1;
+	_header.magic   = TT_TABLE_MAGIC;
+	_header.version = TT_TABLE_VERSION;
+	sprintf(tmp_path, "%s.tmp", path);
+	if ( (fp = fopen(tmp_path, "wb")) == NULL )
+		return -1;
+	if (
+		fwrite(&_header, sizeof(TT_TABLE_HEADER), 1, fp) != 1 ||
+		fwrite(data, sizeof(float), nodes, fp) != nodes
+	) {
+		ret = -1;
+	}
+	if ( fclose(fp) )
+		ret = -1;
+/* */
+	if ( ret || rename(tmp_path, path) ) {
+		remove(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Map the table file into the memory.
+ *
+ * @param path
+ * @return TT_TABLE*
+ */
+TT_TABLE *tt_table_open( const char *path )
+{
+	int          fd;
+	void        *map;
+	struct stat  fs;
+	TT_TABLE    *result = NULL;
+	const TT_TABLE_HEADER *header;
+
+/* */
+	if ( (fd = open(path, O_RDONLY)) < 0 )
+		return NULL;
+	if ( fstat(fd, &fs) || fs.st_size < (off_t)sizeof(TT_TABLE_HEADER) ) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED )
+		return NULL;
+/* Check the header & the size */
+	header = (const TT_TABLE_HEADER *)map;
+	if (
+		header->magic != TT_TABLE_MAGIC || header->version != TT_TABLE_VERSION ||
+		header->nlon < 2 || header->nlat < 2 || header->ndep < 2 ||
+		(size_t)fs.st_size != sizeof(TT_TABLE_HEADER) + get_table_nodes( header ) * sizeof(float)
+	) {
+		munmap(map, fs.st_size);
+		return NULL;
+	}
+/* */
+	if ( (result = malloc(sizeof(TT_TABLE))) == NULL ) {
+		munmap(map, fs.st_size);
+		return NULL;
+	}
+	result->header = header;
+	result->data   = (const float *)(header + 1);
+	result->size   = fs.st_size;
+
+	return result;
+}
+
+/**
+ * @brief Check if the table is built with the same grid, phase, method, receiver & velocity model.
+ *
+ * @param table
+ * @param header
+ * @return int
+ */
+int tt_table_match( const TT_TABLE *table, const TT_TABLE_HEADER *header )
+{
+	const TT_TABLE_HEADER *_header = table->header;
+
+	return
+		_header->nlon == header->nlon && _header->nlat == header->nlat && _header->ndep == header->ndep &&
+		_header->phase == header->phase && _header->method == header->method && _header->model == header->model &&
+		fabs(_header->lon0 - header->lon0) < TT_HEADER_TOLERANCE &&
+		fabs(_header->lat0 - header->lat0) < TT_HEADER_TOLERANCE &&
+		fabs(_header->dep0 - header->dep0) < TT_HEADER_TOLERANCE &&
+		fabs(_header->dlon - header->dlon) < TT_HEADER_TOLERANCE &&
+		fabs(_header->dlat - header->dlat) < TT_HEADER_TOLERANCE &&
+		fabs(_header->ddep - header->ddep) < TT_HEADER_TOLERANCE &&
+		fabs(_header->sta_lon - header->sta_lon) < TT_HEADER_TOLERANCE &&
+		fabs(_header->sta_lat - header->sta_lat) < TT_HEADER_TOLERANCE &&
+		fabs(_header->sta_elev - header->sta_elev) < TT_HEADER_TOLERANCE;
+}
+
+/**
+ * @brief Trilinear interpolate the travel time & its gradient (in second per degree of longitude,
+ *        latitude & second per km of depth) at the input source.
+ *
+ * @param table
+ * @param lon
+ * @param lat
+ * @param dep
+ * @param travel_time
+ * @param gradient
+ * @return int
+ */
+int tt_table_lookup( const TT_TABLE *table, const double lon, const double lat, const double dep, double *travel_time, double gradient[3] )
+{
+	const TT_TABLE_HEADER *header = table->header;
+	const float           *corner;
+	int    i, j, k;
+	double fx, fy, fz;
+	double c00, c01, c10, c11;
+	double c0, c1;
+	double d00, d01, d10, d11;
+	double e0, e1;
+	float  v[8];
+
+/* Locate the cell */
+	fx = (lon - header->lon0) / header->dlon;
+	fy = (lat - header->lat0) / header->dlat;
+	fz = (dep - header->dep0) / header->ddep;
+	if (
+		fx < 0.0 || fy < 0.0 || fz < 0.0 ||
+		fx > (double)(header->nlon - 1) || fy > (double)(header->nlat - 1) || fz > (double)(header->ndep - 1)
+	) {
+		return -1;
+	}
+	if ( (i = (int)fx) > (int)header->nlon - 2 )
+		i = header->nlon - 2;
+	if ( (j = (int)fy) > (int)header->nlat - 2 )
+		j = header->nlat - 2;
+	if ( (k = (int)fz) > (int)header->ndep - 2 )
+		k = header->ndep - 2;
+	fx -= i;
+	fy -= j;
+	fz -= k;
+/* Fetch the eight corners, v[bit2:z bit1:y bit0:x] */
+	corner = table->data + i + header->nlon * (j + (size_t)header->nlat * k);
+	v[0] = corner[0];
+	v[1] = corner[1];
+	v[2] = corner[header->nlon];
+	v[3] = corner[header->nlon + 1];
+	corner += (size_t)header->nlon * header->nlat;
+	v[4] = corner[0];
+	v[5] = corner[1];
+	v[6] = corner[header->nlon];
+	v[7] = corner[header->nlon + 1];
+	for ( i = 0; i < 8; i++ )
+		if ( v[i] < 0.0f )
+			return -1;
+/* Along x first */
+	c00 = v[0] + (v[1] - v[0]) * fx;
+	c10 = v[2] + (v[3] - v[2]) * fx;
+	c01 = v[4] + (v[5] - v[4]) * fx;
+	c11 = v[6] + (v[7] - v[6]) * fx;
+	d00 = v[1] - v[0];
+	d10 = v[3] - v[2];
+	d01 = v[5] - v[4];
+	d11 = v[7] - v[6];
+/* Then y */
+	c0 = c00 + (c10 - c00) * fy;
+	c1 = c01 + (c11 - c01) * fy;
+	e0 = d00 + (d10 - d00) * fy;
+	e1 = d01 + (d11 - d01) * fy;
+/* Then z */
+	*travel_time = c0 + (c1 - c0) * fz;
+	if ( gradient ) {
+		gradient[0] = (e0 + (e1 - e0) * fz) / header->dlon;
+		gradient[1] = ((c10 - c00) + ((c11 - c01) - (c10 - c00)) * fz) / header->dlat;
+		gradient[2] = (c1 - c0) / header->ddep;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief
+ *
+ * @param table
+ */
+void tt_table_close( TT_TABLE *table )
+{
+	if ( table ) {
+		munmap((void *)table->header, table->size);
+		free(table);
+	}
+
+	return;
+}
+
+/**
+ * @brief
+ *
+ * @param header
+ * @return size_t
+ */
+static size_t get_table_nodes( const TT_TABLE_HEADER *header )
+{
+	return (size_t)header->nlon * header->nlat * header->ndep;
+}
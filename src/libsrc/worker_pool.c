@@ -0,0 +1,232 @@
+/**
+ * @file worker_pool.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief The persistent worker threads which run the indexed tasks of the batch in parallel. Several
+ *        threads could submit their batches at the same time, & the submitter also runs the tasks of
+ *        its own batch, so it always makes progress even when all the workers are busy. The tasks
+ *        should only write to their own slots, then the result doesn't depend on the scheduling.
+ * @version 0.1
+ * @date 2023-10-26
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdlib.h>
+#include <threads.h>
+/* */
+#include <worker_pool.h>
+
+/*
+ *
+ */
+typedef struct wp_batch {
+	WP_TASK_FUNC     func;
+	void            *arg;
+	int              ntasks;
+	int              next;      /* The next task to be taken */
+	int              finished;
+	struct wp_batch *next_batch;
+} WP_BATCH;
+
+/*
+ *
+ */
+struct worker_pool {
+	mtx_t     mutex;
+	cnd_t     wake;
+	cnd_t     done;
+	WP_BATCH *head;
+	int       terminate;
+	int       nthreads;
+	thrd_t    tids[WP_MAX_THREADS];
+};
+
+/* */
+static int       thread_worker( void * );
+static WP_BATCH *get_pending_batch( const WORKER_POOL * );
+static void      run_batch_task( WORKER_POOL *, WP_BATCH * );
+
+/**
+ * @brief Create the pool with the number of threads, include the submitting thread itself; therefore,
+ *        (nthreads - 1) workers will be started. It returns NULL when nthreads is less than 2, then
+ *        the batches will be just run by the submitter.
+ *
+ * @param nthreads
+ * @return WORKER_POOL*
+ */
+WORKER_POOL *wp_create( const int nthreads )
+{
+	WORKER_POOL *result;
+
+/* */
+	if ( nthreads < 2 || (result = calloc(1, sizeof(WORKER_POOL))) == NULL )
+		return NULL;
+	if ( mtx_init(&result->mutex, mtx_plain) != thrd_success ) {
+		free(result);
+		return NULL;
+	}
+	if ( cnd_init(&result->wake) != thrd_success ) {
+		mtx_destroy(&result->mutex);
+		free(result);
+		return NULL;
+	}
+	if ( cnd_init(&result->done) != thrd_success ) {
+		cnd_destroy(&result->wake);
+		mtx_destroy(&result->mutex);
+		free(result);
+		return NULL;
+	}
+/* */
+	for ( int i = 0; i < nthreads - 1 && i < WP_MAX_THREADS; i++ ) {
+		if ( thrd_create(&result->tids[i], thread_worker, result) != thrd_success )
+			break;
+		result->nthreads++;
+	}
+	if ( !result->nthreads ) {
+		wp_destroy( result );
+		return NULL;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Run the func with the arg & the index from 0 to (ntasks - 1), it will block until all the
+ *        tasks are finished. The pool could be NULL, then the tasks are run in order by the caller.
+ *
+ * @param pool
+ * @param func
+ * @param arg
+ * @param ntasks
+ * @return int
+ */
+int wp_run( WORKER_POOL *pool, WP_TASK_FUNC func, void *arg, const int ntasks )
+{
+	WP_BATCH   batch;
+	WP_BATCH **bptr;
+
+/* */
+	if ( !pool || ntasks < 2 ) {
+		for ( int i = 0; i < ntasks; i++ )
+			func( arg, i );
+		return 0;
+	}
+/* */
+	batch.func       = func;
+	batch.arg        = arg;
+	batch.ntasks     = ntasks;
+	batch.next       = 0;
+	batch.finished   = 0;
+	mtx_lock(&pool->mutex);
+	batch.next_batch = pool->head;
+	pool->head       = &batch;
+	cnd_broadcast(&pool->wake);
+/* Also take the tasks of its own batch */
+	while ( batch.next < batch.ntasks )
+		run_batch_task( pool, &batch );
+	while ( batch.finished < batch.ntasks )
+		cnd_wait(&pool->done, &pool->mutex);
+/* Remove it from the list */
+	for ( bptr = &pool->head; *bptr != &batch; bptr = &(*bptr)->next_batch );
+	*bptr = batch.next_batch;
+	mtx_unlock(&pool->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief The number of threads which run the batches, include the submitter.
+ *
+ * @param pool
+ * @return int
+ */
+int wp_threads( const WORKER_POOL *pool )
+{
+	return pool ? pool->nthreads + 1 : 1;
+}
+
+/**
+ * @brief Stop the workers, there shouldn't be any batch running.
+ *
+ * @param pool
+ */
+void wp_destroy( WORKER_POOL *pool )
+{
+	if ( !pool )
+		return;
+/* */
+	mtx_lock(&pool->mutex);
+	pool->terminate = 1;
+	cnd_broadcast(&pool->wake);
+	mtx_unlock(&pool->mutex);
+	for ( int i = 0; i < pool->nthreads; i++ )
+		thrd_join(pool->tids[i], NULL);
+/* */
+	cnd_destroy(&pool->done);
+	cnd_destroy(&pool->wake);
+	mtx_destroy(&pool->mutex);
+	free(pool);
+
+	return;
+}
+
+/**
+ * @brief
+ *
+ * @param arg
+ * @return int
+ */
+static int thread_worker( void *arg )
+{
+	WORKER_POOL *pool = (WORKER_POOL *)arg;
+	WP_BATCH    *batch;
+
+/* */
+	mtx_lock(&pool->mutex);
+	while ( !pool->terminate ) {
+		if ( (batch = get_pending_batch( pool )) )
+			run_batch_task( pool, batch );
+		else
+			cnd_wait(&pool->wake, &pool->mutex);
+	}
+	mtx_unlock(&pool->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief Find the batch which still has some tasks not taken, the mutex should be locked.
+ *
+ * @param pool
+ * @return WP_BATCH*
+ */
+static WP_BATCH *get_pending_batch( const WORKER_POOL *pool )
+{
+	for ( WP_BATCH *batch = pool->head; batch; batch = batch->next_batch )
+		if ( batch->next < batch->ntasks )
+			return batch;
+
+	return NULL;
+}
+
+/**
+ * @brief Take the next task of the batch & run it without the mutex, the mutex should be locked
+ *        when calling & it will be locked again when returning.
+ *
+ * @param pool
+ * @param batch
+ */
+static void run_batch_task( WORKER_POOL *pool, WP_BATCH *batch )
+{
+	const int index = batch->next++;
+
+/* */
+	mtx_unlock(&pool->mutex);
+	batch->func( batch->arg, index );
+	mtx_lock(&pool->mutex);
+/* */
+	if ( ++batch->finished == batch->ntasks )
+		cnd_broadcast(&pool->done);
+
+	return;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file velmod_conv.c
+ * @author Benjamin Yang in Department of Geology, National Taiwan University
+ * @brief Convert the text 3D velocity model to the binary model which can be mapped by earlyloc directly.
+ * @version 0.1
+ * @date 2023-10-23
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+/* Standard C header include */
+#include <stdio.h>
+/* */
+#include <raytracing.h>
+
+/* */
+#define PROG_NAME  "velmod_conv"
+
+/**
+ * @brief
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main( int argc, char **argv )
+{
+	RT_VELMOD *model;
+
+/* */
+	if ( argc != 3 ) {
+		fprintf(stderr, "Usage: %s <input text model> <output binary model>\n", PROG_NAME);
+		return -1;
+	}
+/* */
+	if ( (model = rt_velmod_load( argv[1] )) == NULL ) {
+		fprintf(stderr, "%s: Loading the model %s ERROR; exiting!\n", PROG_NAME, argv[1]);
+		return -1;
+	}
+	if ( rt_velmod_save( model, argv[2] ) ) {
+		fprintf(stderr, "%s: Writing the binary model %s ERROR; exiting!\n", PROG_NAME, argv[2]);
+		rt_velmod_free( model );
+		return -1;
+	}
+	rt_velmod_free( model );
+	fprintf(stderr, "%s: Converted %s to %s.\n", PROG_NAME, argv[1], argv[2]);
+
+	return 0;
+}